@@ -2,6 +2,7 @@
 #ifndef HNY_H
 #define HNY_H
 
+#include <stdbool.h>
 #include <sys/types.h>
 
 /**
@@ -38,6 +39,52 @@ enum hny_flags {
 	HNY_FLAGS_BLOCK = 1 << 0 /**< The prefix blocks until availability */
 };
 
+/**
+ * Name of the prefix directory holding content-addressed objects.
+ * Regular files extracted with #HNY_EXTRACTION_FLAGS_DEDUPLICATE are hard links
+ * to an object named after their content digest, mode and ownership.
+ * An object only linked by the store is unused, and removed by hny_remove() of the last package linking it.
+ */
+#define HNY_OBJECTS_DIRECTORY ".objects"
+
+/**
+ * Name of the manifest written at the root of a package directory extracted
+ * with #HNY_EXTRACTION_FLAGS_MANIFEST. It lists every extracted entry, sorted by path,
+ * with its type, mode, size and the SHA-256 digest of its content (or symbolic link target).
+ * The name is then reserved, and must not be part of the archive.
+ */
+#define HNY_MANIFEST_FILE ".manifest"
+
+/**
+ * Name of the directory of a delta archive describing how to derive the package
+ * from its base, see hny_extraction_delta(). It is reserved, and removed once the extraction ends:
+ * - `removed`: null-terminated paths of base entries absent from the package, directories after their content.
+ * - `patches/`: mirrors the package hierarchy, each file patches the base file at the same path.
+ *   A patch starts with the magic `HNYPATCH`, followed by operations building the new content:
+ *   `C` copies a range of the base file, with its offset and size, and `I` inserts bytes, with
+ *   their size followed by the bytes. Integers are unsigned 64 bits little-endian.
+ *   The patched file takes the mode, ownership and modification time of the patch.
+ */
+#define HNY_DELTA_DIRECTORY ".hny-delta"
+
+/**
+ * Name of the table of contents optionally archived first, see #HNY_PACK_FLAGS_TOC.
+ * It is alone in the first blocks of the xz stream, so listing the archive only decodes them,
+ * see hny_archive_list(). It is reserved, and never extracted. Its content, integers little-endian:
+ * - The magic `HNYTABLE`, then the number of entries as 64 bits.
+ * - For each other entry, in archive order: the offset of its header in the uncompressed archive
+ *   and the size of its content as 64 bits, its mode as 32 bits, the size of its path including
+ *   the terminating null byte as 32 bits, then its path.
+ */
+#define HNY_TOC_FILE ".hny-toc"
+
+/**
+ * Name of the package directory holding package-lifetime files, such as
+ * its setup and clean executables or its license. Archives should store it first,
+ * so extracting with #HNY_EXTRACTION_FLAGS_METADATA only decodes their beginning.
+ */
+#define HNY_METADATA_DIRECTORY "pkg"
+
 /**
  * Hook on a honey prefix
  * @param path prefix directory absolute path
@@ -97,7 +144,7 @@ hny_unlock(struct hny *hny);
 /**
  * Macro shortcut to determine if a status is an error.
  */
-#define HNY_EXTRACTION_STATUS_IS_ERROR(s) ((s) > HNY_EXTRACTION_STATUS_END)
+#define HNY_EXTRACTION_STATUS_IS_ERROR(s) ((s) > HNY_EXTRACTION_STATUS_END && (s) != HNY_EXTRACTION_STATUS_STOPPED)
 
 /**
  * Macro shortcut to determine if a status is an error related to xz.
@@ -107,15 +154,19 @@ hny_unlock(struct hny *hny);
 /**
  * Macro shortcut to determine if a status is an error related to cpio.
  */
-#define HNY_EXTRACTION_STATUS_IS_ERROR_CPIO(s) ((s) >= HNY_EXTRACTION_STATUS_ERROR_CPIO_HEADER_INVALID_MAGIC && (s) <= HNY_EXTRACTION_STATUS_ERROR_CPIO_WRITE)
+#define HNY_EXTRACTION_STATUS_IS_ERROR_CPIO(s) ((s) >= HNY_EXTRACTION_STATUS_ERROR_CPIO_HEADER_INVALID_MAGIC && (s) <= HNY_EXTRACTION_STATUS_ERROR_CPIO_DELTA)
 
 /**
  * Macro shortcut to determine if a status is an error related to cpio and a system interface.
  */
-#define HNY_EXTRACTION_STATUS_IS_ERROR_CPIO_SYSTEM(s) ((s) >= HNY_EXTRACTION_STATUS_ERROR_CPIO_MKDIR && (s) <= HNY_EXTRACTION_STATUS_ERROR_CPIO_WRITE)
+#define HNY_EXTRACTION_STATUS_IS_ERROR_CPIO_SYSTEM(s) ((s) >= HNY_EXTRACTION_STATUS_ERROR_CPIO_MKDIR && (s) <= HNY_EXTRACTION_STATUS_ERROR_CPIO_DELTA)
 
 /**
- * Opaque data type to represent a package extraction
+ * Opaque data type to represent a package extraction.
+ * An extraction never alters process-wide state such as the file mode creation mask
+ * or the working directory. Distinct extractions, on the same or different prefixes,
+ * can run concurrently from different threads. A single extraction must not be used
+ * by more than one thread at a time, nor its prefix be hny_close()'d meanwhile.
  */
 struct hny_extraction;
 
@@ -168,8 +219,109 @@ enum hny_extraction_status {
 	HNY_EXTRACTION_STATUS_ERROR_CPIO_CHOWN,
 	HNY_EXTRACTION_STATUS_ERROR_CPIO_CHMOD,
 	HNY_EXTRACTION_STATUS_ERROR_CPIO_WRITE,
+	HNY_EXTRACTION_STATUS_ERROR_CPIO_LINK,
+	HNY_EXTRACTION_STATUS_ERROR_CPIO_SYNC,
+	HNY_EXTRACTION_STATUS_ERROR_CPIO_SINK,
+	HNY_EXTRACTION_STATUS_ERROR_CPIO_MTIME,
+	HNY_EXTRACTION_STATUS_ERROR_CPIO_DELTA,
+
+	HNY_EXTRACTION_STATUS_STOPPED, /**< Ended before the end of the archive, see #HNY_EXTRACTION_FLAGS_METADATA */
+};
+
+/**
+ * Values used for extraction behaviour configuration
+ * @see hny_extraction_create3
+ */
+enum hny_extraction_flags {
+	HNY_EXTRACTION_FLAGS_NONE        = 0,      /**< No flags */
+	HNY_EXTRACTION_FLAGS_SPARSE      = 1 << 0, /**< Zero runs of at least one filesystem block are left as holes in regular files */
+	HNY_EXTRACTION_FLAGS_LINK        = 1 << 1, /**< Files identical to the base package are hard linked instead of cloned, see hny_extraction_base() */
+	HNY_EXTRACTION_FLAGS_DEDUPLICATE = 1 << 2, /**< Regular files are shared through the prefix content-addressed objects store, see #HNY_OBJECTS_DIRECTORY */
+	HNY_EXTRACTION_FLAGS_SYNCFS      = 1 << 3, /**< The extraction is made durable by syncing the prefix filesystem once it ends */
+	HNY_EXTRACTION_FLAGS_FDATASYNC   = 1 << 4, /**< The extraction is made durable by syncing each file in background threads, and directories once it ends */
+	HNY_EXTRACTION_FLAGS_PARALLEL    = 1 << 5, /**< Small regular files are buffered and written by background threads, other entries are still created in archive order */
+	HNY_EXTRACTION_FLAGS_URING       = 1 << 6, /**< Small regular files and symbolic links are committed in batches through io_uring when the system supports it */
+	HNY_EXTRACTION_FLAGS_PIPELINE    = 1 << 7, /**< Entries are unarchived by a dedicated thread, while the calling thread decompresses */
+	HNY_EXTRACTION_FLAGS_MANIFEST    = 1 << 8, /**< A manifest of extracted entries is written once the extraction ends, see #HNY_MANIFEST_FILE */
+	HNY_EXTRACTION_FLAGS_MTIME       = 1 << 9, /**< Modification times of the archive are applied, directories' once the extraction ends. Regular files' are part of their object's identity when deduplicating */
+	HNY_EXTRACTION_FLAGS_REINSTALL   = 1 << 10, /**< Extracts into an existing package directory, regular files with the archive's size and modification time are kept. Implies #HNY_EXTRACTION_FLAGS_MTIME */
+	HNY_EXTRACTION_FLAGS_WRITEBACK   = 1 << 11, /**< Large regular files are written back while written, and dropped from the page cache once on disk */
+	HNY_EXTRACTION_FLAGS_METADATA    = 1 << 12, /**< Only #HNY_METADATA_DIRECTORY and its content are extracted, the extraction stops with #HNY_EXTRACTION_STATUS_STOPPED once the archive moves past them */
+};
+
+/**
+ * Kinds of path patterns restricting the entries of an extraction
+ * @see hny_extraction_filter
+ */
+enum hny_extraction_filter {
+	HNY_EXTRACTION_FILTER_ONLY,    /**< Only entries matching one of these patterns are extracted */
+	HNY_EXTRACTION_FILTER_EXCLUDE, /**< Entries matching one of these patterns are not extracted */
+};
+
+/**
+ * Types of entries accounted by an extraction
+ * @see hny_extraction_stats
+ */
+enum hny_extraction_entry {
+	HNY_EXTRACTION_ENTRY_DIRECTORY, /**< Directories */
+	HNY_EXTRACTION_ENTRY_REGULAR,   /**< Regular files */
+	HNY_EXTRACTION_ENTRY_SYMLINK,   /**< Symbolic links */
+	HNY_EXTRACTION_ENTRY_FIFO,      /**< Named pipes */
+	HNY_EXTRACTION_ENTRY_DEVICE,    /**< Block and character devices */
+	HNY_EXTRACTION_ENTRY_OTHER,     /**< Sockets and unknown types, which are not extracted */
+};
+
+/**
+ * Number of values of ::hny_extraction_entry
+ */
+#define HNY_EXTRACTION_ENTRY_COUNT (HNY_EXTRACTION_ENTRY_OTHER + 1)
+
+/**
+ * Accounting of an extraction, indexed by ::hny_extraction_entry
+ * @see hny_extraction_stats
+ */
+struct hny_extraction_stats {
+	unsigned long entries[HNY_EXTRACTION_ENTRY_COUNT];  /**< Entries committed */
+	unsigned long syscalls[HNY_EXTRACTION_ENTRY_COUNT]; /**< System calls issued by the extracting thread to create, write and commit entries */
+	unsigned long long uncompressed;                    /**< Bytes of archive decompressed */
+};
+
+/**
+ * Entry of an archive, as given to a sink
+ * @see hny_sink
+ */
+struct hny_sink_entry {
+	const char *path; /**< Normalized path, relative to the package root */
+	mode_t mode;      /**< Type and permissions, as in st_mode */
+	uid_t uid;        /**< Owner recorded in the archive */
+	gid_t gid;        /**< Group recorded in the archive */
+	dev_t rdev;       /**< Device number, for block and character devices */
+	time_t mtime;     /**< Modification time recorded in the archive */
+	off_t size;       /**< Size of a regular file's content, or of a symbolic link's target, 0 else */
 };
 
+/**
+ * Destination of an extraction, instead of a package directory.
+ * Each entry is delivered in archive order: a call to begin, calls to data
+ * delivering exactly size bytes of a regular file's content or a symbolic link's
+ * target (not null-terminated), and a call to commit. An entry and its path are only
+ * valid during a callback. A callback returns 0 on success, or an error code which stops
+ * the extraction with #HNY_EXTRACTION_STATUS_ERROR_CPIO_SINK, see hny_extraction_errcode().
+ * @see hny_extraction_create_sink
+ */
+struct hny_sink {
+	int (*begin)(void *context, const struct hny_sink_entry *entry);
+	int (*data)(void *context, const char *buffer, size_t size);
+	int (*commit)(void *context, const struct hny_sink_entry *entry);
+};
+
+/**
+ * Sink discarding every entry. Extracting to it still decompresses the archive,
+ * verifies its checksums and decodes its entries, which verifies it without touching the filesystem.
+ * @see hny_extraction_create_sink
+ */
+extern const struct hny_sink hny_null_sink;
+
 /**
  * Create an extraction handler.
  * @param extractionp pointer to the handler.
@@ -192,6 +344,138 @@ hny_extraction_create(struct hny_extraction **extractionp, struct hny *hny, cons
 int
 hny_extraction_create2(struct hny_extraction **extractionp, struct hny *hny, const char *package, size_t size, size_t dictionarymax);
 
+/**
+ * Create an extraction handler.
+ * @param extractionp pointer to the handler.
+ * @param hny prefix of the package.
+ * @param package name of the package.
+ * @param size size of the intermediate buffer between xz and cpio steps.
+ * @param dictionarymax maximum size of the lzma2 dictionary.
+ * @param flags extraction behaviour, see ::hny_extraction_flags
+ * @return 0 on success, an error code else.
+ */
+int
+hny_extraction_create3(struct hny_extraction **extractionp, struct hny *hny, const char *package, size_t size, size_t dictionarymax, int flags);
+
+/**
+ * Create an extraction handler, delivering entries to a sink instead of a prefix.
+ * Flags only affecting files creation are ignored, hny_extraction_base() is unavailable.
+ * Only #HNY_EXTRACTION_FLAGS_PIPELINE and #HNY_EXTRACTION_FLAGS_METADATA apply.
+ * @param extractionp pointer to the handler.
+ * @param sink callbacks receiving entries, see ::hny_sink, must outlive the handler.
+ * @param context first argument of @p sink callbacks, eg. #hny_memory_sink's.
+ * @param size size of the intermediate buffer between xz and cpio steps.
+ * @param dictionarymax maximum size of the lzma2 dictionary.
+ * @param flags extraction behaviour, see ::hny_extraction_flags
+ * @return 0 on success, an error code else.
+ */
+int
+hny_extraction_create_sink(struct hny_extraction **extractionp, const struct hny_sink *sink, void *context, size_t size, size_t dictionarymax, int flags);
+
+/**
+ * Destination of a fan-out extraction, see hny_extraction_create_fanout().
+ */
+struct hny_extraction_target {
+	struct hny *hny; /**< Prefix of the package. */
+	const char *package; /**< Name of the package. */
+};
+
+/**
+ * Create an extraction handler, extracting a single decode of the archive into several packages.
+ * The first target is extracted as with hny_extraction_create3(), without #HNY_EXTRACTION_FLAGS_PARALLEL
+ * nor #HNY_EXTRACTION_FLAGS_URING so regular files are complete once decoded. Others materialize their
+ * regular files from the first target's, as for a base, see hny_extraction_base(): hard linked with
+ * #HNY_EXTRACTION_FLAGS_LINK, else cloned or copied in-kernel when possible.
+ * hny_extraction_base() only applies to the first target, so do statistics, see hny_extraction_stats().
+ * @param extractionp pointer to the handler.
+ * @param targets destination packages, all must be distinct.
+ * @param count number of @p targets, at least one.
+ * @param size size of the intermediate buffer between xz and cpio steps.
+ * @param dictionarymax maximum size of the lzma2 dictionary.
+ * @param flags extraction behaviour, see ::hny_extraction_flags
+ * @return 0 on success, an error code else.
+ */
+int
+hny_extraction_create_fanout(struct hny_extraction **extractionp, const struct hny_extraction_target *targets, size_t count, size_t size, size_t dictionarymax, int flags);
+
+/**
+ * Size of the memory region hny_extraction_create_static() requires.
+ * @param package name of the package.
+ * @param size size of the intermediate buffer between xz and cpio steps.
+ * @param dictionarymax maximum size of the lzma2 dictionary, reserved entirely.
+ * @return size in bytes, SIZE_MAX if it can't be represented.
+ */
+size_t
+hny_extraction_static_size(const char *package, size_t size, size_t dictionarymax);
+
+/**
+ * Create an extraction handler living in caller-provided memory, for a deterministic footprint.
+ * The handler, decompression dictionary and path buffers are carved from @p memory, and extracting
+ * never allocates: archives whose dictionary exceeds @p dictionarymax fail with #HNY_EXTRACTION_STATUS_ERROR_XZ_LZMA2_UNABLE_DICTIONARY_RESET,
+ * and paths or symbolic link targets longer than PATH_MAX with #HNY_EXTRACTION_STATUS_ERROR_CPIO_MEMORY_EXHAUSTED.
+ * Only #HNY_EXTRACTION_FLAGS_SPARSE, #HNY_EXTRACTION_FLAGS_SYNCFS, #HNY_EXTRACTION_FLAGS_WRITEBACK
+ * and #HNY_EXTRACTION_FLAGS_METADATA are supported, hny_extraction_base() and hny_extraction_filter() are unavailable.
+ * Created entries aren't journaled, hny_extraction_abort() removes the package with hny_remove().
+ * hny_extraction_destroy() must still be called, @p memory can then be reused.
+ * @param extractionp pointer to the handler.
+ * @param hny prefix of the package.
+ * @param package name of the package.
+ * @param memory region the handler lives in, must outlive it.
+ * @param memorysize size of @p memory, see hny_extraction_static_size().
+ * @param size size of the intermediate buffer between xz and cpio steps.
+ * @param dictionarymax maximum size of the lzma2 dictionary.
+ * @param flags extraction behaviour, see ::hny_extraction_flags
+ * @return 0 on success, ENOBUFS if @p memory is too small, an error code else.
+ */
+int
+hny_extraction_create_static(struct hny_extraction **extractionp, struct hny *hny, const char *package,
+	void *memory, size_t memorysize, size_t size, size_t dictionarymax, int flags);
+
+/**
+ * Sets a base package, usually the previous version of the extracted one.
+ * Each regular file whose content is identical to the file at the same path
+ * in the base package is cloned from it (or hard linked with #HNY_EXTRACTION_FLAGS_LINK
+ * when metadata also matches), instead of being written. Contents are compared while decoding.
+ * Must be called before the first call to hny_extraction_extract().
+ * @param extraction extraction handler
+ * @param base name of the base package, in the same prefix.
+ * @return 0 on success, an error code else.
+ */
+int
+hny_extraction_base(struct hny_extraction *extraction, const char *base);
+
+/**
+ * Extracts a delta archive against an installed base package, usually its previous version.
+ * The package is first populated with a clone of the base (hard linked with #HNY_EXTRACTION_FLAGS_LINK),
+ * then the archive's entries are extracted over it: directories are kept, other entries replace cloned ones,
+ * regular files being compared against the base as with hny_extraction_base(), never modified through a link to it.
+ * Its #HNY_DELTA_DIRECTORY is applied once every entry was extracted.
+ * Only regular files added, modified as a whole or patched and directories holding them need to be archived.
+ * Unavailable with #HNY_EXTRACTION_FLAGS_MANIFEST, #HNY_EXTRACTION_FLAGS_METADATA, #HNY_EXTRACTION_FLAGS_REINSTALL,
+ * #HNY_EXTRACTION_FLAGS_FDATASYNC, fan-outs and static extractions. Entries cloned from the base aren't journaled,
+ * hny_extraction_abort() removes the package with hny_remove().
+ * Must be called before the first call to hny_extraction_extract().
+ * @param extraction extraction handler
+ * @param base name of the base package, in the same prefix.
+ * @return 0 on success, an error code else.
+ */
+int
+hny_extraction_delta(struct hny_extraction *extraction, const char *base);
+
+/**
+ * Adds a pattern restricting extracted entries. Patterns are fnmatch(3) globs matched
+ * against normalized paths, a pattern matching a directory also matches its content.
+ * Directories leading to entries which may match an #HNY_EXTRACTION_FILTER_ONLY pattern are kept.
+ * Filtered out entries are still decoded, but neither created, written, accounted nor listed in the manifest.
+ * Must be called before the first call to hny_extraction_extract().
+ * @param extraction extraction handler
+ * @param pattern glob pattern, relative to the package root.
+ * @param filter kind of the pattern, see ::hny_extraction_filter
+ * @return 0 on success, an error code else.
+ */
+int
+hny_extraction_filter(struct hny_extraction *extraction, const char *pattern, enum hny_extraction_filter filter);
+
 /**
  * Destroys a previously hny_extraction_create()'d extraction handler
  * @param extraction Handler to destroy
@@ -199,13 +483,27 @@ hny_extraction_create2(struct hny_extraction **extractionp, struct hny *hny, con
 void
 hny_extraction_destroy(struct hny_extraction *extraction);
 
+/**
+ * Rolls back an unfinished extraction, usually after an error. The extraction keeps
+ * a journal of the entries it creates, which are unlinked in reverse order without
+ * walking the package directory, which is then removed if the extraction created it.
+ * Entries kept by #HNY_EXTRACTION_FLAGS_REINSTALL are left untouched, objects
+ * shared with #HNY_EXTRACTION_FLAGS_DEDUPLICATE are left to hny_remove().
+ * The handler must then only be hny_extraction_destroy()'d.
+ * @param extraction extraction handler, not extracting to a sink.
+ * @return 0 on success, the first error code encountered else.
+ */
+int
+hny_extraction_abort(struct hny_extraction *extraction);
+
 /**
  * Extracts an archive from a byte stream
  * @param extraction extraction handler
  * @param buffer bytes to extract
  * @param size size of @p buffer
  * @return #HNY_EXTRACTION_STATUS_OK if extracting, #HNY_EXTRACTION_STATUS_END
- * when successfull extraction is done. Else the step in which an error occurred.
+ * when successfull extraction is done, and durable if requested, #HNY_EXTRACTION_STATUS_STOPPED
+ * likewise if the rest of the archive wasn't needed. Else the step in which an error occurred.
  */
 enum hny_extraction_status
 hny_extraction_extract(struct hny_extraction *extraction, const char *buffer, size_t size);
@@ -218,6 +516,75 @@ hny_extraction_extract(struct hny_extraction *extraction, const char *buffer, si
 int
 hny_extraction_errcode(struct hny_extraction *extraction);
 
+/**
+ * Get accounting of entries extracted so far.
+ * With #HNY_EXTRACTION_FLAGS_PIPELINE, only valid once hny_extraction_extract() stopped returning #HNY_EXTRACTION_STATUS_OK.
+ * @param extraction extraction handler
+ * @param stats Pointer to return the accounting.
+ */
+void
+hny_extraction_stats(const struct hny_extraction *extraction, struct hny_extraction_stats *stats);
+
+/**
+ * Opaque data type to represent an in-memory image of a package
+ * @see hny_memory_sink
+ */
+struct hny_memory;
+
+/**
+ * Entry of an in-memory image of a package
+ * @see hny_memory_entries
+ */
+struct hny_memory_entry {
+	const char *path; /**< Normalized path, relative to the package root */
+	mode_t mode;      /**< Type and permissions, as in st_mode */
+	uid_t uid;        /**< Owner recorded in the archive */
+	gid_t gid;        /**< Group recorded in the archive */
+	dev_t rdev;       /**< Device number, for block and character devices */
+	time_t mtime;     /**< Modification time recorded in the archive */
+	const char *data; /**< Content of a regular file, or null-terminated target of a symbolic link, NULL else */
+	size_t size;      /**< Size of data, without the null byte of a symbolic link target */
+};
+
+/**
+ * Sink storing entries into a ::hny_memory, given as the sink context.
+ * @see hny_extraction_create_sink
+ */
+extern const struct hny_sink hny_memory_sink;
+
+/**
+ * Create an empty in-memory image of a package.
+ * @param memoryp Pointer to return the image on success.
+ * @return 0 on success, an error code else.
+ */
+int
+hny_memory_create(struct hny_memory **memoryp);
+
+/**
+ * Destroys a previously hny_memory_create()'d image, and all its entries.
+ * @param memory Image to destroy.
+ */
+void
+hny_memory_destroy(struct hny_memory *memory);
+
+/**
+ * Get entries of an image, in archive order.
+ * @param memory image, must not be filled concurrently.
+ * @param entriesp Pointer to return entries, valid until the image receives another entry.
+ * @return Number of entries.
+ */
+size_t
+hny_memory_entries(const struct hny_memory *memory, const struct hny_memory_entry **entriesp);
+
+/**
+ * Find an entry of an image by its path.
+ * @param memory image, must not be filled concurrently.
+ * @param path normalized path, relative to the package root.
+ * @return The entry, valid until the image receives another entry, NULL if not found.
+ */
+const struct hny_memory_entry *
+hny_memory_find(const struct hny_memory *memory, const char *path);
+
 /**
  * Replaces the target of a geist.
  * @param hny honey prefix
@@ -230,7 +597,9 @@ hny_shift(struct hny *hny, const char *geist, const char *target);
 
 /**
  * Depending on type of @p entry, it will unlink a #HNY_TYPE_GEIST
- * and recursively remove a #HNY_TYPE_PACKAGE.
+ * and recursively remove a #HNY_TYPE_PACKAGE. Entries listed in the package's
+ * #HNY_MANIFEST_FILE are removed without walking directories, anything left is then walked.
+ * Removing a package also collects objects it was the last user of in #HNY_OBJECTS_DIRECTORY.
  * @param hny honey prefix
  * @param entry entry to remove
  * @return 0 on success, an error code else.
@@ -238,6 +607,173 @@ hny_shift(struct hny *hny, const char *geist, const char *target);
 int
 hny_remove(struct hny *hny, const char *entry);
 
+/**
+ * Prefix of cache keys, followed by the lowercase hexadecimal SHA-256 digest of the archive.
+ * Keys are package names, so a cache is a honey prefix holding one pristine extracted tree per archive.
+ * @see hny_cache_key
+ */
+#define HNY_CACHE_KEY_PREFIX "sha256-"
+
+/**
+ * Size of a cache key, including its null terminator.
+ * @see hny_cache_key
+ */
+#define HNY_CACHE_KEY_SIZE (sizeof (HNY_CACHE_KEY_PREFIX) + 64)
+
+/**
+ * Computes the cache key of an archive, the name of its extracted tree in a cache prefix.
+ * The archive is read with positional reads, @p fd offset is left as is.
+ * @param fd file descriptor of the archive.
+ * @param key filled with the null-terminated key, a valid package name.
+ * @return 0 on success, an error code else.
+ */
+int
+hny_cache_key(int fd, char key[HNY_CACHE_KEY_SIZE]);
+
+/**
+ * Creates @p package in @p hny as a copy of @p sourcepackage in @p source, usually a cache
+ * prefix whose packages are named after cache keys, see hny_cache_key(). Nothing is decoded:
+ * regular files are hard linked with #HNY_EXTRACTION_FLAGS_LINK, else cloned or copied in-kernel
+ * when possible. Permissions, ownership and modification times are preserved, except for the package directory itself.
+ * If cloning fails, @p package is removed.
+ * @param hny honey prefix to create @p package in.
+ * @param package name of the package to create.
+ * @param source honey prefix of @p sourcepackage, may be @p hny.
+ * @param sourcepackage name of the package to clone, ENOENT is returned if it doesn't exist.
+ * @param flags only #HNY_EXTRACTION_FLAGS_LINK, #HNY_EXTRACTION_FLAGS_SYNCFS and #HNY_EXTRACTION_FLAGS_FDATASYNC apply,
+ * both durability flags sync the prefix filesystem once cloned, see ::hny_extraction_flags
+ * @return 0 on success, an error code else.
+ */
+int
+hny_clone(struct hny *hny, const char *package, struct hny *source, const char *sourcepackage, int flags);
+
+/**
+ * Opaque data type to represent a mapped bundle, archives of several packages
+ * concatenated and followed by an index of their names, offsets and sizes.
+ * @see hny_bundle_open
+ */
+struct hny_bundle;
+
+/**
+ * Member of a bundle
+ * @see hny_bundle_members
+ */
+struct hny_bundle_member {
+	const char *package; /**< Name of the package the archive is extracted as */
+	const char *data;    /**< Archive of the package */
+	size_t size;         /**< Size of data */
+};
+
+/**
+ * Outcome of the extraction of a bundle member
+ * @see hny_bundle_extract
+ */
+struct hny_bundle_result {
+	bool attempted;                     /**< Whether extraction started, members aren't attempted anymore once one fails */
+	enum hny_extraction_status status;  /**< As returned by hny_extraction_extract(), #HNY_EXTRACTION_STATUS_OK if unfinished or never created */
+	int errcode;                        /**< Error code if the extraction couldn't be created or a syscall failed, 0 else */
+};
+
+/**
+ * Writes a bundle of archives, see the bundle format in docs/file-format.md.
+ * @param fd file descriptor to write the bundle to, at its current offset. Offsets recorded
+ * in the bundle are from the start of the file, which may hold other content before the bundle.
+ * Pipes and other unseekable files are considered written from their start.
+ * @param members archives and the names of their packages, in bundle order.
+ * @param count number of members.
+ * @return 0 on success, an error code else.
+ */
+int
+hny_bundle_write(int fd, const struct hny_bundle_member *members, size_t count);
+
+/**
+ * Maps a bundle and validates its index.
+ * @param bundlep pointer to return the bundle on success.
+ * @param fd file descriptor of the bundle, may be closed once opened.
+ * @return 0 on success, EINVAL if it isn't a valid bundle, an error code else.
+ */
+int
+hny_bundle_open(struct hny_bundle **bundlep, int fd);
+
+/**
+ * Unmaps a previously hny_bundle_open()'d bundle.
+ * @param bundle bundle to close.
+ */
+void
+hny_bundle_close(struct hny_bundle *bundle);
+
+/**
+ * Get members of a bundle, in bundle order.
+ * @param bundle bundle.
+ * @param membersp pointer to return members, valid until the bundle is closed.
+ * @return Number of members.
+ */
+size_t
+hny_bundle_members(const struct hny_bundle *bundle, const struct hny_bundle_member **membersp);
+
+/**
+ * Extracts every member of a bundle into @p hny, in parallel. Each worker thread reuses
+ * a single region for all its extractions, see hny_extraction_create_static(), sized for the largest
+ * dictionary declared by the members' blocks, up to @p dictionarymax, and the longest package name of the bundle.
+ * The prefix isn't locked, callers usually hold its lock for the whole run.
+ * Once a member fails it is rolled back, other workers finish their current member and take no more.
+ * @param bundle bundle to extract.
+ * @param hny prefix to extract members into.
+ * @param jobs number of workers, including the calling thread, 0 for the number of online processors.
+ * @param dictionarymax maximum size of the lzma2 dictionary, members declaring a larger one fail.
+ * @param flags extraction behaviour, restricted as with hny_extraction_create_static(), see ::hny_extraction_flags
+ * @param results filled with the outcome of each member, as many as hny_bundle_members().
+ * @return 0 if every member was extracted, ECANCELED if one failed, an error code if none could be.
+ */
+int
+hny_bundle_extract(struct hny_bundle *bundle, struct hny *hny, unsigned int jobs, size_t dictionarymax, int flags, struct hny_bundle_result *results);
+
+/**
+ * Flags for hny_pack()
+ */
+enum hny_pack_flags {
+	HNY_PACK_FLAGS_NONE = 0,
+	HNY_PACK_FLAGS_TOC  = 1 << 0, /**< Archives a #HNY_TOC_FILE first, listing every other entry, in blocks of its own */
+};
+
+/**
+ * Entry of an archive's table of contents
+ * @see hny_archive_list
+ */
+struct hny_archive_entry {
+	const char *path; /**< Normalized path, without trailing slash. */
+	mode_t mode; /**< Type and permissions. */
+	off_t size; /**< Size of a regular file's content or a symbolic link's target, 0 else. */
+	off_t offset; /**< Offset of the entry's header in the uncompressed archive. */
+};
+
+/**
+ * Writes a package archive, an odc cpio archive compressed as an xz stream of
+ * independent blocks, each of CONFIG_HNY_PACK_BLOCK_SIZE uncompressed bytes but the last.
+ * Blocks are compressed in parallel and declare their sizes, so extractions can decode them in parallel too.
+ * Hard links aren't preserved, each of them is archived as its own file.
+ * @param dirfd directory holding the package's files.
+ * @param entries paths relative to @p dirfd to archive in order, NULL to archive the whole directory,
+ * @p pkg/ first then every directory in name order, each followed by its content.
+ * @param count number of @p entries.
+ * @param fd file descriptor to write the archive to, at its current offset.
+ * @param jobs number of compression threads, 0 for the number of online processors.
+ * @param flags packing behaviour, see ::hny_pack_flags
+ * @return 0 on success, EINVAL if an entry isn't normalized or doesn't follow its parent directory, an error code else.
+ */
+int
+hny_pack(int dirfd, const char * const *entries, size_t count, int fd, unsigned int jobs, int flags);
+
+/**
+ * Lists the entries of an archive from its #HNY_TOC_FILE, only decoding the blocks holding it.
+ * @param fd file descriptor of the archive, read from its beginning whatever its offset.
+ * @param entriesp pointer to return the entries in archive order, a single allocation to free().
+ * @param countp pointer to return the number of entries.
+ * @return 0 on success, ENOENT if the archive has no table of contents, EINVAL if it is invalid, an error code else.
+ */
+int
+hny_archive_list(int fd, struct hny_archive_entry **entriesp, size_t *countp);
+
 #define HNY_SPAWN_STATUS_ERROR 127
 
 /**
@@ -6,13 +6,17 @@
 #include <stdbool.h>
 #include <stdnoreturn.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
+#include <limits.h>
 #include <alloca.h>
 #include <dirent.h>
 #include <libgen.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <errno.h>
 #include <err.h>
 
@@ -29,12 +33,141 @@ struct hny_buffer {
 };
 
 static void
-hny_subcommand_extract(struct hny *hny, char **argpos, char **argend) {
-	const char *package, *filename;
+hny_subcommand_extract(const struct hny_args *args, char **argpos, char **argend) {
+	int flags = HNY_EXTRACTION_FLAGS_NONE;
+	const char *package, *filename, *base = NULL, *delta = NULL, *cachepath = NULL;
+	bool stats = false, verify = false, cached = false;
+	char key[HNY_CACHE_KEY_SIZE], staging[HNY_CACHE_KEY_SIZE + 1];
+	struct hny *hny = NULL, *cache = NULL;
+	const char **patterns, **fanouts;
+	enum hny_extraction_filter *filters;
+	size_t patternscount = 0, fanoutscount = 0;
+	struct hny_extraction_target *targets, *first;
+	size_t count;
 	char *buffer;
 	size_t size;
 	int fd;
 
+	{ /* Options parsing, argpos[-1] is the subcommand name */
+		static const struct option longopts[] = {
+			{ "base", required_argument, NULL, 'B' },
+			{ "cache", required_argument, NULL, 'C' },
+			{ "deduplicate", no_argument, NULL, 'd' },
+			{ "durability", required_argument, NULL, 'D' },
+			{ "delta", required_argument, NULL, 'e' },
+			{ "fanout", required_argument, NULL, 'F' },
+			{ "metadata", no_argument, NULL, 'i' },
+			{ "link", no_argument, NULL, 'l' },
+			{ "manifest", no_argument, NULL, 'm' },
+			{ "mtime", no_argument, NULL, 'M' },
+			{ "only", required_argument, NULL, 'o' },
+			{ "parallel", no_argument, NULL, 'P' },
+			{ "pipeline", no_argument, NULL, 'T' },
+			{ "reinstall", no_argument, NULL, 'R' },
+			{ "sparse", no_argument, NULL, 's' },
+			{ "stats", no_argument, NULL, 'S' },
+			{ "uring", no_argument, NULL, 'u' },
+			{ "verify", no_argument, NULL, 'V' },
+			{ "writeback", no_argument, NULL, 'W' },
+			{ "exclude", required_argument, NULL, 'x' },
+			{ NULL, 0, NULL, 0 },
+		};
+		int c;
+
+		/* There can't be more patterns than arguments */
+		patterns = alloca(sizeof (*patterns) * (argend - argpos));
+		filters = alloca(sizeof (*filters) * (argend - argpos));
+		fanouts = alloca(sizeof (*fanouts) * (argend - argpos));
+
+		optind = 1;
+		while (c = getopt_long(argend - argpos + 1, argpos - 1, "+:B:C:dD:e:F:ilmMo:PRsSTuVWx:", longopts, NULL), c != -1) {
+			switch (c) {
+			case 'B':
+				base = optarg;
+				break;
+			case 'C':
+				cachepath = optarg;
+				break;
+			case 'd':
+				flags |= HNY_EXTRACTION_FLAGS_DEDUPLICATE;
+				break;
+			case 'D':
+				flags &= ~(HNY_EXTRACTION_FLAGS_SYNCFS | HNY_EXTRACTION_FLAGS_FDATASYNC);
+				if (strcmp("syncfs", optarg) == 0) {
+					flags |= HNY_EXTRACTION_FLAGS_SYNCFS;
+				} else if (strcmp("fdatasync", optarg) == 0) {
+					flags |= HNY_EXTRACTION_FLAGS_FDATASYNC;
+				} else if (strcmp("none", optarg) != 0) {
+					errx(EXIT_FAILURE, "extract: Invalid durability '%s'", optarg);
+				}
+				break;
+			case 'e':
+				delta = optarg;
+				break;
+			case 'F':
+				fanouts[fanoutscount] = optarg;
+				fanoutscount++;
+				break;
+			case 'i':
+				flags |= HNY_EXTRACTION_FLAGS_METADATA;
+				break;
+			case 'l':
+				flags |= HNY_EXTRACTION_FLAGS_LINK;
+				break;
+			case 'm':
+				flags |= HNY_EXTRACTION_FLAGS_MANIFEST;
+				break;
+			case 'M':
+				flags |= HNY_EXTRACTION_FLAGS_MTIME;
+				break;
+			case 'o':
+				patterns[patternscount] = optarg;
+				filters[patternscount] = HNY_EXTRACTION_FILTER_ONLY;
+				patternscount++;
+				break;
+			case 'P':
+				flags |= HNY_EXTRACTION_FLAGS_PARALLEL;
+				break;
+			case 'R':
+				flags |= HNY_EXTRACTION_FLAGS_REINSTALL;
+				break;
+			case 's':
+				flags |= HNY_EXTRACTION_FLAGS_SPARSE;
+				break;
+			case 'S':
+				stats = true;
+				break;
+			case 'T':
+				flags |= HNY_EXTRACTION_FLAGS_PIPELINE;
+				break;
+			case 'u':
+				flags |= HNY_EXTRACTION_FLAGS_URING;
+				break;
+			case 'V':
+				verify = true;
+				break;
+			case 'W':
+				flags |= HNY_EXTRACTION_FLAGS_WRITEBACK;
+				break;
+			case 'x':
+				patterns[patternscount] = optarg;
+				filters[patternscount] = HNY_EXTRACTION_FILTER_EXCLUDE;
+				patternscount++;
+				break;
+			case ':':
+				errx(EXIT_FAILURE, "extract: Option '%s' requires an operand", argpos[optind - 2]);
+			default:
+				if (optopt != 0) {
+					errx(EXIT_FAILURE, "extract: Unrecognized option -%c", optopt);
+				} else {
+					errx(EXIT_FAILURE, "extract: Unrecognized option '%s'", argpos[optind - 2]);
+				}
+			}
+		}
+
+		argpos += optind - 1;
+	}
+
 	{ /* Argument parsing */
 		switch (argend - argpos) {
 		case 0:
@@ -60,6 +193,22 @@ hny_subcommand_extract(struct hny *hny, char **argpos, char **argend) {
 		}
 	}
 
+	if (verify && fanoutscount != 0) {
+		errx(EXIT_FAILURE, "extract: Verifying doesn't extract into fan-out prefixes");
+	}
+
+	/* Cached trees must be complete and pristine, and cache hits are cloned without any extraction */
+	if (cachepath != NULL && (verify || base != NULL || patternscount != 0
+		|| (flags & (HNY_EXTRACTION_FLAGS_METADATA | HNY_EXTRACTION_FLAGS_REINSTALL | HNY_EXTRACTION_FLAGS_MANIFEST | HNY_EXTRACTION_FLAGS_DEDUPLICATE | HNY_EXTRACTION_FLAGS_SPARSE)))) {
+		errx(EXIT_FAILURE, "extract: Caching is incompatible with verifying, base, filters, metadata, reinstall, manifest, deduplication and sparse files");
+	}
+
+	/* The package is derived from the delta's base, as a whole */
+	if (delta != NULL && (verify || cachepath != NULL || fanoutscount != 0 || base != NULL || patternscount != 0
+		|| (flags & (HNY_EXTRACTION_FLAGS_METADATA | HNY_EXTRACTION_FLAGS_MANIFEST | HNY_EXTRACTION_FLAGS_REINSTALL | HNY_EXTRACTION_FLAGS_FDATASYNC)))) {
+		errx(EXIT_FAILURE, "extract: Delta is incompatible with verifying, caching, fan-out, base, filters, metadata, manifest, reinstall and fdatasync");
+	}
+
 	/* Opening input file */
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
@@ -70,32 +219,160 @@ hny_subcommand_extract(struct hny *hny, char **argpos, char **argend) {
 	size = getpagesize();
 	buffer = alloca(size);
 
-	/* Lock prefix */
-	if (errno = hny_lock(hny), errno != 0) {
-		err(EXIT_FAILURE, "extract: Unable to lock prefix '%s'", filename);
+	/* Open and lock prefix, verifying doesn't need one */
+	if (!verify) {
+		if (errno = hny_open(&hny, args->prefix, args->flags), errno != 0) {
+			err(EXIT_FAILURE, "extract: Unable to open prefix '%s'", args->prefix);
+		}
+
+		if (errno = hny_lock(hny), errno != 0) {
+			err(EXIT_FAILURE, "extract: Unable to lock prefix '%s'", args->prefix);
+		}
 	}
 
-	{ /* Extraction loop */
+	/* Opening and locking fan-out prefixes, the package is extracted under the same name in each.
+	 * The first slot is reserved for the cache, extracted first so others can be cloned from it. */
+	targets = alloca(sizeof (*targets) * (fanoutscount + 2));
+	targets[1].hny = hny;
+	targets[1].package = package;
+	for (size_t i = 0; i < fanoutscount + (cachepath != NULL); i++) {
+		const char * const path = i < fanoutscount ? fanouts[i] : cachepath;
+		const int prefixflags = hny_flags(hny, HNY_FLAGS_NONE);
+		struct hny *other;
+
+		hny_flags(hny, prefixflags);
+
+		if (errno = hny_open(&other, path, prefixflags), errno != 0) {
+			err(EXIT_FAILURE, "extract: Unable to open prefix '%s'", path);
+		}
+
+		if (errno = hny_lock(other), errno != 0) {
+			err(EXIT_FAILURE, "extract: Unable to lock prefix '%s'", path);
+		}
+
+		if (i < fanoutscount) {
+			targets[i + 2].hny = other;
+			targets[i + 2].package = package;
+		} else {
+			cache = other;
+		}
+	}
+	first = targets + 1;
+	count = fanoutscount + 1;
+
+	if (cache != NULL) { /* Cloning from the cache if the archive was already extracted there */
+		if (errno = hny_cache_key(fd, key), errno != 0) {
+			err(EXIT_FAILURE, "extract: Unable to read from '%s'", filename);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			errno = hny_clone(first[i].hny, package, cache, key, flags);
+			if (errno == ENOENT && i == 0) {
+				break;
+			}
+
+			if (errno != 0) {
+				const int errcode = errno;
+
+				while (i != 0) {
+					i--;
+					hny_remove(first[i].hny, package);
+				}
+				errno = errcode;
+
+				err(EXIT_FAILURE, "extract: Unable to clone '%s' from cache '%s'", key, cachepath);
+			}
+
+			cached = true;
+		}
+
+		if (!cached) {
+			/* Extracted under a staging name, published once complete, leftovers of an interrupted extraction are dropped */
+			snprintf(staging, sizeof (staging), "partial-%s", key + sizeof (HNY_CACHE_KEY_PREFIX) - 1);
+			hny_remove(cache, staging);
+
+			targets[0].hny = cache;
+			targets[0].package = staging;
+			first = targets;
+			count++;
+		}
+	}
+
+	if (!cached) { /* Extraction loop */
 		struct hny_extraction *extraction;
 		enum hny_extraction_status status;
+		struct timespec start, end;
+		off_t consumed = 0, dropped = 0;
 		ssize_t readval;
 
-		if (errno = hny_extraction_create(&extraction, hny, package), errno != 0) {
+		if (verify) {
+			errno = hny_extraction_create_sink(&extraction, &hny_null_sink, NULL, CONFIG_HNY_EXTRACTION_BUFFERSIZE_DEFAULT, CONFIG_HNY_EXTRACTION_DICTIONARYMAX_DEFAULT, flags);
+		} else if (count > 1) {
+			errno = hny_extraction_create_fanout(&extraction, first, count, CONFIG_HNY_EXTRACTION_BUFFERSIZE_DEFAULT, CONFIG_HNY_EXTRACTION_DICTIONARYMAX_DEFAULT, flags);
+		} else {
+			errno = hny_extraction_create3(&extraction, hny, package, CONFIG_HNY_EXTRACTION_BUFFERSIZE_DEFAULT, CONFIG_HNY_EXTRACTION_DICTIONARYMAX_DEFAULT, flags);
+		}
+
+		if (errno != 0) {
 			err(EXIT_FAILURE, "extract: Unable to extract '%s'", filename);
 		}
 
-		while ((readval = read(fd, buffer, size), readval >= 0) && (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK));
+		if (!verify && base != NULL && (errno = hny_extraction_base(extraction, base), errno != 0)) {
+			err(EXIT_FAILURE, "extract: Unable to use '%s' as base package", base);
+		}
 
-		if (readval == -1) {
-			err(EXIT_FAILURE, "extract: Unable to read from '%s'", filename);
+		if (delta != NULL && (errno = hny_extraction_delta(extraction, delta), errno != 0)) {
+			const int errcode = errno;
+
+			hny_extraction_abort(extraction);
+			errno = errcode;
+
+			err(EXIT_FAILURE, "extract: Unable to use '%s' as delta base package", delta);
 		}
 
-		if (HNY_EXTRACTION_STATUS_IS_ERROR(status)) {
+		for (size_t i = 0; i < patternscount; i++) {
+			if (errno = hny_extraction_filter(extraction, patterns[i], filters[i]), errno != 0) {
+				err(EXIT_FAILURE, "extract: Invalid pattern '%s'", patterns[i]);
+			}
+		}
+
+		/* The archive is read once, from start to end */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		while ((readval = read(fd, buffer, size), readval > 0) && (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK)) {
+			consumed += readval;
+			if ((flags & HNY_EXTRACTION_FLAGS_WRITEBACK) && consumed - dropped >= CONFIG_HNY_EXTRACTION_WRITEBACK_WINDOW) {
+				posix_fadvise(fd, dropped, consumed - dropped, POSIX_FADV_DONTNEED);
+				dropped = consumed;
+			}
+		}
+
+		if (readval <= 0 || HNY_EXTRACTION_STATUS_IS_ERROR(status)) {
+			const int errcode = readval == -1 ? errno : hny_extraction_errcode(extraction);
+
+			/* Leave the prefix as it was before */
+			if (!verify) {
+				hny_extraction_abort(extraction);
+			}
+			errno = errcode;
+
+			if (readval == -1) {
+				err(EXIT_FAILURE, "extract: Unable to read from '%s'", filename);
+			}
+
+			if (readval == 0) {
+				errx(EXIT_FAILURE, "extract: Unable to extract '%s', unexpected end of file", filename);
+			}
+
 			if (HNY_EXTRACTION_STATUS_IS_ERROR_XZ(status)) {
 				errx(EXIT_FAILURE, "extract: Unable to extract '%s', error while uncompressing", filename);
 			} else if (HNY_EXTRACTION_STATUS_IS_ERROR_CPIO(status)) {
 				if (HNY_EXTRACTION_STATUS_IS_ERROR_CPIO_SYSTEM(status)) {
-					errno = hny_extraction_errcode(extraction);
+					if (status == HNY_EXTRACTION_STATUS_ERROR_CPIO_SYNC) {
+						err(EXIT_FAILURE, "extract: Unable to extract '%s', error while syncing", filename);
+					}
 					err(EXIT_FAILURE, "extract: Unable to extract '%s', error while unarchiving", filename);
 				} else {
 					errx(EXIT_FAILURE, "extract: Unable to extract '%s', error while unarchiving", filename);
@@ -105,13 +382,368 @@ hny_subcommand_extract(struct hny *hny, char **argpos, char **argend) {
 			}
 		}
 
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (verify) {
+			const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+			struct hny_extraction_stats extractionstats;
+			unsigned long entries = 0;
+
+			hny_extraction_stats(extraction, &extractionstats);
+			for (unsigned int i = 0; i < HNY_EXTRACTION_ENTRY_COUNT; i++) {
+				entries += extractionstats.entries[i];
+			}
+
+			printf("%s: %lu entries, %llu bytes uncompressed, %.1f MiB/s\n", filename, entries, extractionstats.uncompressed,
+				seconds > 0 ? extractionstats.uncompressed / seconds / (1024 * 1024) : 0.0);
+		}
+
+		if (stats) {
+			static const char * const entries[] = {
+				[HNY_EXTRACTION_ENTRY_DIRECTORY] = "directory",
+				[HNY_EXTRACTION_ENTRY_REGULAR] = "regular",
+				[HNY_EXTRACTION_ENTRY_SYMLINK] = "symlink",
+				[HNY_EXTRACTION_ENTRY_FIFO] = "fifo",
+				[HNY_EXTRACTION_ENTRY_DEVICE] = "device",
+				[HNY_EXTRACTION_ENTRY_OTHER] = "other",
+			};
+			struct hny_extraction_stats extractionstats;
+
+			hny_extraction_stats(extraction, &extractionstats);
+			for (unsigned int i = 0; i < HNY_EXTRACTION_ENTRY_COUNT; i++) {
+				printf("%s: %lu entries, %lu syscalls\n", entries[i], extractionstats.entries[i], extractionstats.syscalls[i]);
+			}
+		}
+
 		hny_extraction_destroy(extraction);
+
+		if (cache != NULL) {
+			const int cachefd = open(hny_path(cache), O_RDONLY | O_DIRECTORY);
+
+			if (cachefd < 0 || renameat(cachefd, staging, cachefd, key) != 0) {
+				warn("extract: Unable to publish '%s' in cache '%s'", key, cachepath);
+			}
+
+			if (cachefd >= 0) {
+				close(cachefd);
+			}
+		}
 	}
 
-	hny_unlock(hny);
+	for (size_t i = 0; i < fanoutscount; i++) {
+		hny_unlock(targets[i + 2].hny);
+		hny_close(targets[i + 2].hny);
+	}
+
+	if (cache != NULL) {
+		hny_unlock(cache);
+		hny_close(cache);
+	}
+
+	if (!verify) {
+		hny_unlock(hny);
+		hny_close(hny);
+	}
 	close(fd);
 }
 
+static void
+hny_subcommand_pack(const struct hny_args *args, char **argpos, char **argend) {
+	int flags = HNY_PACK_FLAGS_NONE;
+	const char *directory, *output;
+	unsigned int jobs = 0;
+	int dirfd, fd;
+
+	{ /* Options parsing, argpos[-1] is the subcommand name */
+		static const struct option longopts[] = {
+			{ "jobs", required_argument, NULL, 'j' },
+			{ "toc", no_argument, NULL, 't' },
+			{ NULL, 0, NULL, 0 },
+		};
+		int c;
+
+		optind = 1;
+		while (c = getopt_long(argend - argpos + 1, argpos - 1, "+:j:t", longopts, NULL), c != -1) {
+			switch (c) {
+			case 'j': {
+				char *end;
+				const unsigned long value = strtoul(optarg, &end, 10);
+
+				if (*optarg == '\0' || *end != '\0' || value > UINT_MAX) {
+					errx(EXIT_FAILURE, "pack: Invalid number of jobs '%s'", optarg);
+				}
+				jobs = value;
+			} break;
+			case 't':
+				flags |= HNY_PACK_FLAGS_TOC;
+				break;
+			case ':':
+				errx(EXIT_FAILURE, "pack: Option '%s' requires an operand", argpos[optind - 2]);
+			default:
+				if (optopt != 0) {
+					errx(EXIT_FAILURE, "pack: Unrecognized option -%c", optopt);
+				} else {
+					errx(EXIT_FAILURE, "pack: Unrecognized option '%s'", argpos[optind - 2]);
+				}
+			}
+		}
+
+		argpos += optind - 1;
+	}
+
+	if (argend - argpos < 2) {
+		errx(EXIT_FAILURE, "pack: Expected arguments");
+	}
+
+	directory = *argpos++;
+	output = *argpos++;
+
+	dirfd = open(directory, O_RDONLY | O_DIRECTORY);
+	if (dirfd < 0) {
+		err(EXIT_FAILURE, "pack: Unable to open '%s'", directory);
+	}
+
+	fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		err(EXIT_FAILURE, "pack: Unable to create '%s'", output);
+	}
+
+	/* Without entries, the whole directory is archived */
+	if (errno = hny_pack(dirfd, argpos != argend ? (const char * const *)argpos : NULL, argend - argpos, fd, jobs, flags),
+		errno != 0 || close(fd) != 0) {
+		const int errcode = errno;
+
+		unlink(output);
+		errno = errcode;
+
+		err(EXIT_FAILURE, "pack: Unable to pack '%s' into '%s'", directory, output);
+	}
+
+	close(dirfd);
+}
+
+static void
+hny_subcommand_contents(const struct hny_args *args, char **argpos, char **argend) {
+	struct hny_archive_entry *entries;
+	const char *filename;
+	size_t count;
+	int fd;
+
+	if (argend - argpos != 1) {
+		errx(EXIT_FAILURE, "contents: Expected 1 argument");
+	}
+	filename = *argpos;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(EXIT_FAILURE, "contents: Unable to open '%s'", filename);
+	}
+
+	if (errno = hny_archive_list(fd, &entries, &count), errno != 0) {
+		if (errno == ENOENT) {
+			errx(EXIT_FAILURE, "contents: '%s' has no table of contents", filename);
+		}
+		err(EXIT_FAILURE, "contents: Unable to list '%s'", filename);
+	}
+	close(fd);
+
+	for (size_t i = 0; i < count; i++) {
+		printf("%06o %lld %lld %s\n", (unsigned int)entries[i].mode,
+			(long long)entries[i].size, (long long)entries[i].offset, entries[i].path);
+	}
+
+	free(entries);
+}
+
+static void
+hny_subcommand_bundle(const struct hny_args *args, char **argpos, char **argend) {
+	struct hny_bundle_member *members;
+	const char *output;
+	size_t count;
+	int fd;
+
+	if (argend - argpos < 2) {
+		errx(EXIT_FAILURE, "bundle: Expected arguments");
+	}
+
+	output = *argpos++;
+	count = argend - argpos;
+	members = alloca(sizeof (*members) * count);
+
+	/* Members are named after their archive, as when extracting without a package name */
+	for (size_t i = 0; i < count; i++) {
+		const char * const filename = argpos[i];
+		char * const copy = strdup(filename);
+		struct stat st;
+
+		if (copy == NULL) {
+			err(EXIT_FAILURE, "bundle: Unable to name '%s'", filename);
+		}
+
+		/* Never freed, names must live until the bundle is written */
+		char * const bname = basename(copy);
+		char * const dot = strrchr(bname, '.');
+		if (dot != NULL) {
+			*dot = '\0';
+		}
+
+		const int archivefd = open(filename, O_RDONLY);
+		if (archivefd < 0 || fstat(archivefd, &st) != 0) {
+			err(EXIT_FAILURE, "bundle: Unable to open '%s'", filename);
+		}
+
+		members[i].package = bname;
+		members[i].size = st.st_size;
+		members[i].data = st.st_size != 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, archivefd, 0) : NULL;
+		if (members[i].data == MAP_FAILED) {
+			err(EXIT_FAILURE, "bundle: Unable to map '%s'", filename);
+		}
+
+		close(archivefd);
+	}
+
+	fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		err(EXIT_FAILURE, "bundle: Unable to create '%s'", output);
+	}
+
+	if (errno = hny_bundle_write(fd, members, count), errno != 0 || close(fd) != 0) {
+		const int errcode = errno;
+
+		unlink(output);
+		errno = errcode;
+
+		err(EXIT_FAILURE, "bundle: Unable to write '%s'", output);
+	}
+}
+
+static void
+hny_subcommand_extract_bundle(struct hny *hny, char **argpos, char **argend) {
+	int flags = HNY_EXTRACTION_FLAGS_NONE, errcode;
+	const struct hny_bundle_member *members;
+	struct hny_bundle_result *results;
+	struct hny_bundle *bundle;
+	unsigned int jobs = 0;
+	const char *filename;
+	size_t count;
+	int fd;
+
+	{ /* Options parsing, argpos[-1] is the subcommand name */
+		static const struct option longopts[] = {
+			{ "durability", required_argument, NULL, 'D' },
+			{ "jobs", required_argument, NULL, 'j' },
+			{ "sparse", no_argument, NULL, 's' },
+			{ "writeback", no_argument, NULL, 'W' },
+			{ NULL, 0, NULL, 0 },
+		};
+		int c;
+
+		optind = 1;
+		while (c = getopt_long(argend - argpos + 1, argpos - 1, "+:D:j:sW", longopts, NULL), c != -1) {
+			switch (c) {
+			case 'D':
+				flags &= ~HNY_EXTRACTION_FLAGS_SYNCFS;
+				if (strcmp("syncfs", optarg) == 0) {
+					flags |= HNY_EXTRACTION_FLAGS_SYNCFS;
+				} else if (strcmp("none", optarg) != 0) {
+					errx(EXIT_FAILURE, "extract-bundle: Invalid durability '%s'", optarg);
+				}
+				break;
+			case 'j': {
+				char *end;
+				const unsigned long value = strtoul(optarg, &end, 10);
+
+				if (*optarg == '\0' || *end != '\0' || value > UINT_MAX) {
+					errx(EXIT_FAILURE, "extract-bundle: Invalid number of jobs '%s'", optarg);
+				}
+				jobs = value;
+			} break;
+			case 's':
+				flags |= HNY_EXTRACTION_FLAGS_SPARSE;
+				break;
+			case 'W':
+				flags |= HNY_EXTRACTION_FLAGS_WRITEBACK;
+				break;
+			case ':':
+				errx(EXIT_FAILURE, "extract-bundle: Option '%s' requires an operand", argpos[optind - 2]);
+			default:
+				if (optopt != 0) {
+					errx(EXIT_FAILURE, "extract-bundle: Unrecognized option -%c", optopt);
+				} else {
+					errx(EXIT_FAILURE, "extract-bundle: Unrecognized option '%s'", argpos[optind - 2]);
+				}
+			}
+		}
+
+		argpos += optind - 1;
+	}
+
+	if (argend - argpos != 1) {
+		errx(EXIT_FAILURE, "extract-bundle: Expected 1 argument");
+	}
+	filename = *argpos;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(EXIT_FAILURE, "extract-bundle: Unable to open '%s'", filename);
+	}
+
+	if (errno = hny_bundle_open(&bundle, fd), errno != 0) {
+		err(EXIT_FAILURE, "extract-bundle: Unable to open bundle '%s'", filename);
+	}
+	close(fd);
+
+	count = hny_bundle_members(bundle, &members);
+	results = malloc(sizeof (*results) * (count + 1));
+	if (results == NULL) {
+		err(EXIT_FAILURE, "extract-bundle: Unable to allocate results");
+	}
+
+	/* One lock for every member */
+	if (errno = hny_lock(hny), errno != 0) {
+		err(EXIT_FAILURE, "extract-bundle: Unable to lock prefix");
+	}
+
+	errcode = hny_bundle_extract(bundle, hny, jobs, CONFIG_HNY_EXTRACTION_DICTIONARYMAX_DEFAULT, flags, results);
+
+	hny_unlock(hny);
+
+	for (size_t i = 0; i < count; i++) {
+		const struct hny_bundle_result * const result = results + i;
+		const char * const package = members[i].package;
+
+		if (!result->attempted || result->status == HNY_EXTRACTION_STATUS_END || result->status == HNY_EXTRACTION_STATUS_STOPPED) {
+			continue;
+		}
+
+		errno = result->errcode;
+		if (result->status == HNY_EXTRACTION_STATUS_OK) {
+			if (errno != 0) {
+				warn("extract-bundle: Unable to extract '%s'", package);
+			} else {
+				warnx("extract-bundle: Unable to extract '%s', archive not finished", package);
+			}
+		} else if (HNY_EXTRACTION_STATUS_IS_ERROR_XZ(result->status)) {
+			warnx("extract-bundle: Unable to extract '%s', error while uncompressing", package);
+		} else if (HNY_EXTRACTION_STATUS_IS_ERROR_CPIO_SYSTEM(result->status)) {
+			warn("extract-bundle: Unable to extract '%s', error while unarchiving", package);
+		} else {
+			warnx("extract-bundle: Unable to extract '%s', error while unarchiving", package);
+		}
+	}
+
+	if (errcode == ECANCELED) {
+		exit(EXIT_FAILURE);
+	}
+
+	if (errno = errcode, errno != 0) {
+		err(EXIT_FAILURE, "extract-bundle: Unable to extract '%s'", filename);
+	}
+
+	free(results);
+	hny_bundle_close(bundle);
+}
+
 static inline bool
 hny_list_is_dot_or_dot_dot(const char *name) {
 	return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
@@ -157,7 +789,7 @@ hny_subcommand_list(struct hny *hny, char **argpos, char **argend) {
 			}
 			break;
 		case DT_DIR:
-			if (!hny_list_is_dot_or_dot_dot(entry->d_name)) {
+			if (!hny_list_is_dot_or_dot_dot(entry->d_name) && strcmp(HNY_OBJECTS_DIRECTORY, entry->d_name) != 0) {
 				if (hny_type_of(entry->d_name) != HNY_TYPE_PACKAGE) {
 					errx(EXIT_FAILURE, "list: Inconsistency, directory entry '%s' doesn't conform to a package name", entry->d_name);
 				}
@@ -406,13 +1038,17 @@ hny_usage(int status) {
 		= "hny";
 #endif
 
-	fprintf(stderr, "usage: %s [-hb] [-p <prefix>] extract [<geist>] <file>\n"
+	fprintf(stderr, "usage: %s [-hb] [-p <prefix>] extract [-dilmMPRsSTuVW] [-B <base>] [-C <cache>] [-D none|syncfs|fdatasync] [-e <base>] [-F <prefix>] [-o <pattern>] [-x <pattern>] [<geist>] <file>\n"
+		"       %s [-h] pack [-t] [-j <jobs>] <directory> <file> [<entry>...]\n"
+		"       %s [-h] contents <file>\n"
+		"       %s [-h] bundle <bundle> <file>...\n"
+		"       %s [-hb] [-p <prefix>] extract-bundle [-sW] [-D none|syncfs] [-j <jobs>] <bundle>\n"
 		"       %s [-h] [-p <prefix>] list [packages|geister]\n"
 		"       %s [-hb] [-p <prefix>] remove [<entry>...]\n"
 		"       %s [-hb] [-p <prefix>] shift <geist> <target>\n"
 		"       %s [-h] [-p <prefix>] status [<geist>...]\n"
 		"       %s [-h] [-p <prefix>] <subcommand> [<entry>...]\n",
-		progname, progname, progname, progname, progname, progname);
+		progname, progname, progname, progname, progname, progname, progname, progname, progname, progname);
 
 	exit(status);
 }
@@ -429,7 +1065,7 @@ hny_parse_args(int argc, char **argv) {
 	setprogname(*argv);
 #endif
 
-	while (c = getopt(argc, argv, ":hbp:"), c != -1) {
+	while (c = getopt(argc, argv, "+:hbp:"), c != -1) {
 		switch (c) {
 		case 'h':
 			hny_usage(EXIT_SUCCESS);
@@ -462,11 +1098,21 @@ hny_parse_args(int argc, char **argv) {
 
 int
 main(int argc, char **argv) {
+	/* Opening the prefix themselves if they need one, usable without any (eg. on build machines) */
+	static const struct {
+		const char *name;
+		void (*run)(const struct hny_args *, char **, char **);
+	} standalones[] = {
+		{ "extract", hny_subcommand_extract },
+		{ "pack", hny_subcommand_pack },
+		{ "contents", hny_subcommand_contents },
+		{ "bundle", hny_subcommand_bundle },
+	};
 	static const struct {
 		const char *name;
 		void (*run)(struct hny *, char **, char **);
 	} subcommands[] = {
-		{ "extract", hny_subcommand_extract },
+		{ "extract-bundle", hny_subcommand_extract_bundle },
 		{ "list", hny_subcommand_list },
 		{ "remove", hny_subcommand_remove },
 		{ "shift", hny_subcommand_shift },
@@ -481,6 +1127,13 @@ main(int argc, char **argv) {
 	unsigned int index = 0;
 	struct hny *hny;
 
+	for (unsigned int i = 0; i < sizeof (standalones) / sizeof (*standalones); i++) {
+		if (strcmp(argv[optind], standalones[i].name) == 0) {
+			standalones[i].run(&args, argv + optind + 1, argv + argc);
+			return EXIT_SUCCESS;
+		}
+	}
+
 	while (index < sizeof (subcommands) / sizeof (*subcommands) && strcmp(argv[optind], subcommands[index].name) != 0) {
 		index++;
 	}
@@ -1,21 +1,42 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
+#define _GNU_SOURCE
 #include "cpio_decoder.h"
 
+#include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <cpio.h>
 #include <errno.h>
 #include <err.h>
 
 #include "hny_prefix.h"
+#include "delta.h"
+#include "config.h"
+
+#ifdef CONFIG_HAS_FICLONE
+#include <linux/fs.h>
+#endif
 
 #define CPIO_HEADER_SIZE 76
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+#define CPIO_ZERO_CHUNK_WORDS 8
+
+#define CPIO_COPY_BUFFER_SIZE 65536
+
+#define CPIO_OBJECT_NAME_SIZE (SHA256_DIGEST_SIZE * 2 + 96)
+
+/* Accounts a system call issued for the current entry, evaluates to its result */
+#define CPIO_SYSCALL(cpio, call) ((cpio)->syscalls++, (call))
+
 struct cpio_stream {
 	const char *next;
 	size_t available;
@@ -26,10 +47,18 @@ cpio_decoder_string_reserve_for(struct cpio_decoder_string *string, size_t requi
 	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
 
 	if (string->capacity < required) {
-		string->buffer = realloc(string->buffer, sizeof (*string->buffer) * required);
-		string->capacity = required;
+		char *newbuffer;
+
+		if (string->fixed) {
+			/* Fail fast, rather than ever allocating */
+			return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+		}
 
-		if (string->buffer == NULL) {
+		newbuffer = realloc(string->buffer, sizeof (*string->buffer) * required);
+		if (newbuffer != NULL) {
+			string->buffer = newbuffer;
+			string->capacity = required;
+		} else {
 			status = CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
 		}
 	}
@@ -37,6 +66,82 @@ cpio_decoder_string_reserve_for(struct cpio_decoder_string *string, size_t requi
 	return status;
 }
 
+static void
+cpio_decoder_string_deinit(struct cpio_decoder_string *string) {
+
+	if (!string->fixed) {
+		free(string->buffer);
+	}
+}
+
+static enum cpio_decoder_status
+cpio_decoder_list_append(struct cpio_decoder_list *list, const char *string) {
+	const size_t length = strlen(string) + 1;
+
+	if (list->capacity - list->size < length) {
+		const size_t newcapacity = list->capacity * 2 + length;
+		char * const newbuffer = realloc(list->buffer, newcapacity);
+
+		if (newbuffer == NULL) {
+			return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+		}
+
+		list->buffer = newbuffer;
+		list->capacity = newcapacity;
+	}
+
+	memcpy(list->buffer + list->size, string, length);
+	list->size += length;
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+struct cpio_decoder_sync_job {
+	struct worker_job job;
+	int fd;
+	bool metadata; /**< Whether fsync(2) is required instead of fdatasync(2). */
+};
+
+static int
+cpio_decoder_sync_job_run(struct worker_job *job) {
+	struct cpio_decoder_sync_job * const syncjob = (struct cpio_decoder_sync_job *)job;
+	int errcode = 0;
+
+	if ((syncjob->metadata ? fsync(syncjob->fd) : fdatasync(syncjob->fd)) != 0) {
+		errcode = errno;
+	}
+
+	close(syncjob->fd);
+	free(syncjob);
+
+	return errcode;
+}
+
+static void
+cpio_decoder_close(struct cpio_decoder *cpio, int fd, bool metadata) {
+
+	if (cpio->sync.pool != NULL) {
+		struct cpio_decoder_sync_job * const syncjob = malloc(sizeof (*syncjob));
+
+		if (syncjob != NULL) {
+			syncjob->job.run = cpio_decoder_sync_job_run;
+			syncjob->fd = fd;
+			syncjob->metadata = metadata;
+			worker_pool_push(cpio->sync.pool, &syncjob->job);
+		} else {
+			/* Degrade to a synchronous sync, errors will be reported by the end sync */
+			if (metadata) {
+				fsync(fd);
+			} else {
+				fdatasync(fd);
+			}
+			close(fd);
+		}
+	} else {
+		CPIO_SYSCALL(cpio, close(fd));
+	}
+}
+
 static enum cpio_decoder_status
 cpio_decoder_decode_header_byte(struct cpio_decoder *cpio, unsigned char byte) {
 	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
@@ -285,251 +390,2075 @@ cpio_decoder_normalize_path(char *path, size_t length) {
 }
 
 static enum cpio_decoder_status
-cpio_decoder_decode_filename(struct cpio_decoder *cpio, struct cpio_stream *stream) {
-	const size_t copied = MIN(cpio->stat.c_namesize - cpio->offset, stream->available);
-	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
-
-	memcpy(cpio->filename.buffer + cpio->offset, stream->next, copied);
-	cpio->offset += copied;
-	stream->next += copied;
-	stream->available -= copied;
+cpio_decoder_write(struct cpio_decoder *cpio, const char *data, size_t size) {
+	size_t written = 0;
 
-	while (cpio->offset == cpio->stat.c_namesize) {
-		static const char trailer[] = "TRAILER!!!";
-		const char * const pathname = cpio->filename.buffer;
+	while (written < size) {
+		const ssize_t writeval = CPIO_SYSCALL(cpio, write(cpio->fd, data + written, size - written));
 
-		if (cpio->stat.c_namesize == sizeof (trailer) && memcmp(trailer, pathname, sizeof (trailer)) == 0) {
-			status = CPIO_DECODER_STATUS_END;
-			cpio->state = CPIO_DECODER_STATE_END;
-			break;
+		if (writeval < 0) {
+			cpio->errcode = errno;
+			return CPIO_DECODER_STATUS_ERROR_WRITE;
 		}
 
-		if (cpio_decoder_normalize_path(cpio->filename.buffer, cpio->stat.c_namesize) != 0) {
-			status = CPIO_DECODER_STATUS_ERROR_FILENAME_INVALID;
-			break;
-		}
-		/* Normalization is done in-place, thus pathname now points to a normalized path. */
+		written += writeval;
+	}
 
-		switch (cpio->stat.c_mode & 0770000) {
-		case C_ISREG:
-			cpio->fd = openat(cpio->dirfd, pathname, O_CREAT | O_WRONLY | O_EXCL, 0200);
-			if (cpio->fd < 0) {
-				status = CPIO_DECODER_STATUS_ERROR_CREAT;
-				cpio->errcode = errno;
-			}
-			break;
-		case C_ISLNK:
-			if (cpio->stat.c_filesize != 0) {
-				status = cpio_decoder_string_reserve_for(&cpio->sltarget, cpio->stat.c_filesize);
-			} else {
-				status = CPIO_DECODER_STATUS_ERROR_SYMLINK_TARGET_INVALID;
-			}
-			break;
-		default:
-			break;
-		}
+	return CPIO_DECODER_STATUS_OK;
+}
 
-		if (status == CPIO_DECODER_STATUS_OK) {
-			cpio->state = CPIO_DECODER_STATE_FILE;
-			cpio->offset = 0;
-		}
-		break;
-	}
+static enum cpio_decoder_status
+cpio_decoder_coalesce_flush(struct cpio_decoder *cpio) {
+	const enum cpio_decoder_status status = cpio_decoder_write(cpio, cpio->coalesce.buffer.buffer, cpio->coalesce.size);
+
+	cpio->coalesce.size = 0;
 
 	return status;
 }
 
 static enum cpio_decoder_status
-cpio_decoder_decode_file_finish(struct cpio_decoder *cpio) {
-	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
-	const char * const pathname = cpio->filename.buffer;
-	const mode_t type = cpio->stat.c_mode & 0770000;
-	const mode_t perm = cpio->stat.c_mode & 07777;
-	const mode_t mask = umask(0);
-	uid_t owner;
-	gid_t group;
+cpio_decoder_write_coalesced(struct cpio_decoder *cpio, const char *data, size_t size) {
 
-	if (cpio->extractids) {
-		owner = cpio->stat.c_uid;
-		group = cpio->stat.c_gid;
-	} else {
-		owner = cpio->owner;
-		group = cpio->group;
+	/* Spans as large as the buffer gain nothing from a copy, nor do files completed by a single span */
+	if (cpio->coalesce.size == 0 && (size >= CONFIG_HNY_EXTRACTION_COALESCE_SIZE || cpio->offset + size == cpio->stat.c_filesize)) {
+		return cpio_decoder_write(cpio, data, size);
 	}
 
-	switch (type) {
-	case C_ISDIR:
-		if (mkdirat(cpio->dirfd, pathname, perm) != 0) {
-			status = CPIO_DECODER_STATUS_ERROR_MKDIR;
-			cpio->errcode = errno;
+	/* Coalescing is an optimization, written directly without a buffer */
+	if (cpio_decoder_string_reserve_for(&cpio->coalesce.buffer, CONFIG_HNY_EXTRACTION_COALESCE_SIZE) != CPIO_DECODER_STATUS_OK) {
+		return cpio_decoder_write(cpio, data, size);
+	}
+
+	while (size != 0) {
+		const size_t length = MIN(cpio->coalesce.buffer.capacity - cpio->coalesce.size, size);
+
+		memcpy(cpio->coalesce.buffer.buffer + cpio->coalesce.size, data, length);
+		cpio->coalesce.size += length;
+		data += length;
+		size -= length;
+
+		if (cpio->coalesce.size == cpio->coalesce.buffer.capacity) {
+			const enum cpio_decoder_status status = cpio_decoder_coalesce_flush(cpio);
+
+			if (status != CPIO_DECODER_STATUS_OK) {
+				return status;
+			}
 		}
-		break;
-	case C_ISFIFO:
-		if (mkfifoat(cpio->dirfd, pathname, perm) != 0) {
-			status = CPIO_DECODER_STATUS_ERROR_MKFIFO;
-			cpio->errcode = errno;
+	}
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static void
+cpio_decoder_writeback(struct cpio_decoder *cpio, off_t end) {
+	const off_t window = CONFIG_HNY_EXTRACTION_WRITEBACK_WINDOW;
+
+	/* Advisory, write errors are still reported by the end sync or close */
+	while (end - cpio->writeback.started >= window) {
+		const off_t previous = cpio->writeback.started - window;
+
+#ifdef CONFIG_HAS_SYNC_FILE_RANGE
+		/* Start writing the new window back, wait for the previous one, which can then be dropped */
+		CPIO_SYSCALL(cpio, sync_file_range(cpio->fd, cpio->writeback.started, window, SYNC_FILE_RANGE_WRITE));
+		if (previous >= 0) {
+			CPIO_SYSCALL(cpio, sync_file_range(cpio->fd, previous, window,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER));
+			CPIO_SYSCALL(cpio, posix_fadvise(cpio->fd, previous, window, POSIX_FADV_DONTNEED));
 		}
-		break;
-	case C_ISREG:
-		if (fchmod(cpio->fd, perm) == 0) {
-			if (fchown(cpio->fd, owner, group) != 0) {
-				status = CPIO_DECODER_STATUS_ERROR_CHOWN;
-				cpio->errcode = errno;
-			}
-		} else {
-			status = CPIO_DECODER_STATUS_ERROR_CHMOD;
-			cpio->errcode = errno;
+#else
+		CPIO_SYSCALL(cpio, fdatasync(cpio->fd));
+		CPIO_SYSCALL(cpio, posix_fadvise(cpio->fd, cpio->writeback.started, window, POSIX_FADV_DONTNEED));
+#endif
+
+		cpio->writeback.started += window;
+	}
+}
+
+static void
+cpio_decoder_writeback_finish(struct cpio_decoder *cpio) {
+
+	/* Files smaller than a window are left to the kernel */
+	if (cpio->writeback.started != 0) {
+#ifdef CONFIG_HAS_SYNC_FILE_RANGE
+		CPIO_SYSCALL(cpio, sync_file_range(cpio->fd, cpio->writeback.started - CONFIG_HNY_EXTRACTION_WRITEBACK_WINDOW, 0,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER));
+#else
+		CPIO_SYSCALL(cpio, fdatasync(cpio->fd));
+#endif
+		CPIO_SYSCALL(cpio, posix_fadvise(cpio->fd, 0, 0, POSIX_FADV_DONTNEED));
+	}
+}
+
+static bool
+cpio_decoder_is_zero(const char *data, size_t size) {
+	uint64_t words[CPIO_ZERO_CHUNK_WORDS];
+
+	/* Reduce whole chunks with a branchless OR, which compilers lower to vector instructions */
+	while (size >= sizeof (words)) {
+		uint64_t reduced = 0;
+
+		memcpy(words, data, sizeof (words));
+		for (unsigned int i = 0; i < CPIO_ZERO_CHUNK_WORDS; i++) {
+			reduced |= words[i];
 		}
-		close(cpio->fd);
-		break;
-	case C_ISBLK:
-		/* fallthrough */
-	case C_ISCHR:
-		if (mknodat(cpio->dirfd, pathname, perm, cpio->stat.c_rdev) != 0) {
-			status = CPIO_DECODER_STATUS_ERROR_MKNOD;
-			cpio->errcode = errno;
+
+		if (reduced != 0) {
+			return false;
 		}
-		break;
-	case C_ISLNK:
-		if (symlinkat(cpio->sltarget.buffer, cpio->dirfd, pathname) != 0) {
-			status = CPIO_DECODER_STATUS_ERROR_SYMLINK;
-			cpio->errcode = errno;
+
+		data += sizeof (words);
+		size -= sizeof (words);
+	}
+
+	while (size != 0) {
+		if (*data != 0) {
+			return false;
 		}
-		break;
-	case C_ISSOCK:
-	case C_ISCTG:
-	default:
-		break;
+		data++;
+		size--;
 	}
 
-	umask(mask);
+	return true;
+}
 
-	if (status == CPIO_DECODER_STATUS_OK) {
-		switch (type) {
-		case C_ISDIR:
-		case C_ISFIFO:
-		case C_ISBLK:
-		case C_ISCHR:
-		case C_ISLNK:
-			if (fchownat(cpio->dirfd, pathname, owner, group, AT_SYMLINK_NOFOLLOW) != 0) {
-				status = CPIO_DECODER_STATUS_ERROR_CHOWN;
-				cpio->errcode = errno;
-			}
-			break;
-		default:
-			break;
+static enum cpio_decoder_status
+cpio_decoder_write_hole(struct cpio_decoder *cpio, off_t head) {
+	static const char zeroes[4096];
+	const off_t skipped = cpio->sparse.hole - head;
+
+	/* The hole always starts on a block boundary, every whole block it spans is skipped,
+	 * the zeroes preceding data in the current block are written to avoid fragmenting it. */
+	if (skipped != 0 && CPIO_SYSCALL(cpio, lseek(cpio->fd, skipped, SEEK_CUR)) < 0) {
+		cpio->errcode = errno;
+		return CPIO_DECODER_STATUS_ERROR_WRITE;
+	}
+
+	cpio->sparse.hole = 0;
+
+	while (head != 0) {
+		const size_t length = MIN(head, sizeof (zeroes));
+		const enum cpio_decoder_status status = cpio_decoder_write(cpio, zeroes, length);
+
+		if (status != CPIO_DECODER_STATUS_OK) {
+			return status;
 		}
+
+		head -= length;
 	}
 
-	return status;
+	return CPIO_DECODER_STATUS_OK;
 }
 
 static enum cpio_decoder_status
-cpio_decoder_decode_file(struct cpio_decoder *cpio, struct cpio_stream *stream) {
-	const size_t copied = MIN(cpio->stat.c_filesize - cpio->offset, stream->available);
+cpio_decoder_write_sparse(struct cpio_decoder *cpio, const char *data, size_t size) {
 	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+	off_t offset = cpio->offset;
 
-	switch (cpio->stat.c_mode & 0770000) {
-	case C_ISREG: {
-		size_t written = 0;
-		ssize_t writeval;
-
-		while (written < copied && (writeval = write(cpio->fd, stream->next + written, copied - written), writeval >= 0)) {
-			written += writeval;
-		}
+	while (status == CPIO_DECODER_STATUS_OK && size != 0) {
+		const off_t blockoffset = offset % cpio->blocksize;
+		const size_t length = MIN(cpio->blocksize - blockoffset, size);
 
-		if (writeval < 0) {
-			status = CPIO_DECODER_STATUS_ERROR_WRITE;
-			cpio->errcode = errno;
+		if (blockoffset == 0) {
+			cpio->sparse.dirty = false;
 		}
-	}	break;
-	case C_ISLNK:
-		memcpy(cpio->sltarget.buffer + cpio->offset, stream->next, copied);
-		break;
-	default:
-		/* Discard */
-		break;
-	}
 
-	if (status == CPIO_DECODER_STATUS_OK) {
-		cpio->offset += copied;
-		stream->next += copied;
-		stream->available -= copied;
+		if (!cpio->sparse.dirty && cpio_decoder_is_zero(data, length)) {
+			cpio->sparse.hole += length;
+		} else {
+			if (!cpio->sparse.dirty) {
+				status = cpio_decoder_write_hole(cpio, blockoffset);
+				cpio->sparse.dirty = true;
+			}
 
-		if (cpio->offset == cpio->stat.c_filesize) {
-			status = cpio_decoder_decode_file_finish(cpio);
 			if (status == CPIO_DECODER_STATUS_OK) {
-				cpio->state = CPIO_DECODER_STATE_HEADER;
-				cpio->offset = 0;
+				status = cpio_decoder_write(cpio, data, length);
 			}
 		}
+
+		data += length;
+		size -= length;
+		offset += length;
 	}
 
 	return status;
 }
 
-int
-cpio_decoder_init(struct cpio_decoder *cpio, int dirfd, const char *path) {
-	int errcode;
+static enum cpio_decoder_status
+cpio_decoder_open(struct cpio_decoder *cpio, const char *pathname) {
 
-	cpio->state = CPIO_DECODER_STATE_HEADER;
+	/* Created with its final permissions if the mask allows it, special bits are applied once written and owned */
+	cpio->fd = CPIO_SYSCALL(cpio, openat(cpio->dirfd, pathname, O_CREAT | O_WRONLY | O_EXCL, cpio->stat.c_mode & 0777));
+	if (cpio->fd < 0) {
+		cpio->errcode = errno;
+		return CPIO_DECODER_STATUS_ERROR_CREAT;
+	}
 
-	cpio->offset = 0;
-	cpio->errcode = 0;
+	cpio->sparse.hole = 0;
 
-	if (mkdirat(dirfd, path, 0777) != 0) {
-		errcode = errno;
-		goto cpio_decoder_init_err0;
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static bool
+cpio_decoder_is_digested(const struct cpio_decoder *cpio) {
+	return cpio->objects.dirfd >= 0 || (cpio->flags & HNY_EXTRACTION_FLAGS_MANIFEST);
+}
+
+static void
+cpio_decoder_object_name(struct cpio_decoder *cpio, mode_t perm, uid_t owner, gid_t group, char *name) {
+
+	for (unsigned int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+		snprintf(name + i * 2, 3, "%.2x", cpio->objects.digest[i]);
 	}
+	/* Hard links share metadata, so these are part of the object's identity */
+	const int length = snprintf(name + SHA256_DIGEST_SIZE * 2, CPIO_OBJECT_NAME_SIZE - SHA256_DIGEST_SIZE * 2, "-%.4o-%lu-%lu",
+		(unsigned int)perm, (unsigned long)owner, (unsigned long)group);
 
-	cpio->dirfd = openat(dirfd, path, O_DIRECTORY | O_NOFOLLOW);
-	if (cpio->dirfd < 0) {
-		errcode = errno;
-		goto cpio_decoder_init_err1;
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_MTIME) {
+		snprintf(name + SHA256_DIGEST_SIZE * 2 + length, CPIO_OBJECT_NAME_SIZE - SHA256_DIGEST_SIZE * 2 - length, "-%lld",
+			(long long)cpio->stat.c_mtime);
 	}
+}
 
-	{ /* Is root extracting? If so, then we apply uids and gids. */
-		const uid_t euid = geteuid();
+static int
+cpio_decoder_object_link(int dirfd, const char *pathname, int objectsdirfd, const char *name, unsigned long *syscalls) {
 
-		if (euid != 0) {
-			cpio->owner = euid;
-			cpio->group = getegid();
-			cpio->extractids = false;
-		} else {
-			cpio->extractids = true;
+	/* Publish the file as a new object, if an identical one exists, replace the file by a link to it */
+	++*syscalls;
+	if (linkat(dirfd, pathname, objectsdirfd, name, 0) != 0) {
+		if (errno != EEXIST) {
+			/* The store is an optimization, the extracted file is left as is (eg. EMLINK) */
+			return 0;
+		}
+
+		*syscalls += 2;
+		if (unlinkat(dirfd, pathname, 0) != 0 || linkat(objectsdirfd, name, dirfd, pathname, 0) != 0) {
+			return errno;
 		}
 	}
 
-	cpio->filename.buffer = NULL;
-	cpio->filename.capacity = 0;
+	return 0;
+}
 
-	cpio->sltarget.buffer = NULL;
-	cpio->sltarget.capacity = 0;
+static enum cpio_decoder_status
+cpio_decoder_deduplicate(struct cpio_decoder *cpio, mode_t perm, uid_t owner, gid_t group) {
+	char name[CPIO_OBJECT_NAME_SIZE];
 
-	return 0;
-cpio_decoder_init_err1:
-	unlinkat(dirfd, path, AT_REMOVEDIR);
-cpio_decoder_init_err0:
-	return errcode;
+	cpio_decoder_object_name(cpio, perm, owner, group, name);
+
+	const int errcode = cpio_decoder_object_link(cpio->dirfd, cpio->filename.buffer, cpio->objects.dirfd, name, &cpio->syscalls);
+	if (errcode != 0) {
+		cpio->errcode = errcode;
+		return CPIO_DECODER_STATUS_ERROR_LINK;
+	}
+
+	return CPIO_DECODER_STATUS_OK;
 }
 
-void
-cpio_decoder_deinit(struct cpio_decoder *cpio) {
+static void
+cpio_decoder_metadata(const struct cpio_decoder *cpio, uid_t *ownerp, gid_t *groupp, bool *reownp, bool *remodep) {
+	const mode_t perm = cpio->stat.c_mode & 07777;
+	uid_t owner = cpio->owner;
+	gid_t group = cpio->group;
 
-	if (cpio->state == CPIO_DECODER_STATE_FILE && (cpio->stat.c_mode & 0770000) == C_ISREG) {
-		close(cpio->fd);
+	if (cpio->extractids) {
+		owner = cpio->stat.c_uid;
+		group = cpio->stat.c_gid;
 	}
 
-	free(cpio->sltarget.buffer);
-	free(cpio->filename.buffer);
+	/* Entries are created with our effective ids and masked permissions, only fix what differs.
+	 * Special bits are always applied last, as changing ownership or writing may clear them. */
+	*ownerp = owner;
+	*groupp = group;
+	*reownp = cpio->setgid || owner != cpio->owner || group != cpio->group;
+	*remodep = (perm & (cpio->umask | 07000)) != 0;
 
-	close(cpio->dirfd);
+	if (cpio->reinstall.existing) {
+		/* Kept entries are only fixed where they differ */
+		*reownp = cpio->reinstall.st.st_uid != owner || cpio->reinstall.st.st_gid != group;
+		*remodep = (cpio->reinstall.st.st_mode & 07777) != perm;
+	}
 }
 
-enum cpio_decoder_status
-cpio_decoder_decode(struct cpio_decoder *cpio, const char *buffer, size_t size) {
-	struct cpio_stream stream = { .next = buffer, .available = size };
-	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+static void
+cpio_decoder_mtime(const struct cpio_decoder *cpio, struct timespec times[2]) {
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_OMIT;
+	times[1].tv_sec = cpio->stat.c_mtime;
+	times[1].tv_nsec = 0;
+}
+
+struct cpio_decoder_writer_job {
+	struct worker_job job;
+	int dirfd;
+	int objectsdirfd; /**< Objects store to publish the file to, or -1. */
+	bool fdatasync; /**< Whether the file must be synced before being closed. */
+	bool reown; /**< Whether ownership must be applied. */
+	bool remode; /**< Whether permissions must be applied after creation. */
+	bool retime; /**< Whether the modification time must be applied. */
+	mode_t perm;
+	uid_t owner;
+	gid_t group;
+	time_t mtime;
+	char object[CPIO_OBJECT_NAME_SIZE];
+	const char *pathname; /**< Stored after contents. */
+	size_t size;
+	char data[];
+};
+
+static int
+cpio_decoder_writer_job_run(struct worker_job *job) {
+	struct cpio_decoder_writer_job * const writerjob = (struct cpio_decoder_writer_job *)job;
+	const int fd = openat(writerjob->dirfd, writerjob->pathname, O_CREAT | O_WRONLY | O_EXCL, writerjob->perm & 0777);
+	int errcode = 0;
+
+	if (fd >= 0) {
+		size_t written = 0;
+
+		while (written < writerjob->size) {
+			const ssize_t writeval = write(fd, writerjob->data + written, writerjob->size - written);
+
+			if (writeval < 0) {
+				errcode = errno;
+				break;
+			}
+
+			written += writeval;
+		}
+
+		if (errcode == 0 && writerjob->reown && fchown(fd, writerjob->owner, writerjob->group) != 0) {
+			errcode = errno;
+		}
+
+		if (errcode == 0 && writerjob->remode && fchmod(fd, writerjob->perm) != 0) {
+			errcode = errno;
+		}
+
+		if (errcode == 0 && writerjob->retime) {
+			const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, { .tv_sec = writerjob->mtime } };
+
+			if (futimens(fd, times) != 0) {
+				errcode = errno;
+			}
+		}
+
+		if (errcode == 0 && writerjob->fdatasync && fdatasync(fd) != 0) {
+			errcode = errno;
+		}
+
+		close(fd);
+
+		if (errcode == 0 && writerjob->objectsdirfd >= 0) {
+			unsigned long syscalls = 0; /* Only the extracting thread is accounted */
+
+			errcode = cpio_decoder_object_link(writerjob->dirfd, writerjob->pathname, writerjob->objectsdirfd, writerjob->object, &syscalls);
+		}
+	} else {
+		errcode = errno;
+	}
+
+	free(writerjob);
+
+	return errcode;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_writer_job_create(struct cpio_decoder *cpio, const char *pathname) {
+	const size_t length = strlen(pathname) + 1;
+	struct cpio_decoder_writer_job * const writerjob = malloc(sizeof (*writerjob) + cpio->stat.c_filesize + length);
+
+	if (writerjob == NULL) {
+		return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+	}
+
+	writerjob->job.run = cpio_decoder_writer_job_run;
+	writerjob->dirfd = cpio->dirfd;
+	writerjob->fdatasync = (cpio->flags & HNY_EXTRACTION_FLAGS_FDATASYNC) != 0;
+	writerjob->pathname = memcpy(writerjob->data + cpio->stat.c_filesize, pathname, length);
+	writerjob->size = cpio->stat.c_filesize;
+
+	cpio->writer.job = writerjob;
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static void
+cpio_decoder_writer_job_push(struct cpio_decoder *cpio, mode_t perm, uid_t owner, gid_t group, bool reown, bool remode) {
+	struct cpio_decoder_writer_job * const writerjob = cpio->writer.job;
+
+	writerjob->reown = reown;
+	writerjob->remode = remode;
+	writerjob->perm = perm;
+	writerjob->owner = owner;
+	writerjob->group = group;
+	writerjob->retime = (cpio->flags & HNY_EXTRACTION_FLAGS_MTIME) != 0;
+	writerjob->mtime = cpio->stat.c_mtime;
+
+	if (cpio->objects.dirfd >= 0 && writerjob->size != 0) {
+		cpio_decoder_object_name(cpio, perm, owner, group, writerjob->object);
+		writerjob->objectsdirfd = cpio->objects.dirfd;
+	} else {
+		writerjob->objectsdirfd = -1;
+	}
+
+	/* Its directory was already created, the file can be committed independently from now on */
+	worker_pool_push(cpio->writer.pool, &writerjob->job);
+	cpio->writer.job = NULL;
+}
+
+#ifdef CONFIG_HAS_IO_URING
+struct cpio_decoder_uring_request {
+	unsigned int remaining; /**< Completions expected before release. */
+	int slot; /**< Fixed file slot to release, or -1. */
+	struct cpio_decoder_writer_job *file; /**< Buffered file, or NULL. */
+	char strings[]; /**< Target and path of a symbolic link. */
+};
+
+_Static_assert(_Alignof (max_align_t) > URING_STAGE_MASK, "Allocations cannot hold the io_uring completion stage in their low bits");
+
+static void
+cpio_decoder_uring_reap(struct cpio_decoder *cpio) {
+	static const enum cpio_decoder_status statuses[] = {
+		[URING_STAGE_OPEN] = CPIO_DECODER_STATUS_ERROR_CREAT,
+		[URING_STAGE_WRITE] = CPIO_DECODER_STATUS_ERROR_WRITE,
+		[URING_STAGE_SYNC] = CPIO_DECODER_STATUS_ERROR_SYNC,
+		[URING_STAGE_CLOSE] = CPIO_DECODER_STATUS_ERROR_WRITE,
+		[URING_STAGE_SYMLINK] = CPIO_DECODER_STATUS_ERROR_SYMLINK,
+	};
+	enum uring_stage stage;
+	uint64_t data;
+	int res;
+
+	while (uring_complete(cpio->uring.ring, &data, &stage, &res)) {
+		struct cpio_decoder_uring_request * const request = (struct cpio_decoder_uring_request *)(uintptr_t)data;
+		int errcode = 0;
+
+		if (res < 0) {
+			/* Requests following a failed one in a chain are canceled, only the cause is reported */
+			if (res != -ECANCELED) {
+				errcode = -res;
+			}
+		} else if (stage == URING_STAGE_WRITE && (size_t)res != request->file->size) {
+			errcode = EIO;
+		}
+
+		if (errcode != 0 && cpio->uring.errcode == 0) {
+			cpio->uring.status = statuses[stage];
+			cpio->uring.errcode = errcode;
+		}
+
+		if (--request->remaining == 0) {
+			if (request->slot >= 0) {
+				cpio->uring.slots[cpio->uring.available++] = request->slot;
+			}
+			free(request->file);
+			free(request);
+		}
+	}
+}
+
+static enum cpio_decoder_status
+cpio_decoder_uring_submit(struct cpio_decoder *cpio, unsigned int wait) {
+	const int errcode = CPIO_SYSCALL(cpio, uring_submit(cpio->uring.ring, wait));
+
+	if (errcode != 0) {
+		cpio->errcode = errcode;
+		return CPIO_DECODER_STATUS_ERROR_WRITE;
+	}
+
+	cpio_decoder_uring_reap(cpio);
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_uring_reserve(struct cpio_decoder *cpio, unsigned int requests, bool slot) {
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	cpio_decoder_uring_reap(cpio);
+
+	/* Waiting is only required when everything is in flight, which guarantees completions to come */
+	while (status == CPIO_DECODER_STATUS_OK
+		&& (uring_available(cpio->uring.ring) < requests || (slot && cpio->uring.available == 0))) {
+		status = cpio_decoder_uring_submit(cpio, 1);
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_uring_file(struct cpio_decoder *cpio, mode_t perm) {
+	struct cpio_decoder_writer_job * const file = cpio->writer.job;
+	struct cpio_decoder_uring_request * const request = malloc(sizeof (*request));
+	enum cpio_decoder_status status;
+
+	if (request == NULL) {
+		return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+	}
+
+	/* Open, write, sync and close */
+	status = cpio_decoder_uring_reserve(cpio, 4, true);
+	if (status != CPIO_DECODER_STATUS_OK) {
+		free(request);
+		return status;
+	}
+
+	request->slot = cpio->uring.slots[--cpio->uring.available];
+	request->file = file;
+	request->remaining = uring_file(cpio->uring.ring, file->dirfd, file->pathname, perm & 0777, request->slot,
+		file->data, file->size, file->fdatasync, (uintptr_t)request);
+	cpio->writer.job = NULL;
+
+	if (uring_unsubmitted(cpio->uring.ring) >= CONFIG_HNY_EXTRACTION_URING_BATCH) {
+		status = cpio_decoder_uring_submit(cpio, 0);
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_uring_symlink(struct cpio_decoder *cpio) {
+	const size_t targetlength = cpio->stat.c_filesize + 1, pathlength = strlen(cpio->filename.buffer) + 1;
+	struct cpio_decoder_uring_request * const request = malloc(sizeof (*request) + targetlength + pathlength);
+	enum cpio_decoder_status status;
+
+	if (request == NULL) {
+		return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+	}
+
+	status = cpio_decoder_uring_reserve(cpio, 1, false);
+	if (status != CPIO_DECODER_STATUS_OK) {
+		free(request);
+		return status;
+	}
+
+	memcpy(request->strings, cpio->sltarget.buffer, targetlength);
+	memcpy(request->strings + targetlength, cpio->filename.buffer, pathlength);
+	request->slot = -1;
+	request->file = NULL;
+	request->remaining = 1;
+	uring_symlinkat(cpio->uring.ring, request->strings, cpio->dirfd, request->strings + targetlength, (uintptr_t)request);
+
+	if (uring_unsubmitted(cpio->uring.ring) >= CONFIG_HNY_EXTRACTION_URING_BATCH) {
+		status = cpio_decoder_uring_submit(cpio, 0);
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_uring_drain(struct cpio_decoder *cpio) {
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	while (status == CPIO_DECODER_STATUS_OK && uring_inflight(cpio->uring.ring) != 0) {
+		status = cpio_decoder_uring_submit(cpio, 1);
+	}
+
+	if (status == CPIO_DECODER_STATUS_OK && cpio->uring.errcode != 0) {
+		status = cpio->uring.status;
+		cpio->errcode = cpio->uring.errcode;
+		cpio->uring.errcode = 0;
+	}
+
+	return status;
+}
+
+static int
+cpio_decoder_uring_init(struct cpio_decoder *cpio) {
+	int errcode;
+
+	cpio->uring.slots = malloc(sizeof (*cpio->uring.slots) * CONFIG_HNY_EXTRACTION_URING_FILES);
+	if (cpio->uring.slots == NULL) {
+		return errno;
+	}
+
+	/* Unsupported or forbidden io_uring is not an error, entries are committed with system calls instead */
+	errcode = uring_create(&cpio->uring.ring, CONFIG_HNY_EXTRACTION_URING_ENTRIES, CONFIG_HNY_EXTRACTION_URING_FILES);
+	if (errcode != 0) {
+		free(cpio->uring.slots);
+		cpio->uring.slots = NULL;
+		cpio->uring.ring = NULL;
+		return errcode == ENOMEM ? errcode : 0;
+	}
+
+	for (unsigned int i = 0; i < CONFIG_HNY_EXTRACTION_URING_FILES; i++) {
+		cpio->uring.slots[i] = i;
+	}
+	cpio->uring.available = CONFIG_HNY_EXTRACTION_URING_FILES;
+	cpio->uring.errcode = 0;
+
+	return 0;
+}
+#endif
+
+static void
+cpio_decoder_open_base(struct cpio_decoder *cpio, const char *pathname) {
+	struct stat st;
+
+	/* Only a base file of the same size can be identical, any failure means we extract normally */
+	if (CPIO_SYSCALL(cpio, fstatat(cpio->base.dirfd, pathname, &st, AT_SYMLINK_NOFOLLOW)) == 0
+		&& S_ISREG(st.st_mode) && st.st_size == cpio->stat.c_filesize) {
+		cpio->base.fd = CPIO_SYSCALL(cpio, openat(cpio->base.dirfd, pathname, O_RDONLY | O_NOFOLLOW));
+	}
+}
+
+static enum cpio_decoder_status
+cpio_decoder_copy(struct cpio_decoder *cpio, int fd, off_t size) {
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+	off_t offset = 0;
+
+#ifdef CONFIG_HAS_COPY_FILE_RANGE
+	/* In-kernel copy, which filesystems may turn into a clone, unsupported cases fall back to read/write */
+	while (offset < size) {
+		const ssize_t copied = CPIO_SYSCALL(cpio, copy_file_range(fd, &offset, cpio->fd, NULL, size - offset, 0));
+
+		if (copied <= 0) {
+			if (copied == 0 || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EINVAL) {
+				break;
+			}
+			cpio->errcode = errno;
+			return CPIO_DECODER_STATUS_ERROR_WRITE;
+		}
+	}
+#endif
+
+	if (offset < size) {
+		status = cpio_decoder_string_reserve_for(&cpio->scratch, CPIO_COPY_BUFFER_SIZE);
+	}
+
+	while (status == CPIO_DECODER_STATUS_OK && offset < size) {
+		const ssize_t readval = CPIO_SYSCALL(cpio, pread(fd, cpio->scratch.buffer, MIN(size - offset, cpio->scratch.capacity), offset));
+
+		if (readval <= 0) {
+			cpio->errcode = readval == 0 ? EIO : errno;
+			return CPIO_DECODER_STATUS_ERROR_WRITE;
+		}
+
+		status = cpio_decoder_write(cpio, cpio->scratch.buffer, readval);
+		offset += readval;
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_compare_base(struct cpio_decoder *cpio, const char *data, size_t size) {
+	enum cpio_decoder_status status = cpio_decoder_string_reserve_for(&cpio->scratch, size);
+
+	if (status == CPIO_DECODER_STATUS_OK) {
+		const ssize_t readval = CPIO_SYSCALL(cpio, pread(cpio->base.fd, cpio->scratch.buffer, size, cpio->offset));
+
+		if (readval != size || memcmp(cpio->scratch.buffer, data, size) != 0) {
+			/* Contents diverged, create the file with what was identical so far and continue normally */
+			status = cpio_decoder_open(cpio, cpio->filename.buffer);
+			if (status == CPIO_DECODER_STATUS_OK) {
+				status = cpio_decoder_copy(cpio, cpio->base.fd, cpio->offset);
+				cpio->sparse.dirty = true;
+			}
+
+			CPIO_SYSCALL(cpio, close(cpio->base.fd));
+			cpio->base.fd = -1;
+		}
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_materialize_base(struct cpio_decoder *cpio, mode_t perm, uid_t owner, gid_t group, bool *linked) {
+	const char * const pathname = cpio->filename.buffer;
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+	struct stat st;
+
+	/* A hard link shares the inode, so only when its metadata already is what we would apply */
+	if ((cpio->flags & HNY_EXTRACTION_FLAGS_LINK) && CPIO_SYSCALL(cpio, fstat(cpio->base.fd, &st)) == 0
+		&& (st.st_mode & 07777) == perm && st.st_uid == owner && st.st_gid == group
+		&& CPIO_SYSCALL(cpio, linkat(cpio->base.dirfd, pathname, cpio->dirfd, pathname, 0)) == 0) {
+		*linked = true;
+	} else {
+		status = cpio_decoder_open(cpio, pathname);
+		if (status == CPIO_DECODER_STATUS_OK) {
+#ifdef CONFIG_HAS_FICLONE
+			if (CPIO_SYSCALL(cpio, ioctl(cpio->fd, FICLONE, cpio->base.fd)) != 0)
+#endif
+				status = cpio_decoder_copy(cpio, cpio->base.fd, cpio->stat.c_filesize);
+		}
+		*linked = false;
+	}
+
+	CPIO_SYSCALL(cpio, close(cpio->base.fd));
+	cpio->base.fd = -1;
+
+	return status;
+}
+
+static bool
+cpio_decoder_is_buffered(const struct cpio_decoder *cpio) {
+
+	if (cpio->stat.c_filesize > CONFIG_HNY_EXTRACTION_WRITER_FILESIZE_MAX) {
+		return false;
+	}
+
+	if (cpio->writer.pool != NULL) {
+		return true;
+	}
+
+#ifdef CONFIG_HAS_IO_URING
+	/* Like the writer pool, sparse files are written in place */
+	if (cpio->uring.ring != NULL && cpio->objects.dirfd < 0 && !(cpio->flags & HNY_EXTRACTION_FLAGS_SPARSE)) {
+		bool reown, remode;
+		uid_t owner;
+		gid_t group;
+
+		/* The ring only creates, writes and closes */
+		cpio_decoder_metadata(cpio, &owner, &group, &reown, &remode);
+
+		return !reown && !remode;
+	}
+#endif
+
+	return false;
+}
+
+static enum hny_extraction_entry
+cpio_decoder_entry(mode_t type) {
+
+	switch (type) {
+	case C_ISDIR:
+		return HNY_EXTRACTION_ENTRY_DIRECTORY;
+	case C_ISREG:
+		return HNY_EXTRACTION_ENTRY_REGULAR;
+	case C_ISLNK:
+		return HNY_EXTRACTION_ENTRY_SYMLINK;
+	case C_ISFIFO:
+		return HNY_EXTRACTION_ENTRY_FIFO;
+	case C_ISBLK:
+	case C_ISCHR:
+		return HNY_EXTRACTION_ENTRY_DEVICE;
+	default:
+		return HNY_EXTRACTION_ENTRY_OTHER;
+	}
+}
+
+static void
+cpio_decoder_sink_entry(const struct cpio_decoder *cpio, struct hny_sink_entry *entry) {
+	const mode_t type = cpio->stat.c_mode & 0770000;
+
+	entry->path = cpio->filename.buffer;
+	entry->mode = cpio->stat.c_mode;
+	entry->uid = cpio->stat.c_uid;
+	entry->gid = cpio->stat.c_gid;
+	entry->rdev = cpio->stat.c_rdev;
+	entry->mtime = cpio->stat.c_mtime;
+	entry->size = type == C_ISREG || type == C_ISLNK ? cpio->stat.c_filesize : 0;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_sink_begin(struct cpio_decoder *cpio) {
+	struct hny_sink_entry entry;
+
+	if ((cpio->stat.c_mode & 0770000) == C_ISLNK && cpio->stat.c_filesize == 0) {
+		return CPIO_DECODER_STATUS_ERROR_SYMLINK_TARGET_INVALID;
+	}
+
+	cpio_decoder_sink_entry(cpio, &entry);
+
+	const int errcode = cpio->sink->begin(cpio->context, &entry);
+	if (errcode != 0) {
+		cpio->errcode = errcode;
+		return CPIO_DECODER_STATUS_ERROR_SINK;
+	}
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_sink_data(struct cpio_decoder *cpio, const char *data, size_t size) {
+	const mode_t type = cpio->stat.c_mode & 0770000;
+
+	/* Other entries' content is discarded, as when extracting to the filesystem */
+	if (size == 0 || (type != C_ISREG && type != C_ISLNK)) {
+		return CPIO_DECODER_STATUS_OK;
+	}
+
+	const int errcode = cpio->sink->data(cpio->context, data, size);
+	if (errcode != 0) {
+		cpio->errcode = errcode;
+		return CPIO_DECODER_STATUS_ERROR_SINK;
+	}
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_sink_commit(struct cpio_decoder *cpio) {
+	struct hny_sink_entry entry;
+
+	cpio_decoder_sink_entry(cpio, &entry);
+
+	const int errcode = cpio->sink->commit(cpio->context, &entry);
+	if (errcode != 0) {
+		cpio->errcode = errcode;
+		return CPIO_DECODER_STATUS_ERROR_SINK;
+	}
+
+	cpio->stats.entries[cpio_decoder_entry(cpio->stat.c_mode & 0770000)]++;
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_reinstall(struct cpio_decoder *cpio, const char *pathname) {
+	const mode_t type = cpio->stat.c_mode & 0770000;
+	struct stat * const st = &cpio->reinstall.st;
+
+	if (CPIO_SYSCALL(cpio, fstatat(cpio->dirfd, pathname, st, AT_SYMLINK_NOFOLLOW)) != 0) {
+		if (errno == ENOENT) {
+			return CPIO_DECODER_STATUS_OK;
+		}
+		cpio->errcode = errno;
+		return CPIO_DECODER_STATUS_ERROR_CREAT;
+	}
+
+	if (S_ISDIR(st->st_mode)) {
+		if (type != C_ISDIR) {
+			cpio->errcode = EISDIR;
+			return CPIO_DECODER_STATUS_ERROR_CREAT;
+		}
+		/* Directories are kept, their content is reinstalled */
+		cpio->reinstall.existing = true;
+		return CPIO_DECODER_STATUS_OK;
+	}
+
+	/* A delta only archives files differing from the base, cloned ones are always replaced */
+	if (type == C_ISREG && !cpio->base.delta && S_ISREG(st->st_mode)
+		&& st->st_size == cpio->stat.c_filesize && st->st_mtime == cpio->stat.c_mtime) {
+		bool reown, remode;
+		uid_t owner;
+		gid_t group;
+
+		cpio->reinstall.existing = true;
+		cpio->reinstall.skip = true;
+
+		/* Hard links (objects, bases, cache clones) are shared, they are never modified in place */
+		cpio_decoder_metadata(cpio, &owner, &group, &reown, &remode);
+		if (st->st_nlink == 1 || (!reown && !remode)) {
+			return CPIO_DECODER_STATUS_OK;
+		}
+
+		cpio->reinstall.existing = false;
+		cpio->reinstall.skip = false;
+	}
+
+	/* Anything else is replaced */
+	if (CPIO_SYSCALL(cpio, unlinkat(cpio->dirfd, pathname, 0)) != 0) {
+		cpio->errcode = errno;
+		return CPIO_DECODER_STATUS_ERROR_CREAT;
+	}
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_prepare(struct cpio_decoder *cpio, const char *pathname) {
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	cpio->reinstall.existing = false;
+	cpio->reinstall.skip = false;
+
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_REINSTALL) {
+		status = cpio_decoder_reinstall(cpio, pathname);
+		if (status != CPIO_DECODER_STATUS_OK) {
+			return status;
+		}
+	}
+
+	switch (cpio->stat.c_mode & 0770000) {
+	case C_ISREG:
+		cpio->fd = -1;
+		cpio->coalesce.size = 0;
+		cpio->writeback.started = 0;
+		if (cpio->reinstall.skip || cpio->base.identical) {
+			/* Only drained, yet digested */
+		} else if (cpio->base.dirfd >= 0 && cpio->stat.c_filesize != 0) {
+			cpio_decoder_open_base(cpio, pathname);
+		}
+		if (!cpio->reinstall.skip && !cpio->base.identical && cpio->base.fd < 0) {
+			if (cpio_decoder_is_buffered(cpio)) {
+				status = cpio_decoder_writer_job_create(cpio, pathname);
+			} else {
+				status = cpio_decoder_open(cpio, pathname);
+			}
+		}
+		if (cpio_decoder_is_digested(cpio)) {
+			sha256_init(&cpio->objects.sha256);
+		}
+		break;
+	case C_ISLNK:
+		if (cpio->stat.c_filesize != 0) {
+			status = cpio_decoder_string_reserve_for(&cpio->sltarget, cpio->stat.c_filesize + 1);
+		} else {
+			status = CPIO_DECODER_STATUS_ERROR_SYMLINK_TARGET_INVALID;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return status;
+}
+
+static bool
+cpio_decoder_filter_match(const struct cpio_decoder_list *patterns, const char *pathname, bool directory) {
+	const char * const end = patterns->buffer + patterns->size;
+	size_t components = 1;
+
+	for (const char *slash = pathname; (slash = strchr(slash, '/')) != NULL; slash++) {
+		components++;
+	}
+
+	for (const char *pattern = patterns->buffer; pattern != end; pattern += strlen(pattern) + 1) {
+		if (fnmatch(pattern, pathname, FNM_PATHNAME | FNM_LEADING_DIR) == 0) {
+			return true;
+		}
+
+		if (directory) {
+			/* The directory may lead to a match when it matches as many leading components of the pattern */
+			const char *slash = pattern;
+			size_t count = components;
+
+			while (slash = strchr(slash, '/'), slash != NULL && --count != 0) {
+				slash++;
+			}
+
+			if (slash != NULL) {
+				const size_t length = slash - pattern;
+				char leading[length + 1];
+
+				memcpy(leading, pattern, length);
+				leading[length] = '\0';
+
+				if (fnmatch(leading, pathname, FNM_PATHNAME) == 0) {
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+static bool
+cpio_decoder_is_filtered(struct cpio_decoder *cpio) {
+	const bool directory = (cpio->stat.c_mode & 0770000) == C_ISDIR;
+	char * const pathname = cpio->filename.buffer;
+	const size_t length = strlen(pathname);
+	const bool slashed = pathname[length - 1] == '/';
+	bool filtered;
+
+	if (cpio->filter.only.size == 0 && cpio->filter.exclude.size == 0) {
+		return false;
+	}
+
+	/* Patterns match directories without their trailing slash */
+	if (slashed) {
+		pathname[length - 1] = '\0';
+	}
+
+	filtered = (cpio->filter.only.size != 0 && !cpio_decoder_filter_match(&cpio->filter.only, pathname, directory))
+		|| cpio_decoder_filter_match(&cpio->filter.exclude, pathname, false);
+
+	if (slashed) {
+		pathname[length - 1] = '/';
+	}
+
+	return filtered;
+}
+
+static bool
+cpio_decoder_is_metadata(const char *pathname) {
+	const size_t length = sizeof (HNY_METADATA_DIRECTORY) - 1;
+
+	return strncmp(pathname, HNY_METADATA_DIRECTORY, length) == 0
+		&& (pathname[length] == '\0' || pathname[length] == '/');
+}
+
+static enum cpio_decoder_status
+cpio_decoder_journal(struct cpio_decoder *cpio, const char *pathname) {
+
+	/* Entries kept by a reinstallation aren't ours to remove */
+	if (cpio->reinstall.existing || cpio->journal.disabled) {
+		return CPIO_DECODER_STATUS_OK;
+	}
+
+	if ((cpio->stat.c_mode & 0770000) == C_ISDIR) {
+		return cpio_decoder_list_append(&cpio->journal.directories, pathname);
+	} else {
+		return cpio_decoder_list_append(&cpio->journal.files, pathname);
+	}
+}
+
+static enum cpio_decoder_status
+cpio_decoder_decode_filename(struct cpio_decoder *cpio, struct cpio_stream *stream) {
+	const size_t copied = MIN(cpio->stat.c_namesize - cpio->offset, stream->available);
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	memcpy(cpio->filename.buffer + cpio->offset, stream->next, copied);
+	cpio->offset += copied;
+	stream->next += copied;
+	stream->available -= copied;
+
+	while (cpio->offset == cpio->stat.c_namesize) {
+		static const char trailer[] = "TRAILER!!!";
+		const char * const pathname = cpio->filename.buffer;
+
+		if (cpio->stat.c_namesize == sizeof (trailer) && memcmp(trailer, pathname, sizeof (trailer)) == 0) {
+			status = CPIO_DECODER_STATUS_END;
+			cpio->state = CPIO_DECODER_STATE_END;
+			break;
+		}
+
+		if (cpio_decoder_normalize_path(cpio->filename.buffer, cpio->stat.c_namesize) != 0) {
+			status = CPIO_DECODER_STATUS_ERROR_FILENAME_INVALID;
+			break;
+		}
+		/* Normalization is done in-place, thus pathname now points to a normalized path. */
+
+		if (cpio->flags & HNY_EXTRACTION_FLAGS_METADATA) {
+			const bool metadata = cpio_decoder_is_metadata(pathname);
+
+			if (!metadata && cpio->filter.metadata) {
+				/* Moved past the metadata directory, the rest of the archive is not needed */
+				status = CPIO_DECODER_STATUS_STOP;
+				cpio->state = CPIO_DECODER_STATE_STOP;
+				break;
+			}
+
+			cpio->filter.metadata = metadata;
+			cpio->filter.skip = !metadata || cpio_decoder_is_filtered(cpio);
+		} else {
+			/* The table of contents describes the archive, it isn't part of the package */
+			cpio->filter.skip = strcmp(pathname, HNY_TOC_FILE) == 0 || cpio_decoder_is_filtered(cpio);
+		}
+		if (cpio->filter.skip) {
+			/* Nothing is opened, nor must be closed when destroyed */
+			cpio->fd = -1;
+		} else if (cpio->sink != NULL) {
+			status = cpio_decoder_sink_begin(cpio);
+		} else {
+			status = cpio_decoder_prepare(cpio, pathname);
+			if (status == CPIO_DECODER_STATUS_OK) {
+				status = cpio_decoder_journal(cpio, pathname);
+			}
+		}
+
+		if (status == CPIO_DECODER_STATUS_OK) {
+			cpio->state = CPIO_DECODER_STATE_FILE;
+			cpio->offset = 0;
+		}
+		break;
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_manifest_append(struct cpio_decoder *cpio) {
+	const char * const pathname = cpio->filename.buffer;
+	const uint8_t *digest = NULL;
+	off_t size = 0;
+	int errcode;
+
+	switch (cpio->stat.c_mode & 0770000) {
+	case C_ISREG:
+		digest = cpio->objects.digest;
+		size = cpio->stat.c_filesize;
+		break;
+	case C_ISLNK: {
+		struct sha256 sha256;
+
+		sha256_init(&sha256);
+		sha256_update(&sha256, cpio->sltarget.buffer, cpio->stat.c_filesize);
+		sha256_final(&sha256, cpio->objects.digest);
+		digest = cpio->objects.digest;
+		size = cpio->stat.c_filesize;
+	}	break;
+	default:
+		break;
+	}
+
+	errcode = manifest_append(&cpio->manifest, pathname, cpio->stat.c_mode, size, digest);
+	if (errcode != 0) {
+		cpio->errcode = errcode;
+		return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+	}
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_mtime_defer(struct cpio_decoder *cpio, const char *pathname) {
+
+	if (cpio->mtime.count == cpio->mtime.capacity) {
+		const size_t newcapacity = cpio->mtime.capacity * 2 + 16;
+		time_t * const newtimes = realloc(cpio->mtime.times, sizeof (*newtimes) * newcapacity);
+
+		if (newtimes == NULL) {
+			return CPIO_DECODER_STATUS_ERROR_MEMORY_EXHAUSTED;
+		}
+
+		cpio->mtime.times = newtimes;
+		cpio->mtime.capacity = newcapacity;
+	}
+
+	const enum cpio_decoder_status status = cpio_decoder_list_append(&cpio->mtime.directories, pathname);
+	if (status == CPIO_DECODER_STATUS_OK) {
+		cpio->mtime.times[cpio->mtime.count++] = cpio->stat.c_mtime;
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_decode_file_finish(struct cpio_decoder *cpio) {
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+	const char * const pathname = cpio->filename.buffer;
+	const mode_t type = cpio->stat.c_mode & 0770000;
+	const mode_t perm = cpio->stat.c_mode & 07777;
+	bool reown, remode;
+	uid_t owner;
+	gid_t group;
+
+	if (cpio->filter.skip) {
+		return CPIO_DECODER_STATUS_OK;
+	}
+
+	if (cpio->sink != NULL) {
+		return cpio_decoder_sink_commit(cpio);
+	}
+
+	cpio_decoder_metadata(cpio, &owner, &group, &reown, &remode);
+
+	if (type == C_ISREG && cpio_decoder_is_digested(cpio)) {
+		sha256_final(&cpio->objects.sha256, cpio->objects.digest);
+	}
+
+	switch (type) {
+	case C_ISDIR:
+		if (cpio->reinstall.existing || CPIO_SYSCALL(cpio, mkdirat(cpio->dirfd, pathname, perm)) == 0) {
+			if (perm & S_ISGID) {
+				cpio->setgid = true;
+			}
+			if (cpio->sync.pool != NULL) {
+				status = cpio_decoder_list_append(&cpio->sync.directories, pathname);
+			}
+		} else {
+			status = CPIO_DECODER_STATUS_ERROR_MKDIR;
+			cpio->errcode = errno;
+		}
+		break;
+	case C_ISFIFO:
+		if (CPIO_SYSCALL(cpio, mkfifoat(cpio->dirfd, pathname, perm)) != 0) {
+			status = CPIO_DECODER_STATUS_ERROR_MKFIFO;
+			cpio->errcode = errno;
+		}
+		break;
+	case C_ISREG:
+		if (cpio->writer.job != NULL) {
+			/* Buffered, committed by the writer pool */
+			break;
+		}
+
+		if (cpio->reinstall.skip) {
+			if (reown && CPIO_SYSCALL(cpio, fchownat(cpio->dirfd, pathname, owner, group, AT_SYMLINK_NOFOLLOW)) != 0) {
+				status = CPIO_DECODER_STATUS_ERROR_CHOWN;
+				cpio->errcode = errno;
+			} else if (remode && CPIO_SYSCALL(cpio, fchmodat(cpio->dirfd, pathname, perm, 0)) != 0) {
+				status = CPIO_DECODER_STATUS_ERROR_CHMOD;
+				cpio->errcode = errno;
+			}
+			break;
+		}
+
+		if (cpio->base.identical) {
+			/* The primary's file was completed before reaching here */
+			cpio->base.fd = CPIO_SYSCALL(cpio, openat(cpio->base.dirfd, pathname, O_RDONLY | O_NOFOLLOW));
+			if (cpio->base.fd < 0) {
+				status = CPIO_DECODER_STATUS_ERROR_CREAT;
+				cpio->errcode = errno;
+				break;
+			}
+		}
+
+		if (cpio->base.fd >= 0) {
+			bool linked;
+
+			status = cpio_decoder_materialize_base(cpio, perm, owner, group, &linked);
+			if (status != CPIO_DECODER_STATUS_OK || linked) {
+				if (cpio->fd >= 0) {
+					cpio_decoder_close(cpio, cpio->fd, false);
+				}
+				break;
+			}
+		}
+
+		if (cpio->coalesce.size != 0 && (status = cpio_decoder_coalesce_flush(cpio), status != CPIO_DECODER_STATUS_OK)) {
+			/* Staged data must reach the file before its metadata is applied */
+		} else if (cpio->sparse.hole != 0 && CPIO_SYSCALL(cpio, ftruncate(cpio->fd, cpio->stat.c_filesize)) != 0) {
+			/* Trailing zeroes were skipped, the file must still be extended to its size */
+			status = CPIO_DECODER_STATUS_ERROR_WRITE;
+			cpio->errcode = errno;
+		} else if (reown && CPIO_SYSCALL(cpio, fchown(cpio->fd, owner, group)) != 0) {
+			status = CPIO_DECODER_STATUS_ERROR_CHOWN;
+			cpio->errcode = errno;
+		} else if (remode && CPIO_SYSCALL(cpio, fchmod(cpio->fd, perm)) != 0) {
+			status = CPIO_DECODER_STATUS_ERROR_CHMOD;
+			cpio->errcode = errno;
+		} else if (cpio->flags & HNY_EXTRACTION_FLAGS_MTIME) {
+			struct timespec times[2];
+
+			cpio_decoder_mtime(cpio, times);
+			if (CPIO_SYSCALL(cpio, futimens(cpio->fd, times)) != 0) {
+				status = CPIO_DECODER_STATUS_ERROR_MTIME;
+				cpio->errcode = errno;
+			}
+		}
+		if (cpio->flags & HNY_EXTRACTION_FLAGS_WRITEBACK) {
+			cpio_decoder_writeback_finish(cpio);
+		}
+		cpio_decoder_close(cpio, cpio->fd, false);
+		break;
+	case C_ISBLK:
+		/* fallthrough */
+	case C_ISCHR:
+		if (CPIO_SYSCALL(cpio, mknodat(cpio->dirfd, pathname, perm, cpio->stat.c_rdev)) != 0) {
+			status = CPIO_DECODER_STATUS_ERROR_MKNOD;
+			cpio->errcode = errno;
+		}
+		break;
+	case C_ISLNK:
+		/* The archive doesn't store a terminating null byte */
+		cpio->sltarget.buffer[cpio->stat.c_filesize] = '\0';
+#ifdef CONFIG_HAS_IO_URING
+		if (cpio->uring.ring != NULL && !reown) {
+			status = cpio_decoder_uring_symlink(cpio);
+			break;
+		}
+#endif
+		if (CPIO_SYSCALL(cpio, symlinkat(cpio->sltarget.buffer, cpio->dirfd, pathname)) != 0) {
+			status = CPIO_DECODER_STATUS_ERROR_SYMLINK;
+			cpio->errcode = errno;
+		}
+		break;
+	case C_ISSOCK:
+	case C_ISCTG:
+	default:
+		break;
+	}
+
+	if (status == CPIO_DECODER_STATUS_OK) {
+		switch (type) {
+		case C_ISREG:
+			if (cpio->writer.job != NULL) {
+#ifdef CONFIG_HAS_IO_URING
+				if (cpio->uring.ring != NULL && !reown && !remode && cpio->objects.dirfd < 0) {
+					status = cpio_decoder_uring_file(cpio, perm);
+					break;
+				}
+#endif
+				cpio_decoder_writer_job_push(cpio, perm, owner, group, reown, remode);
+			} else if (cpio->objects.dirfd >= 0 && cpio->stat.c_filesize != 0 && !cpio->reinstall.skip) {
+				status = cpio_decoder_deduplicate(cpio, perm, owner, group);
+			}
+			break;
+		case C_ISDIR:
+		case C_ISFIFO:
+		case C_ISBLK:
+		case C_ISCHR:
+			if (reown && CPIO_SYSCALL(cpio, fchownat(cpio->dirfd, pathname, owner, group, AT_SYMLINK_NOFOLLOW)) != 0) {
+				status = CPIO_DECODER_STATUS_ERROR_CHOWN;
+				cpio->errcode = errno;
+			} else if (remode && CPIO_SYSCALL(cpio, fchmodat(cpio->dirfd, pathname, perm, 0)) != 0) {
+				status = CPIO_DECODER_STATUS_ERROR_CHMOD;
+				cpio->errcode = errno;
+			} else if (cpio->flags & HNY_EXTRACTION_FLAGS_MTIME) {
+				if (type == C_ISDIR) {
+					/* Creating entries inside updates it, applied once the extraction ends */
+					status = cpio_decoder_mtime_defer(cpio, pathname);
+				} else {
+					struct timespec times[2];
+
+					cpio_decoder_mtime(cpio, times);
+					if (CPIO_SYSCALL(cpio, utimensat(cpio->dirfd, pathname, times, AT_SYMLINK_NOFOLLOW)) != 0) {
+						status = CPIO_DECODER_STATUS_ERROR_MTIME;
+						cpio->errcode = errno;
+					}
+				}
+			}
+			break;
+		case C_ISLNK:
+			/* Permissions of symbolic links are meaningless */
+			if (reown && CPIO_SYSCALL(cpio, fchownat(cpio->dirfd, pathname, owner, group, AT_SYMLINK_NOFOLLOW)) != 0) {
+				status = CPIO_DECODER_STATUS_ERROR_CHOWN;
+				cpio->errcode = errno;
+			} else if (cpio->flags & HNY_EXTRACTION_FLAGS_MTIME) {
+				struct timespec times[2];
+
+				cpio_decoder_mtime(cpio, times);
+				if (CPIO_SYSCALL(cpio, utimensat(cpio->dirfd, pathname, times, AT_SYMLINK_NOFOLLOW)) != 0) {
+					status = CPIO_DECODER_STATUS_ERROR_MTIME;
+					cpio->errcode = errno;
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (status == CPIO_DECODER_STATUS_OK && (cpio->flags & HNY_EXTRACTION_FLAGS_MANIFEST)) {
+		status = cpio_decoder_manifest_append(cpio);
+	}
+
+	const enum hny_extraction_entry entry = cpio_decoder_entry(type);
+
+	if (status == CPIO_DECODER_STATUS_OK) {
+		cpio->stats.entries[entry]++;
+	}
+	cpio->stats.syscalls[entry] += cpio->syscalls;
+	cpio->syscalls = 0;
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_write_data(struct cpio_decoder *cpio, const char *data, size_t size) {
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	switch (cpio->stat.c_mode & 0770000) {
+	case C_ISREG:
+		if (cpio_decoder_is_digested(cpio)) {
+			sha256_update(&cpio->objects.sha256, data, size);
+		}
+
+		if (cpio->reinstall.skip || cpio->base.identical) {
+			break;
+		}
+
+		if (cpio->writer.job != NULL) {
+			memcpy(cpio->writer.job->data + cpio->offset, data, size);
+			break;
+		}
+
+		if (cpio->base.fd >= 0) {
+			status = cpio_decoder_compare_base(cpio, data, size);
+			if (status != CPIO_DECODER_STATUS_OK || cpio->base.fd >= 0) {
+				break;
+			}
+		}
+
+		if (cpio->flags & HNY_EXTRACTION_FLAGS_SPARSE) {
+			status = cpio_decoder_write_sparse(cpio, data, size);
+		} else {
+			status = cpio_decoder_write_coalesced(cpio, data, size);
+		}
+
+		if (status == CPIO_DECODER_STATUS_OK && (cpio->flags & HNY_EXTRACTION_FLAGS_WRITEBACK)) {
+			/* Only what reached the file */
+			cpio_decoder_writeback(cpio, cpio->offset + size - cpio->coalesce.size);
+		}
+		break;
+	case C_ISLNK:
+		memcpy(cpio->sltarget.buffer + cpio->offset, data, size);
+		break;
+	default:
+		/* Discard */
+		break;
+	}
+
+	return status;
+}
+
+static enum cpio_decoder_status
+cpio_decoder_decode_file(struct cpio_decoder *cpio, struct cpio_stream *stream) {
+	const size_t copied = MIN(cpio->stat.c_filesize - cpio->offset, stream->available);
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	if (cpio->filter.skip) {
+		/* Drained */
+	} else if (cpio->sink != NULL) {
+		status = cpio_decoder_sink_data(cpio, stream->next, copied);
+	} else {
+		status = cpio_decoder_write_data(cpio, stream->next, copied);
+	}
+
+	if (status == CPIO_DECODER_STATUS_OK) {
+		cpio->offset += copied;
+		stream->next += copied;
+		stream->available -= copied;
+
+		if (cpio->offset == cpio->stat.c_filesize) {
+			status = cpio_decoder_decode_file_finish(cpio);
+			if (status == CPIO_DECODER_STATUS_OK) {
+				cpio->state = CPIO_DECODER_STATE_HEADER;
+				cpio->offset = 0;
+			}
+		}
+	}
+
+	return status;
+}
+
+static mode_t
+cpio_decoder_umask(void) {
+	/* umask(2) can only be read by changing it, which would race with other threads creating files.
+	 * Without procfs, assume everything may be masked so each entry's mode is applied explicitly. */
+	mode_t mask = 0777;
+	const int fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+
+	if (fd >= 0) {
+		/* The mask is near the top, read without stdio so initialization never allocates */
+		char buffer[1024];
+		const ssize_t readval = read(fd, buffer, sizeof (buffer) - 1);
+
+		if (readval > 0) {
+			const char *line;
+			unsigned int value;
+
+			buffer[readval] = '\0';
+			line = strstr(buffer, "Umask:");
+			if (line != NULL && sscanf(line, "Umask: %o", &value) == 1) {
+				mask = value & 0777;
+			}
+		}
+
+		close(fd);
+	}
+
+	return mask;
+}
+
+static void
+cpio_decoder_init_buffers(struct cpio_decoder *cpio) {
+
+	cpio->filename.buffer = NULL;
+	cpio->filename.capacity = 0;
+	cpio->filename.fixed = false;
+
+	cpio->sltarget.buffer = NULL;
+	cpio->sltarget.capacity = 0;
+	cpio->sltarget.fixed = false;
+
+	cpio->base.dirfd = -1;
+	cpio->base.fd = -1;
+	cpio->base.identical = false;
+	cpio->base.delta = false;
+
+	cpio->scratch.buffer = NULL;
+	cpio->scratch.capacity = 0;
+	cpio->scratch.fixed = false;
+
+	cpio->coalesce.buffer.buffer = NULL;
+	cpio->coalesce.buffer.capacity = 0;
+	cpio->coalesce.buffer.fixed = false;
+	cpio->coalesce.size = 0;
+
+	cpio->sync.directories.buffer = NULL;
+	cpio->sync.directories.capacity = 0;
+	cpio->sync.directories.size = 0;
+
+	cpio->writer.job = NULL;
+
+	cpio->mtime.directories.buffer = NULL;
+	cpio->mtime.directories.capacity = 0;
+	cpio->mtime.directories.size = 0;
+	cpio->mtime.times = NULL;
+	cpio->mtime.count = 0;
+	cpio->mtime.capacity = 0;
+
+	cpio->reinstall.existing = false;
+	cpio->reinstall.skip = false;
+
+	cpio->journal.files.buffer = NULL;
+	cpio->journal.files.capacity = 0;
+	cpio->journal.files.size = 0;
+	cpio->journal.directories.buffer = NULL;
+	cpio->journal.directories.capacity = 0;
+	cpio->journal.directories.size = 0;
+	cpio->journal.created = false;
+	cpio->journal.disabled = false;
+
+	cpio->filter.only.buffer = NULL;
+	cpio->filter.only.capacity = 0;
+	cpio->filter.only.size = 0;
+	cpio->filter.exclude.buffer = NULL;
+	cpio->filter.exclude.capacity = 0;
+	cpio->filter.exclude.size = 0;
+	cpio->filter.skip = false;
+	cpio->filter.metadata = false;
+
+	manifest_init(&cpio->manifest);
+
+	cpio->syscalls = 0;
+	memset(&cpio->stats, 0, sizeof (cpio->stats));
+}
+
+int
+cpio_decoder_init(struct cpio_decoder *cpio, int dirfd, const char *path, int flags) {
+	bool created = true;
+	int errcode;
+
+	cpio->state = CPIO_DECODER_STATE_HEADER;
+
+	cpio->offset = 0;
+	cpio->errcode = 0;
+
+	cpio->flags = flags;
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_REINSTALL) {
+		/* Kept files are only recognized through their modification time */
+		cpio->flags |= HNY_EXTRACTION_FLAGS_MTIME;
+	}
+
+	cpio->sink = NULL;
+	cpio->context = NULL;
+
+	if (mkdirat(dirfd, path, 0777) != 0) {
+		if (errno != EEXIST || !(cpio->flags & HNY_EXTRACTION_FLAGS_REINSTALL)) {
+			errcode = errno;
+			goto cpio_decoder_init_err0;
+		}
+		created = false;
+	}
+
+	cpio->dirfd = openat(dirfd, path, O_DIRECTORY | O_NOFOLLOW);
+	if (cpio->dirfd < 0) {
+		errcode = errno;
+		goto cpio_decoder_init_err1;
+	}
+
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_DEDUPLICATE) {
+		if (mkdirat(dirfd, HNY_OBJECTS_DIRECTORY, 0755) != 0 && errno != EEXIST) {
+			errcode = errno;
+			goto cpio_decoder_init_err2;
+		}
+
+		cpio->objects.dirfd = openat(dirfd, HNY_OBJECTS_DIRECTORY, O_DIRECTORY | O_NOFOLLOW);
+		if (cpio->objects.dirfd < 0) {
+			errcode = errno;
+			goto cpio_decoder_init_err2;
+		}
+	} else {
+		cpio->objects.dirfd = -1;
+	}
+
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_FDATASYNC) {
+		errcode = worker_pool_create(&cpio->sync.pool, CONFIG_HNY_EXTRACTION_SYNC_THREADS, CONFIG_HNY_EXTRACTION_SYNC_PENDING);
+		if (errcode != 0) {
+			goto cpio_decoder_init_err3;
+		}
+	} else {
+		cpio->sync.pool = NULL;
+	}
+
+	/* Sparse writing seeks through the decoder's state, so it is always done in place */
+	if ((cpio->flags & HNY_EXTRACTION_FLAGS_PARALLEL) && !(cpio->flags & HNY_EXTRACTION_FLAGS_SPARSE)) {
+		errcode = worker_pool_create(&cpio->writer.pool, CONFIG_HNY_EXTRACTION_WRITER_THREADS, CONFIG_HNY_EXTRACTION_WRITER_PENDING);
+		if (errcode != 0) {
+			goto cpio_decoder_init_err4;
+		}
+	} else {
+		cpio->writer.pool = NULL;
+	}
+
+	cpio->uring.ring = NULL;
+#ifdef CONFIG_HAS_IO_URING
+	/* The ring doesn't apply modification times, which would cost a system call per entry anyway */
+	if ((cpio->flags & HNY_EXTRACTION_FLAGS_URING) && !(cpio->flags & HNY_EXTRACTION_FLAGS_MTIME)) {
+		errcode = cpio_decoder_uring_init(cpio);
+		if (errcode != 0) {
+			goto cpio_decoder_init_err5;
+		}
+	}
+#endif
+
+	{ /* Entries inherit the package directory's group if it is set-group-ID */
+		struct stat st;
+
+		if (fstat(cpio->dirfd, &st) != 0) {
+			errcode = errno;
+			goto cpio_decoder_init_err6;
+		}
+
+		cpio->blocksize = st.st_blksize;
+		cpio->setgid = (st.st_mode & S_ISGID) != 0;
+	}
+
+	/* Is root extracting? If so, then we apply uids and gids. */
+	cpio->owner = geteuid();
+	cpio->group = getegid();
+	cpio->extractids = cpio->owner == 0;
+
+	/* Read once without altering it, entries are then created through the mask */
+	cpio->umask = cpio_decoder_umask();
+
+	cpio_decoder_init_buffers(cpio);
+
+	cpio->journal.created = created;
+
+	return 0;
+cpio_decoder_init_err6:
+#ifdef CONFIG_HAS_IO_URING
+	if (cpio->uring.ring != NULL) {
+		uring_destroy(cpio->uring.ring);
+		free(cpio->uring.slots);
+	}
+#endif
+cpio_decoder_init_err5:
+	if (cpio->writer.pool != NULL) {
+		worker_pool_destroy(cpio->writer.pool);
+	}
+cpio_decoder_init_err4:
+	if (cpio->sync.pool != NULL) {
+		worker_pool_destroy(cpio->sync.pool);
+	}
+cpio_decoder_init_err3:
+	if (cpio->objects.dirfd >= 0) {
+		close(cpio->objects.dirfd);
+	}
+cpio_decoder_init_err2:
+	close(cpio->dirfd);
+cpio_decoder_init_err1:
+	if (created) {
+		unlinkat(dirfd, path, AT_REMOVEDIR);
+	}
+cpio_decoder_init_err0:
+	return errcode;
+}
+
+int
+cpio_decoder_init_sink(struct cpio_decoder *cpio, const struct hny_sink *sink, void *context, int flags) {
+
+	cpio->state = CPIO_DECODER_STATE_HEADER;
+
+	cpio->offset = 0;
+	cpio->errcode = 0;
+
+	/* Other flags only affect how files are created */
+	cpio->flags = flags & HNY_EXTRACTION_FLAGS_METADATA;
+
+	cpio->sink = sink;
+	cpio->context = context;
+
+	cpio->dirfd = -1;
+	cpio->objects.dirfd = -1;
+	cpio->sync.pool = NULL;
+	cpio->writer.pool = NULL;
+	cpio->uring.ring = NULL;
+	cpio->fd = -1;
+
+	cpio_decoder_init_buffers(cpio);
+
+	return 0;
+}
+
+void
+cpio_decoder_fixed(struct cpio_decoder *cpio, char *filename, char *sltarget, size_t capacity) {
+
+	cpio->filename.buffer = filename;
+	cpio->filename.capacity = capacity;
+	cpio->filename.fixed = true;
+
+	cpio->sltarget.buffer = sltarget;
+	cpio->sltarget.capacity = capacity;
+	cpio->sltarget.fixed = true;
+
+	/* Without a staging buffer, writes aren't coalesced */
+	cpio->coalesce.buffer.fixed = true;
+
+	/* Its size depends on the archive, it couldn't be bounded */
+	cpio->journal.disabled = true;
+}
+
+void
+cpio_decoder_deinit(struct cpio_decoder *cpio) {
+
+	/* Pending writes use the directories closed below */
+	if (cpio->writer.pool != NULL) {
+		worker_pool_destroy(cpio->writer.pool);
+	}
+
+#ifdef CONFIG_HAS_IO_URING
+	if (cpio->uring.ring != NULL) {
+		/* Requests still in flight if draining fails are leaked, the kernel may still use their memory */
+		cpio_decoder_uring_drain(cpio);
+		uring_destroy(cpio->uring.ring);
+		free(cpio->uring.slots);
+	}
+#endif
+
+	if (cpio->state == CPIO_DECODER_STATE_FILE && (cpio->stat.c_mode & 0770000) == C_ISREG) {
+		if (cpio->fd >= 0) {
+			close(cpio->fd);
+		}
+		if (cpio->base.fd >= 0) {
+			close(cpio->base.fd);
+		}
+	}
+
+	if (cpio->base.dirfd >= 0) {
+		close(cpio->base.dirfd);
+	}
+
+	if (cpio->objects.dirfd >= 0) {
+		close(cpio->objects.dirfd);
+	}
+
+	if (cpio->sync.pool != NULL) {
+		worker_pool_destroy(cpio->sync.pool);
+	}
+
+	manifest_deinit(&cpio->manifest);
+	free(cpio->filter.exclude.buffer);
+	free(cpio->filter.only.buffer);
+	free(cpio->journal.directories.buffer);
+	free(cpio->journal.files.buffer);
+	free(cpio->mtime.times);
+	free(cpio->mtime.directories.buffer);
+	free(cpio->writer.job);
+	free(cpio->sync.directories.buffer);
+	cpio_decoder_string_deinit(&cpio->coalesce.buffer);
+	cpio_decoder_string_deinit(&cpio->scratch);
+	cpio_decoder_string_deinit(&cpio->sltarget);
+	cpio_decoder_string_deinit(&cpio->filename);
+
+	if (cpio->dirfd >= 0) {
+		close(cpio->dirfd);
+	}
+}
+
+enum cpio_decoder_status
+cpio_decoder_sync(struct cpio_decoder *cpio, int dirfd) {
+
+	if (cpio->sink != NULL) {
+		/* Durability is up to the sink */
+		return CPIO_DECODER_STATUS_OK;
+	}
+
+#ifdef CONFIG_HAS_IO_URING
+	if (cpio->uring.ring != NULL) {
+		const enum cpio_decoder_status status = cpio_decoder_uring_drain(cpio);
+
+		if (status != CPIO_DECODER_STATUS_OK) {
+			return status;
+		}
+	}
+#endif
+
+	if (cpio->writer.pool != NULL) {
+		const int errcode = worker_pool_wait(cpio->writer.pool);
+
+		if (errcode != 0) {
+			cpio->errcode = errcode;
+			return CPIO_DECODER_STATUS_ERROR_WRITE;
+		}
+	}
+
+	if (cpio->base.delta) {
+		const int errcode = delta_apply(cpio->dirfd, cpio->base.dirfd);
+
+		if (errcode != 0) {
+			cpio->errcode = errcode;
+			return CPIO_DECODER_STATUS_ERROR_DELTA;
+		}
+	}
+
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_MTIME) {
+		const char *directory = cpio->mtime.directories.buffer;
+
+		/* Every entry was created, directories won't be modified anymore */
+		for (size_t i = 0; i < cpio->mtime.count; i++) {
+			const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, { .tv_sec = cpio->mtime.times[i] } };
+
+			/* Reserved directories of a delta were removed when applying it */
+			if (utimensat(cpio->dirfd, directory, times, AT_SYMLINK_NOFOLLOW) != 0 && !(cpio->base.delta && errno == ENOENT)) {
+				cpio->errcode = errno;
+				return CPIO_DECODER_STATUS_ERROR_MTIME;
+			}
+
+			directory += strlen(directory) + 1;
+		}
+	}
+
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_REINSTALL) {
+		/* A previous manifest no longer describes the package */
+		unlinkat(cpio->dirfd, HNY_MANIFEST_FILE, 0);
+	}
+
+	if (cpio->flags & HNY_EXTRACTION_FLAGS_MANIFEST) {
+		int errcode = manifest_write(&cpio->manifest, cpio->dirfd, HNY_MANIFEST_FILE);
+
+		if (errcode == 0 && cpio->sync.pool != NULL) {
+			/* Synced like any other extracted file */
+			const int fd = openat(cpio->dirfd, HNY_MANIFEST_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+			if (fd >= 0) {
+				cpio_decoder_close(cpio, fd, false);
+			} else {
+				errcode = errno;
+			}
+		}
+
+		if (errcode != 0) {
+			cpio->errcode = errcode;
+			return CPIO_DECODER_STATUS_ERROR_WRITE;
+		}
+	}
+
+	if (cpio->sync.pool != NULL) {
+		const char *directory = cpio->sync.directories.buffer;
+		const char * const end = directory + cpio->sync.directories.size;
+		int errcode = 0;
+
+		/* Every file was queued, directories are synced once the entries they contain were created */
+		while (directory != end) {
+			const int fd = openat(cpio->dirfd, directory, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+
+			if (fd < 0) {
+				errcode = errno;
+				break;
+			}
+
+			cpio_decoder_close(cpio, fd, true);
+			directory += strlen(directory) + 1;
+		}
+
+		if (errcode == 0 && fsync(cpio->dirfd) != 0) {
+			errcode = errno;
+		}
+
+		if (errcode == 0 && cpio->objects.dirfd >= 0 && fsync(cpio->objects.dirfd) != 0) {
+			errcode = errno;
+		}
+
+		if (errcode == 0 && fsync(dirfd) != 0) {
+			errcode = errno;
+		}
+
+		const int poolerrcode = worker_pool_wait(cpio->sync.pool);
+		if (errcode == 0) {
+			errcode = poolerrcode;
+		}
+
+		if (errcode != 0) {
+			cpio->errcode = errcode;
+			return CPIO_DECODER_STATUS_ERROR_SYNC;
+		}
+	} else if (cpio->flags & HNY_EXTRACTION_FLAGS_SYNCFS) {
+#ifdef CONFIG_HAS_SYNCFS
+		if (syncfs(cpio->dirfd) != 0) {
+			cpio->errcode = errno;
+			return CPIO_DECODER_STATUS_ERROR_SYNC;
+		}
+#else
+		sync();
+#endif
+	}
+
+	return CPIO_DECODER_STATUS_OK;
+}
+
+int
+cpio_decoder_base(struct cpio_decoder *cpio, int dirfd, const char *path) {
+	const int basefd = openat(dirfd, path, O_DIRECTORY | O_NOFOLLOW);
+
+	if (basefd < 0) {
+		return errno;
+	}
+
+	if (cpio->base.dirfd >= 0) {
+		close(cpio->base.dirfd);
+	}
+
+	cpio->base.dirfd = basefd;
+
+	return 0;
+}
+
+int
+cpio_decoder_delta(struct cpio_decoder *cpio, int dirfd, const char *path) {
+	int errcode = cpio_decoder_base(cpio, dirfd, path);
+
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	/* Cloned entries aren't recorded, the whole package must be removed when aborting */
+	cpio->journal.disabled = true;
+	cpio->base.delta = true;
+
+	errcode = hny_clone_content(cpio->base.dirfd, cpio->dirfd, cpio->flags & HNY_EXTRACTION_FLAGS_LINK);
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	/* Archived entries replace cloned ones, directories are kept */
+	cpio->flags |= HNY_EXTRACTION_FLAGS_REINSTALL | HNY_EXTRACTION_FLAGS_MTIME;
+
+	return 0;
+}
+
+int
+cpio_decoder_mirror(struct cpio_decoder *cpio, int dirfd) {
+	const int basefd = dup(dirfd);
+
+	if (basefd < 0) {
+		return errno;
+	}
+
+	cpio->base.dirfd = basefd;
+	cpio->base.identical = true;
+
+	return 0;
+}
+
+int
+cpio_decoder_filter(struct cpio_decoder *cpio, const char *pattern, bool exclude) {
+	struct cpio_decoder_list * const patterns = exclude ? &cpio->filter.exclude : &cpio->filter.only;
+
+	if (cpio_decoder_list_append(patterns, pattern) != CPIO_DECODER_STATUS_OK) {
+		return ENOMEM;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_HAS_IO_URING
+static int
+cpio_decoder_abort_uring(struct cpio_decoder *cpio) {
+	const char *path = cpio->journal.files.buffer;
+	const char * const end = path + cpio->journal.files.size;
+	int errcode = 0;
+
+	/* Only unlinks are in flight, their completions don't refer to any request */
+	while (path != end || uring_inflight(cpio->uring.ring) != 0) {
+		enum uring_stage stage;
+		uint64_t data;
+		int res;
+
+		while (path != end && uring_available(cpio->uring.ring) != 0) {
+			uring_unlinkat(cpio->uring.ring, cpio->dirfd, path, 0, 0);
+			path += strlen(path) + 1;
+		}
+
+		const int submitval = uring_submit(cpio->uring.ring, 1);
+		if (submitval != 0) {
+			return submitval;
+		}
+
+		while (uring_complete(cpio->uring.ring, &data, &stage, &res)) {
+			if (res < 0 && res != -ENOENT && errcode == 0) {
+				errcode = -res;
+			}
+		}
+	}
+
+	return errcode;
+}
+#endif
+
+int
+cpio_decoder_abort(struct cpio_decoder *cpio, int dirfd, const char *path) {
+	int errcode = 0;
+
+	/* Entries being written in background must be created before being removed */
+#ifdef CONFIG_HAS_IO_URING
+	if (cpio->uring.ring != NULL) {
+		cpio_decoder_uring_drain(cpio);
+	}
+#endif
+
+	if (cpio->writer.pool != NULL) {
+		worker_pool_wait(cpio->writer.pool);
+	}
+
+	if (cpio->state == CPIO_DECODER_STATE_FILE && (cpio->stat.c_mode & 0770000) == C_ISREG) {
+		if (cpio->fd >= 0) {
+			close(cpio->fd);
+			cpio->fd = -1;
+		}
+		if (cpio->base.fd >= 0) {
+			close(cpio->base.fd);
+			cpio->base.fd = -1;
+		}
+	}
+
+	/* Nothing more can be extracted */
+	cpio->state = CPIO_DECODER_STATE_END;
+
+	if (cpio->journal.disabled) {
+		/* Nothing was recorded, see cpio_decoder_fixed() */
+		return 0;
+	}
+
+#ifdef CONFIG_HAS_IO_URING
+	if (cpio->uring.ring != NULL) {
+		errcode = cpio_decoder_abort_uring(cpio);
+	} else
+#endif
+	{
+		const char * const end = cpio->journal.files.buffer + cpio->journal.files.size;
+
+		for (const char *file = cpio->journal.files.buffer; file != end; file += strlen(file) + 1) {
+			if (unlinkat(cpio->dirfd, file, 0) != 0 && errno != ENOENT && errcode == 0) {
+				errcode = errno;
+			}
+		}
+	}
+
+	if (unlinkat(cpio->dirfd, HNY_MANIFEST_FILE, 0) != 0 && errno != ENOENT && errcode == 0) {
+		errcode = errno;
+	}
+
+	/* Directories in reverse order, their content was removed before */
+	const char * const directories = cpio->journal.directories.buffer;
+	size_t size = cpio->journal.directories.size;
+	while (size != 0) {
+		size_t begin = size - 1;
+
+		while (begin != 0 && directories[begin - 1] != '\0') {
+			begin--;
+		}
+
+		if (unlinkat(cpio->dirfd, directories + begin, AT_REMOVEDIR) != 0 && errno != ENOENT && errcode == 0) {
+			errcode = errno;
+		}
+
+		size = begin;
+	}
+
+	if (cpio->journal.created && unlinkat(dirfd, path, AT_REMOVEDIR) != 0 && errno != ENOENT && errcode == 0) {
+		errcode = errno;
+	}
+
+	cpio->journal.files.size = 0;
+	cpio->journal.directories.size = 0;
+
+	return errcode;
+}
+
+enum cpio_decoder_status
+cpio_decoder_decode(struct cpio_decoder *cpio, const char *buffer, size_t size) {
+	struct cpio_stream stream = { .next = buffer, .available = size };
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+
+	/* Reported even without input, the xz stream may end with a span decompressing to nothing */
+	switch (cpio->state) {
+	case CPIO_DECODER_STATE_STOP:
+		return CPIO_DECODER_STATUS_STOP;
+	case CPIO_DECODER_STATE_END:
+		return CPIO_DECODER_STATUS_END;
+	default:
+		break;
+	}
 
 	while (status == CPIO_DECODER_STATUS_OK && stream.available != 0) {
 		switch (cpio->state) {
@@ -542,6 +2471,9 @@ cpio_decoder_decode(struct cpio_decoder *cpio, const char *buffer, size_t size)
 		case CPIO_DECODER_STATE_FILE:
 			status = cpio_decoder_decode_file(cpio, &stream);
 			break;
+		case CPIO_DECODER_STATE_STOP:
+			status = CPIO_DECODER_STATUS_STOP;
+			break;
 		case CPIO_DECODER_STATE_END:
 			status = CPIO_DECODER_STATUS_END;
 			break;
@@ -2,11 +2,20 @@
 #ifndef CPIO_DECODER_H
 #define CPIO_DECODER_H
 
+#include <hny.h>
+
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+
+#include "manifest.h"
+#include "sha256.h"
+#include "uring.h"
+#include "worker_pool.h"
 
 enum cpio_decoder_status {
 	CPIO_DECODER_STATUS_OK,
+	CPIO_DECODER_STATUS_STOP,
 	CPIO_DECODER_STATUS_END,
 	CPIO_DECODER_STATUS_ERROR_HEADER_INVALID_MAGIC,
 	CPIO_DECODER_STATUS_ERROR_HEADER_INVALID_BYTE,
@@ -22,6 +31,11 @@ enum cpio_decoder_status {
 	CPIO_DECODER_STATUS_ERROR_CHOWN,
 	CPIO_DECODER_STATUS_ERROR_CHMOD,
 	CPIO_DECODER_STATUS_ERROR_WRITE,
+	CPIO_DECODER_STATUS_ERROR_LINK,
+	CPIO_DECODER_STATUS_ERROR_SYNC,
+	CPIO_DECODER_STATUS_ERROR_SINK,
+	CPIO_DECODER_STATUS_ERROR_MTIME,
+	CPIO_DECODER_STATUS_ERROR_DELTA,
 };
 
 struct cpio_decoder_stat {
@@ -40,24 +54,42 @@ struct cpio_decoder_stat {
 struct cpio_decoder_string {
 	char *buffer;
 	size_t capacity;
+	bool fixed; /**< Provided by the caller, never reallocated nor freed. */
+};
+
+struct cpio_decoder_list {
+	char *buffer; /**< Null-terminated strings, one after the other. */
+	size_t capacity;
+	size_t size;
 };
 
+struct cpio_decoder_writer_job;
+
 struct cpio_decoder {
 	enum {
 		CPIO_DECODER_STATE_HEADER,
 		CPIO_DECODER_STATE_FILENAME,
 		CPIO_DECODER_STATE_FILE,
+		CPIO_DECODER_STATE_STOP,
 		CPIO_DECODER_STATE_END
 	} state; /**< State of the decode stream. */
 
 	size_t offset; /**< Position in the current stream state. */
 	int errcode; /**< Last reported error code. */
 
-	int dirfd; /**< Root of file extractions. */
+	int dirfd; /**< Root of file extractions, or -1 if extracting to a sink. */
+
+	const struct hny_sink *sink; /**< Callbacks receiving entries instead of the filesystem, or NULL. */
+	void *context; /**< Context of sink callbacks. */
+
+	int flags; /**< Extraction flags, see enum hny_extraction_flags. */
+	blksize_t blocksize; /**< Preferred block size of the extraction filesystem. */
 
-	uid_t owner; /**< User id we apply to files if we don't extract ids. */
-	gid_t group; /**< Group id we apply to files if we don't extract ids. */
+	uid_t owner; /**< Effective user id, which entries are created with. */
+	gid_t group; /**< Effective group id, which entries are created with. */
 	bool extractids; /**< Whether we apply uid/gid from the stream. */
+	bool setgid; /**< Whether entries may inherit another group from a set-group-ID directory. */
+	mode_t umask; /**< File mode creation mask, applied by the kernel when creating entries, never modified. */
 
 	struct cpio_decoder_stat stat; /**< Informations extracted from the header of a file. */
 
@@ -65,14 +97,117 @@ struct cpio_decoder {
 
 	struct cpio_decoder_string sltarget; /**< Buffer to store target of symbolic link. */
 	int fd; /**< File descriptor of the currently written file */
+
+	struct {
+		int dirfd; /**< Root of the base package, or -1 if none. */
+		int fd; /**< Base file identical to the current one so far, or -1. */
+		bool identical; /**< Whether base files are known to be identical, being the primary's of a fan-out. */
+		bool delta; /**< Whether the archive is a delta against the base, applied once every entry was extracted. */
+	} base; /**< Previous version of the package, used to avoid rewriting identical files. */
+
+	struct cpio_decoder_string scratch; /**< Buffer to read base files into. */
+
+	struct {
+		int dirfd; /**< Objects store of the prefix, or -1 if not deduplicating. */
+		struct sha256 sha256; /**< Digest of the current file, also computed for the manifest. */
+		uint8_t digest[SHA256_DIGEST_SIZE]; /**< Final digest of the current file, once finished. */
+	} objects; /**< Content-addressed deduplication state. */
+
+	struct manifest manifest; /**< Entries extracted, written when ending with HNY_EXTRACTION_FLAGS_MANIFEST. */
+
+	struct {
+		struct worker_pool *pool; /**< Threads syncing files, or NULL if not syncing each file. */
+		struct cpio_decoder_list directories; /**< Directories created, synced at the end. */
+	} sync; /**< Durability state. */
+
+	struct {
+		struct worker_pool *pool; /**< Threads writing regular files, or NULL if writing them in place. */
+		struct cpio_decoder_writer_job *job; /**< Buffered current file, or NULL if written in place. */
+	} writer; /**< Parallel writing state. */
+
+	struct {
+		struct uring *ring; /**< Ring committing entries, or NULL if unsupported or not requested. */
+		unsigned int *slots; /**< Stack of free fixed file slots. */
+		unsigned int available; /**< Number of free fixed file slots. */
+		enum cpio_decoder_status status; /**< First error reported by a completion. */
+		int errcode; /**< Error code of the first error reported by a completion, 0 if none. */
+	} uring; /**< Batched asynchronous commit state. */
+
+	struct {
+		struct cpio_decoder_list directories; /**< Directories created, their modification times are applied at the end. */
+		time_t *times; /**< Modification times of directories, in the same order. */
+		size_t count;
+		size_t capacity;
+	} mtime; /**< Deferred modification times, with HNY_EXTRACTION_FLAGS_MTIME. */
+
+	struct {
+		bool existing; /**< Whether the current entry is kept from a previous extraction. */
+		bool skip; /**< Whether the current regular file is kept, its data is only drained. */
+		struct stat st; /**< Metadata of the kept entry. */
+	} reinstall; /**< State of the current entry with HNY_EXTRACTION_FLAGS_REINSTALL. */
+
+	struct {
+		struct cpio_decoder_list files; /**< Entries other than directories created, or about to be. */
+		struct cpio_decoder_list directories; /**< Directories created, in archive order. */
+		bool created; /**< Whether the package directory was created by the extraction. */
+		bool disabled; /**< Whether nothing is recorded, aborting then leaves the package to the caller. */
+	} journal; /**< Entries created by the extraction, removed if it is aborted. */
+
+	struct {
+		struct cpio_decoder_list only; /**< Patterns one of which entries must match, if any. */
+		struct cpio_decoder_list exclude; /**< Patterns none of which entries must match. */
+		bool skip; /**< Whether the current entry is filtered out, its data is only drained. */
+		bool metadata; /**< Whether the metadata directory was reached, with HNY_EXTRACTION_FLAGS_METADATA. */
+	} filter; /**< Path patterns restricting extracted entries. */
+
+	struct {
+		struct cpio_decoder_string buffer; /**< Staging buffer, allocated with the first file written in several spans. */
+		size_t size; /**< Bytes of the current file staged, not written yet. */
+	} coalesce; /**< Write coalescing of regular files written in place. */
+
+	struct {
+		off_t started; /**< End of the last range of the current file whose writeback was started. */
+	} writeback; /**< Page cache hygiene state, with HNY_EXTRACTION_FLAGS_WRITEBACK. */
+
+	struct {
+		off_t hole; /**< Zero bytes deferred since the last written block. */
+		bool dirty; /**< Whether the current block already received data. */
+	} sparse; /**< State of sparse writing of the current file. */
+
+	unsigned long syscalls; /**< System calls issued for the current entry. */
+	struct hny_extraction_stats stats; /**< Accounting of committed entries. */
 };
 
 int
-cpio_decoder_init(struct cpio_decoder *cpio, int dirfd, const char *path);
+cpio_decoder_init(struct cpio_decoder *cpio, int dirfd, const char *path, int flags);
+
+int
+cpio_decoder_init_sink(struct cpio_decoder *cpio, const struct hny_sink *sink, void *context, int flags);
+
+void
+cpio_decoder_fixed(struct cpio_decoder *cpio, char *filename, char *sltarget, size_t capacity);
 
 void
 cpio_decoder_deinit(struct cpio_decoder *cpio);
 
+enum cpio_decoder_status
+cpio_decoder_sync(struct cpio_decoder *cpio, int dirfd);
+
+int
+cpio_decoder_base(struct cpio_decoder *cpio, int dirfd, const char *path);
+
+int
+cpio_decoder_delta(struct cpio_decoder *cpio, int dirfd, const char *path);
+
+int
+cpio_decoder_mirror(struct cpio_decoder *cpio, int dirfd);
+
+int
+cpio_decoder_filter(struct cpio_decoder *cpio, const char *pattern, bool exclude);
+
+int
+cpio_decoder_abort(struct cpio_decoder *cpio, int dirfd, const char *path);
+
 enum cpio_decoder_status
 cpio_decoder_decode(struct cpio_decoder *cpio, const char *buffer, size_t size);
 
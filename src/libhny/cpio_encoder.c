@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "cpio_encoder.h"
+
+#include <string.h>
+#include <cpio.h>
+#include <errno.h>
+
+static int
+cpio_encoder_octal(char *field, size_t digits, uint64_t value) {
+
+	for (size_t i = digits; i-- != 0;) {
+		field[i] = '0' + (value & 07);
+		value >>= 3;
+	}
+
+	return value == 0 ? 0 : EOVERFLOW;
+}
+
+int
+cpio_encoder_header(char *header, const struct stat *st, uint32_t ino, size_t namesize, uint64_t filesize) {
+	mode_t type;
+	int errcode = 0;
+
+	if (S_ISDIR(st->st_mode)) {
+		type = C_ISDIR;
+	} else if (S_ISREG(st->st_mode)) {
+		type = C_ISREG;
+	} else if (S_ISLNK(st->st_mode)) {
+		type = C_ISLNK;
+	} else if (S_ISFIFO(st->st_mode)) {
+		type = C_ISFIFO;
+	} else if (S_ISBLK(st->st_mode)) {
+		type = C_ISBLK;
+	} else if (S_ISCHR(st->st_mode)) {
+		type = C_ISCHR;
+	} else {
+		return EINVAL;
+	}
+
+	/* Hard links aren't preserved, every entry is its own inode,
+	 * and the device is meaningless outside of the packaging host */
+	memcpy(header, MAGIC, 6);
+	cpio_encoder_octal(header + 6, 6, 0);
+	cpio_encoder_octal(header + 12, 6, ino & 0777777);
+	cpio_encoder_octal(header + 18, 6, type | (st->st_mode & 07777));
+	errcode |= cpio_encoder_octal(header + 24, 6, st->st_uid);
+	errcode |= cpio_encoder_octal(header + 30, 6, st->st_gid);
+	cpio_encoder_octal(header + 36, 6, type == C_ISDIR ? 2 : 1);
+	errcode |= cpio_encoder_octal(header + 42, 6, type == C_ISBLK || type == C_ISCHR ? st->st_rdev : 0);
+	errcode |= cpio_encoder_octal(header + 48, 11, st->st_mtime >= 0 ? st->st_mtime : 0);
+	errcode |= cpio_encoder_octal(header + 59, 6, namesize);
+
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	if (cpio_encoder_octal(header + 65, 11, filesize) != 0) {
+		return EFBIG;
+	}
+
+	return 0;
+}
+
+void
+cpio_encoder_trailer_header(char *header) {
+
+	memset(header, '0', CPIO_ENCODER_HEADER_SIZE);
+	memcpy(header, MAGIC, 6);
+	cpio_encoder_octal(header + 36, 6, 1);
+	cpio_encoder_octal(header + 59, 6, sizeof (CPIO_ENCODER_TRAILER));
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef CPIO_ENCODER_H
+#define CPIO_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* Writes odc headers, the format read by cpio_decoder.c */
+
+#define CPIO_ENCODER_HEADER_SIZE 76
+
+#define CPIO_ENCODER_TRAILER "TRAILER!!!"
+
+int
+cpio_encoder_header(char *header, const struct stat *st, uint32_t ino, size_t namesize, uint64_t filesize);
+
+void
+cpio_encoder_trailer_header(char *header);
+
+/* CPIO_ENCODER_H */
+#endif
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32_INIT ((uint32_t)-1)
+
+uint32_t
+crc32_update(uint32_t crc32, const uint8_t *bytes, size_t size);
+
+static inline uint32_t
+crc32_end(uint32_t crc32) {
+	return ~crc32;
+}
+
+/* CRC32_H */
+#endif
@@ -0,0 +1,408 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#define _GNU_SOURCE
+#include "delta.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "config.h"
+
+#include "util.h"
+
+#define DELTA_BUFFER_SIZE 65536
+
+static inline bool
+delta_is_dot_or_dot_dot(const char *name) {
+	return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+/* Only relative paths without dot components, outside of HNY_DELTA_DIRECTORY, can be removed */
+static bool
+delta_is_valid_path(const char *path) {
+	const char *component = path;
+
+	if (*path == '\0' || *path == '/') {
+		return false;
+	}
+
+	if (strncmp(path, HNY_DELTA_DIRECTORY, sizeof (HNY_DELTA_DIRECTORY) - 1) == 0
+		&& (path[sizeof (HNY_DELTA_DIRECTORY) - 1] == '\0' || path[sizeof (HNY_DELTA_DIRECTORY) - 1] == '/')) {
+		return false;
+	}
+
+	while (*component != '\0') {
+		const char * const slash = strchrnul(component, '/');
+		const size_t length = slash - component;
+
+		if (length == 0 || (length == 1 && component[0] == '.') || (length == 2 && component[0] == '.' && component[1] == '.')) {
+			return false;
+		}
+
+		component = *slash == '/' ? slash + 1 : slash;
+	}
+
+	return true;
+}
+
+/* Reads exactly size bytes at *offsetp, a short patch is invalid */
+static int
+delta_read(int fd, void *buffer, size_t size, off_t *offsetp) {
+	size_t done = 0;
+
+	while (done != size) {
+		const ssize_t readval = pread(fd, (char *)buffer + done, size - done, *offsetp + done);
+
+		if (readval <= 0) {
+			if (readval < 0 && errno == EINTR) {
+				continue;
+			}
+			return readval == 0 ? EINVAL : errno;
+		}
+
+		done += readval;
+	}
+
+	*offsetp += size;
+
+	return 0;
+}
+
+/* Appends size bytes of infd, from *offsetp, to outfd, a range past the end of infd is invalid */
+static int
+delta_copy(int infd, off_t *offsetp, int outfd, uint64_t size, char *buffer) {
+
+	if (*offsetp < 0 || size > (uint64_t)(INT64_MAX - *offsetp)) {
+		return EINVAL;
+	}
+
+	const off_t end = *offsetp + size;
+
+#ifdef CONFIG_HAS_COPY_FILE_RANGE
+	/* In-kernel copy, unsupported cases fall back to read/write */
+	while (*offsetp < end) {
+		const ssize_t copied = copy_file_range(infd, offsetp, outfd, NULL, end - *offsetp, 0);
+
+		if (copied <= 0) {
+			if (copied == 0) {
+				return EINVAL;
+			}
+			if (errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EINVAL) {
+				break;
+			}
+			return errno;
+		}
+	}
+#endif
+
+	while (*offsetp < end) {
+		const ssize_t readval = pread(infd, buffer, end - *offsetp < DELTA_BUFFER_SIZE ? end - *offsetp : DELTA_BUFFER_SIZE, *offsetp);
+
+		if (readval <= 0) {
+			if (readval < 0 && errno == EINTR) {
+				continue;
+			}
+			return readval == 0 ? EINVAL : errno;
+		}
+
+		const int errcode = util_write_all(outfd, buffer, readval);
+		if (errcode != 0) {
+			return errcode;
+		}
+
+		*offsetp += readval;
+	}
+
+	return 0;
+}
+
+static int
+delta_apply_removed(int packagefd) {
+	struct stat st;
+	char *list;
+	int errcode;
+
+	const int fd = openat(packagefd, DELTA_REMOVED_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		return errno == ENOENT ? 0 : errno;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		errcode = errno;
+		goto delta_apply_removed_err0;
+	}
+
+	list = malloc(st.st_size + 1);
+	if (list == NULL) {
+		errcode = errno;
+		goto delta_apply_removed_err0;
+	}
+
+	off_t offset = 0;
+	errcode = delta_read(fd, list, st.st_size, &offset);
+	if (errcode == 0 && st.st_size != 0 && list[st.st_size - 1] != '\0') {
+		errcode = EINVAL;
+	}
+
+	/* Listed in order, directories after their content */
+	for (const char *path = list; errcode == 0 && path != list + st.st_size; path += strlen(path) + 1) {
+		struct stat pathst;
+
+		if (!delta_is_valid_path(path)) {
+			errcode = EINVAL;
+		} else if (fstatat(packagefd, path, &pathst, AT_SYMLINK_NOFOLLOW) != 0) {
+			/* Already absent from the base */
+			if (errno != ENOENT) {
+				errcode = errno;
+			}
+		} else if (unlinkat(packagefd, path, S_ISDIR(pathst.st_mode) ? AT_REMOVEDIR : 0) != 0) {
+			errcode = errno;
+		}
+	}
+
+	free(list);
+delta_apply_removed_err0:
+	close(fd);
+	return errcode;
+}
+
+static int
+delta_apply_patch(int patchesfd, const char *name, int packagefd, int basedirfd, const char *path, char *buffer) {
+	unsigned char magic[DELTA_PATCH_MAGIC_SIZE];
+	int patchfd, basefd, fd, errcode;
+	off_t offset = 0;
+	struct stat st;
+
+	patchfd = openat(patchesfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (patchfd < 0) {
+		errcode = errno;
+		goto delta_apply_patch_err0;
+	}
+
+	if (fstat(patchfd, &st) != 0) {
+		errcode = errno;
+		goto delta_apply_patch_err1;
+	}
+
+	basefd = openat(basedirfd, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (basefd < 0) {
+		errcode = errno;
+		goto delta_apply_patch_err1;
+	}
+
+	/* The base file was cloned, the patched one replaces it */
+	if (unlinkat(packagefd, path, 0) != 0 && errno != ENOENT) {
+		errcode = errno;
+		goto delta_apply_patch_err2;
+	}
+
+	fd = openat(packagefd, path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		errcode = errno;
+		goto delta_apply_patch_err2;
+	}
+
+	errcode = delta_read(patchfd, magic, sizeof (magic), &offset);
+	if (errcode == 0 && memcmp(magic, DELTA_PATCH_MAGIC, DELTA_PATCH_MAGIC_SIZE) != 0) {
+		errcode = EINVAL;
+	}
+
+	while (errcode == 0 && offset < st.st_size) {
+		unsigned char op[1 + 16];
+
+		errcode = delta_read(patchfd, op, 1, &offset);
+		if (errcode != 0) {
+			break;
+		}
+
+		switch (op[0]) {
+		case DELTA_PATCH_OP_COPY:
+			errcode = delta_read(patchfd, op + 1, 16, &offset);
+			if (errcode == 0) {
+				const uint64_t baseoffset = util_load64(op + 1);
+				off_t position = baseoffset;
+
+				errcode = baseoffset <= INT64_MAX ? delta_copy(basefd, &position, fd, util_load64(op + 9), buffer) : EINVAL;
+			}
+			break;
+		case DELTA_PATCH_OP_INSERT:
+			errcode = delta_read(patchfd, op + 1, 8, &offset);
+			if (errcode == 0) {
+				errcode = delta_copy(patchfd, &offset, fd, util_load64(op + 1), buffer);
+			}
+			break;
+		default:
+			errcode = EINVAL;
+			break;
+		}
+	}
+
+	/* Metadata is the one the patch entry was extracted with */
+	const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, st.st_mtim };
+	if (errcode == 0 && (((st.st_uid != geteuid() || st.st_gid != getegid()) && fchown(fd, st.st_uid, st.st_gid) != 0)
+		|| fchmod(fd, st.st_mode & 07777) != 0 || futimens(fd, times) != 0)) {
+		errcode = errno;
+	}
+
+	close(fd);
+delta_apply_patch_err2:
+	close(basefd);
+delta_apply_patch_err1:
+	close(patchfd);
+delta_apply_patch_err0:
+	return errcode;
+}
+
+/* Patches mirror the package hierarchy, path holds the package path of the walked directory */
+static int
+delta_apply_patches(int patchesfd, int packagefd, int basedirfd, char *path, size_t length, char *buffer) {
+	struct dirent *entry;
+	int errcode = 0;
+	DIR *dirp;
+
+	dirp = fdopendir(patchesfd);
+	if (dirp == NULL) {
+		errcode = errno;
+		close(patchesfd);
+		return errcode;
+	}
+
+	while (errcode == 0 && (errno = 0, entry = readdir(dirp)) != NULL) {
+		const char * const name = entry->d_name;
+		const size_t namelength = strlen(name);
+		size_t newlength = length;
+		struct stat st;
+
+		if (delta_is_dot_or_dot_dot(name)) {
+			continue;
+		}
+
+		if (length + namelength + 2 > PATH_MAX) {
+			errcode = ENAMETOOLONG;
+			break;
+		}
+
+		if (length != 0) {
+			path[newlength++] = '/';
+		}
+		memcpy(path + newlength, name, namelength + 1);
+		newlength += namelength;
+
+		if (fstatat(dirfd(dirp), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			errcode = errno;
+		} else if (S_ISDIR(st.st_mode)) {
+			const int subfd = openat(dirfd(dirp), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+			if (subfd >= 0) {
+				errcode = delta_apply_patches(subfd, packagefd, basedirfd, path, newlength, buffer);
+			} else {
+				errcode = errno;
+			}
+		} else if (S_ISREG(st.st_mode)) {
+			errcode = delta_apply_patch(dirfd(dirp), name, packagefd, basedirfd, path, buffer);
+		} else {
+			errcode = EINVAL;
+		}
+
+		path[length] = '\0';
+	}
+
+	if (errcode == 0 && errno != 0) {
+		errcode = errno;
+	}
+
+	closedir(dirp);
+
+	return errcode;
+}
+
+static int
+delta_remove(int parentfd, const char *name) {
+	struct dirent *entry;
+	int errcode = 0;
+	DIR *dirp;
+
+	const int fd = openat(parentfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		return errno;
+	}
+
+	dirp = fdopendir(fd);
+	if (dirp == NULL) {
+		errcode = errno;
+		close(fd);
+		return errcode;
+	}
+
+	while (errcode == 0 && (errno = 0, entry = readdir(dirp)) != NULL) {
+		if (delta_is_dot_or_dot_dot(entry->d_name)) {
+			continue;
+		}
+
+		if (unlinkat(dirfd(dirp), entry->d_name, 0) != 0) {
+			if (errno == EISDIR || errno == EPERM) {
+				errcode = delta_remove(dirfd(dirp), entry->d_name);
+			} else {
+				errcode = errno;
+			}
+		}
+	}
+
+	if (errcode == 0 && errno != 0) {
+		errcode = errno;
+	}
+
+	closedir(dirp);
+
+	if (errcode == 0 && unlinkat(parentfd, name, AT_REMOVEDIR) != 0) {
+		errcode = errno;
+	}
+
+	return errcode;
+}
+
+int
+delta_apply(int packagefd, int basedirfd) {
+	char path[PATH_MAX] = "";
+	char *buffer;
+	int errcode;
+
+	errcode = delta_apply_removed(packagefd);
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	const int patchesfd = openat(packagefd, DELTA_PATCHES_DIRECTORY, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (patchesfd >= 0) {
+		buffer = malloc(DELTA_BUFFER_SIZE);
+		if (buffer == NULL) {
+			errcode = errno;
+			close(patchesfd);
+			return errcode;
+		}
+
+		/* Takes ownership of patchesfd */
+		errcode = delta_apply_patches(patchesfd, packagefd, basedirfd, path, 0, buffer);
+		free(buffer);
+		if (errcode != 0) {
+			return errcode;
+		}
+	} else if (errno != ENOENT) {
+		return errno;
+	}
+
+	/* Reserved entries never outlive the extraction */
+	errcode = delta_remove(packagefd, HNY_DELTA_DIRECTORY);
+	if (errcode == ENOENT) {
+		errcode = 0;
+	}
+
+	return errcode;
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <hny.h>
+
+/* Entries of a delta archive's HNY_DELTA_DIRECTORY, applied once every other entry was extracted */
+
+#define DELTA_REMOVED_FILE HNY_DELTA_DIRECTORY"/removed"
+#define DELTA_PATCHES_DIRECTORY HNY_DELTA_DIRECTORY"/patches"
+
+#define DELTA_PATCH_MAGIC "HNYPATCH"
+#define DELTA_PATCH_MAGIC_SIZE 8
+
+#define DELTA_PATCH_OP_COPY 'C'
+#define DELTA_PATCH_OP_INSERT 'I'
+
+int
+delta_apply(int packagefd, int basedirfd);
+
+/* DELTA_H */
+#endif
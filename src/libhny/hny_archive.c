@@ -0,0 +1,249 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include <hny.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "config.h"
+
+#include "toc.h"
+#include "util.h"
+#include "xz_decoder.h"
+
+#define HNY_ARCHIVE_CPIO_HEADER_SIZE 76
+
+struct hny_archive_reader {
+	int fd;
+	off_t offset; /**< Offset of the next bytes to read from the archive. */
+	struct xz_decoder xz;
+	struct xz_stream stream;
+	char input[4096];
+};
+
+/* Decodes exactly size bytes from the archive */
+static int
+hny_archive_read(struct hny_archive_reader *reader, void *buffer, size_t size) {
+	struct xz_stream * const stream = &reader->stream;
+
+	stream->output.next = buffer;
+	stream->output.available = size;
+
+	while (stream->output.available != 0) {
+		enum xz_decoder_status status;
+
+		if (stream->input.available == 0) {
+			const ssize_t readval = pread(reader->fd, reader->input, sizeof (reader->input), reader->offset);
+
+			if (readval <= 0) {
+				if (readval < 0 && errno == EINTR) {
+					continue;
+				}
+				return readval < 0 ? errno : EINVAL;
+			}
+
+			stream->input.next = reader->input;
+			stream->input.available = readval;
+			reader->offset += readval;
+		}
+
+		status = xz_decoder_decode(&reader->xz, stream);
+		if (status != XZ_DECODER_STATUS_OK) {
+			/* Including XZ_DECODER_STATUS_END, the archive ended early */
+			return status == XZ_DECODER_STATUS_ERROR_LZMA2_MEMORY_EXHAUSTED ? ENOMEM : EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/* The table of contents ends its blocks, decodes up to the next one to verify their check */
+static int
+hny_archive_check(struct hny_archive_reader *reader) {
+	struct xz_stream * const stream = &reader->stream;
+	size_t remaining = stream->input.available;
+	char byte;
+
+	/* One byte at a time, so decoding stops right at the end of the block */
+	while (reader->xz.state != XZ_DECODER_STATE_STREAM_BLOCK_OR_INDEX) {
+		enum xz_decoder_status status;
+
+		if (remaining == 0) {
+			const ssize_t readval = pread(reader->fd, reader->input, sizeof (reader->input), reader->offset);
+
+			if (readval <= 0) {
+				if (readval < 0 && errno == EINTR) {
+					continue;
+				}
+				return readval < 0 ? errno : EINVAL;
+			}
+
+			stream->input.next = reader->input;
+			remaining = readval;
+			reader->offset += readval;
+		}
+
+		stream->input.available = 1;
+		stream->output.next = &byte;
+		stream->output.available = sizeof (byte);
+
+		status = xz_decoder_decode(&reader->xz, stream);
+		if (status != XZ_DECODER_STATUS_OK || stream->output.available == 0) {
+			/* Any more content means the table of contents wasn't alone in its blocks */
+			return EINVAL;
+		}
+		remaining--;
+	}
+
+	return 0;
+}
+
+static int
+hny_archive_octal(const char *field, size_t digits, uint64_t *valuep) {
+	uint64_t value = 0;
+
+	for (size_t i = 0; i < digits; i++) {
+		if (field[i] < '0' || field[i] > '7') {
+			return EINVAL;
+		}
+		value = value * 8 + (field[i] - '0');
+	}
+
+	*valuep = value;
+
+	return 0;
+}
+
+/* Paths of returned entries point into a copy of the table, allocated along them */
+static int
+hny_archive_parse(uint8_t *toc, size_t size, struct hny_archive_entry **entriesp, size_t *countp) {
+	struct hny_archive_entry *entries;
+	uint64_t count;
+	size_t offset;
+
+	if (size < TOC_HEADER_SIZE || memcmp(toc, TOC_MAGIC, TOC_MAGIC_SIZE) != 0) {
+		return EINVAL;
+	}
+
+	count = util_load64(toc + TOC_MAGIC_SIZE);
+	if (count > (size - TOC_HEADER_SIZE) / (TOC_RECORD_SIZE + 2)) {
+		return EINVAL;
+	}
+
+	entries = malloc(sizeof (*entries) * count + size);
+	if (entries == NULL) {
+		return errno;
+	}
+
+	/* Copied after the entries, so both are released at once */
+	uint8_t * const paths = memcpy(entries + count, toc, size);
+
+	offset = TOC_HEADER_SIZE;
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t * const record = paths + offset;
+		uint32_t pathsize;
+
+		if (size - offset < TOC_RECORD_SIZE) {
+			free(entries);
+			return EINVAL;
+		}
+
+		pathsize = util_load32(record + 20);
+		if (pathsize < 2 || size - offset - TOC_RECORD_SIZE < pathsize || record[TOC_RECORD_SIZE + pathsize - 1] != '\0'
+			|| memchr(record + TOC_RECORD_SIZE, '\0', pathsize - 1) != NULL) {
+			free(entries);
+			return EINVAL;
+		}
+
+		entries[i].path = (const char *)record + TOC_RECORD_SIZE;
+		entries[i].offset = util_load64(record);
+		entries[i].size = util_load64(record + 8);
+		entries[i].mode = util_load32(record + 16);
+
+		offset += TOC_RECORD_SIZE + pathsize;
+	}
+
+	if (offset != size) {
+		free(entries);
+		return EINVAL;
+	}
+
+	*entriesp = entries;
+	*countp = count;
+
+	return 0;
+}
+
+int
+hny_archive_list(int fd, struct hny_archive_entry **entriesp, size_t *countp) {
+	char header[HNY_ARCHIVE_CPIO_HEADER_SIZE + sizeof (HNY_TOC_FILE)];
+	struct hny_archive_reader *reader;
+	uint64_t namesize, filesize;
+	uint8_t *toc = NULL;
+	int errcode;
+
+	reader = malloc(sizeof (*reader));
+	if (reader == NULL) {
+		return errno;
+	}
+
+	errcode = xz_decoder_init(&reader->xz, CONFIG_HNY_EXTRACTION_DICTIONARYMAX_DEFAULT);
+	if (errcode != 0) {
+		free(reader);
+		return errcode;
+	}
+
+	reader->fd = fd;
+	reader->offset = 0;
+	reader->stream.input.next = reader->input;
+	reader->stream.input.available = 0;
+
+	/* The odc header of the first entry, and its name if it is the table of contents */
+	errcode = hny_archive_read(reader, header, sizeof (header));
+	if (errcode != 0) {
+		goto hny_archive_list_err0;
+	}
+
+	if (memcmp(header, "070707", 6) != 0 || hny_archive_octal(header + 59, 6, &namesize) != 0
+		|| hny_archive_octal(header + 65, 11, &filesize) != 0) {
+		errcode = EINVAL;
+		goto hny_archive_list_err0;
+	}
+
+	if (namesize != sizeof (HNY_TOC_FILE) || memcmp(header + HNY_ARCHIVE_CPIO_HEADER_SIZE, HNY_TOC_FILE, sizeof (HNY_TOC_FILE)) != 0) {
+		errcode = ENOENT;
+		goto hny_archive_list_err0;
+	}
+
+	if (filesize > SIZE_MAX / 2) {
+		errcode = EFBIG;
+		goto hny_archive_list_err0;
+	}
+
+	toc = malloc(filesize);
+	if (toc == NULL && filesize != 0) {
+		errcode = errno;
+		goto hny_archive_list_err0;
+	}
+
+	errcode = hny_archive_read(reader, toc, filesize);
+	if (errcode != 0) {
+		goto hny_archive_list_err0;
+	}
+
+	errcode = hny_archive_check(reader);
+	if (errcode != 0) {
+		goto hny_archive_list_err0;
+	}
+
+	errcode = hny_archive_parse(toc, filesize, entriesp, countp);
+
+hny_archive_list_err0:
+	free(toc);
+	xz_decoder_deinit(&reader->xz);
+	free(reader);
+
+	return errcode;
+}
@@ -0,0 +1,353 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "hny_prefix.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#include "util.h"
+#include "xz_decoder.h"
+
+/* Bundle layout, see docs/file-format.md. The trailer locates the index,
+ * so members are written without knowing their count in advance. */
+
+#define HNY_BUNDLE_MAGIC "HNYBUNDL"
+#define HNY_BUNDLE_MAGIC_SIZE 8
+#define HNY_BUNDLE_RECORD_SIZE 24 /* Offset and size of the archive, offset of the name, reserved */
+#define HNY_BUNDLE_TRAILER_SIZE 24 /* Magic, offset of the index, number of records, size of the names table */
+
+struct hny_bundle {
+	void *address;
+	size_t length;
+
+	struct hny_bundle_member *members; /**< Members in bundle order, referring to the mapping. */
+	size_t count;
+	const char *longest; /**< Longest package name, sizing workers' memory. */
+	uint32_t dictionary; /**< Largest dictionary of the members' blocks. */
+};
+
+struct hny_bundle_run {
+	struct hny_bundle *bundle;
+	struct hny *hny;
+	int flags;
+	size_t dictionary; /**< Of the workers' extractions, the bundle's at most. */
+	size_t memorysize;
+	struct hny_bundle_result *results;
+	atomic_size_t next; /**< Index of the next member to extract. */
+	atomic_bool failed; /**< Whether workers must stop taking members. */
+};
+
+struct hny_bundle_worker {
+	struct hny_bundle_run *run;
+	void *memory; /**< Reused by each extraction of the worker, see hny_extraction_create_static(). */
+	pthread_t thread;
+};
+
+int
+hny_bundle_write(int fd, const struct hny_bundle_member *members, size_t count) {
+	const size_t recordssize = HNY_BUNDLE_RECORD_SIZE * count;
+	size_t namessize = 0, length;
+	unsigned char *index;
+	uint64_t offset;
+	int errcode;
+
+	for (size_t i = 0; i < count; i++) {
+		if (hny_type_of(members[i].package) != HNY_TYPE_PACKAGE) {
+			return EINVAL;
+		}
+		namessize += strlen(members[i].package) + 1;
+	}
+
+	if (count > UINT32_MAX || namessize > UINT32_MAX) {
+		return EOVERFLOW;
+	}
+
+	/* Offsets are from the start of the file, so a bundle can follow other content, pipes are written from their start */
+	const off_t start = lseek(fd, 0, SEEK_CUR);
+	if (start < 0 && errno != ESPIPE) {
+		return errno;
+	}
+	offset = start < 0 ? 0 : start;
+
+	length = recordssize + namessize + HNY_BUNDLE_TRAILER_SIZE;
+	index = malloc(length);
+	if (index == NULL) {
+		return errno;
+	}
+
+	/* Archives first, the index is built along */
+	unsigned char *record = index, *name = index + recordssize;
+	for (size_t i = 0; i < count; i++) {
+		const size_t namelength = strlen(members[i].package) + 1;
+
+		errcode = util_write_all(fd, members[i].data, members[i].size);
+		if (errcode != 0) {
+			goto hny_bundle_write_err0;
+		}
+
+		util_store64(record, offset);
+		util_store64(record + 8, members[i].size);
+		util_store32(record + 16, name - (index + recordssize));
+		util_store32(record + 20, 0);
+		memcpy(name, members[i].package, namelength);
+
+		offset += members[i].size;
+		record += HNY_BUNDLE_RECORD_SIZE;
+		name += namelength;
+	}
+
+	memcpy(name, HNY_BUNDLE_MAGIC, HNY_BUNDLE_MAGIC_SIZE);
+	util_store64(name + 8, offset);
+	util_store32(name + 16, count);
+	util_store32(name + 20, namessize);
+
+	errcode = util_write_all(fd, index, length);
+
+hny_bundle_write_err0:
+	free(index);
+	return errcode;
+}
+
+int
+hny_bundle_open(struct hny_bundle **bundlep, int fd) {
+	const unsigned char *trailer, *records;
+	struct hny_bundle *bundle;
+	struct stat st;
+	int errcode;
+
+	bundle = malloc(sizeof (*bundle));
+	if (bundle == NULL) {
+		errcode = errno;
+		goto hny_bundle_open_err0;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		errcode = errno;
+		goto hny_bundle_open_err1;
+	}
+
+	if (!S_ISREG(st.st_mode) || st.st_size < HNY_BUNDLE_TRAILER_SIZE) {
+		errcode = EINVAL;
+		goto hny_bundle_open_err1;
+	}
+
+	/* Mapped once, members are extracted straight from the mapping */
+	bundle->length = st.st_size;
+	bundle->address = mmap(NULL, bundle->length, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (bundle->address == MAP_FAILED) {
+		errcode = errno;
+		goto hny_bundle_open_err1;
+	}
+
+	const unsigned char * const address = bundle->address;
+	trailer = address + bundle->length - HNY_BUNDLE_TRAILER_SIZE;
+
+	const uint64_t indexoffset = util_load64(trailer + 8);
+	const uint32_t count = util_load32(trailer + 16), namessize = util_load32(trailer + 20);
+	const uint64_t indexsize = (uint64_t)HNY_BUNDLE_RECORD_SIZE * count + namessize;
+
+	/* Validate once, so members never refer out of the mapping */
+	if (memcmp(trailer, HNY_BUNDLE_MAGIC, HNY_BUNDLE_MAGIC_SIZE) != 0
+		|| indexoffset > bundle->length - HNY_BUNDLE_TRAILER_SIZE
+		|| indexsize != bundle->length - HNY_BUNDLE_TRAILER_SIZE - indexoffset
+		|| (namessize != 0 && trailer[-1] != '\0')) {
+		errcode = EINVAL;
+		goto hny_bundle_open_err2;
+	}
+
+	bundle->members = malloc(sizeof (*bundle->members) * (count + 1));
+	if (bundle->members == NULL) {
+		errcode = errno;
+		goto hny_bundle_open_err2;
+	}
+
+	records = address + indexoffset;
+	const char * const names = (const char *)records + HNY_BUNDLE_RECORD_SIZE * count;
+
+	bundle->count = count;
+	bundle->longest = NULL;
+	bundle->dictionary = 0;
+	for (size_t i = 0; i < count; i++) {
+		const unsigned char * const record = records + HNY_BUNDLE_RECORD_SIZE * i;
+		const uint64_t offset = util_load64(record), size = util_load64(record + 8);
+		const uint32_t name = util_load32(record + 16);
+		struct hny_bundle_member * const member = bundle->members + i;
+		uint32_t dictionary;
+
+		if (offset > indexoffset || size > indexoffset - offset || name >= namessize || hny_type_of(names + name) != HNY_TYPE_PACKAGE) {
+			errcode = EINVAL;
+			goto hny_bundle_open_err3;
+		}
+
+		member->package = names + name;
+		member->data = (const char *)address + offset;
+		member->size = size;
+
+		/* Workers' dictionaries are sized for the largest member */
+		errcode = xz_dictionary_size(member->data, member->size, &dictionary);
+		if (errcode != 0) {
+			goto hny_bundle_open_err3;
+		}
+
+		if (dictionary > bundle->dictionary) {
+			bundle->dictionary = dictionary;
+		}
+
+		if (bundle->longest == NULL || strlen(member->package) > strlen(bundle->longest)) {
+			bundle->longest = member->package;
+		}
+	}
+
+	*bundlep = bundle;
+
+	return 0;
+hny_bundle_open_err3:
+	free(bundle->members);
+hny_bundle_open_err2:
+	munmap(bundle->address, bundle->length);
+hny_bundle_open_err1:
+	free(bundle);
+hny_bundle_open_err0:
+	return errcode;
+}
+
+void
+hny_bundle_close(struct hny_bundle *bundle) {
+	munmap(bundle->address, bundle->length);
+	free(bundle->members);
+	free(bundle);
+}
+
+size_t
+hny_bundle_members(const struct hny_bundle *bundle, const struct hny_bundle_member **membersp) {
+
+	*membersp = bundle->members;
+
+	return bundle->count;
+}
+
+static void *
+hny_bundle_worker_run(void *data) {
+	struct hny_bundle_worker * const worker = data;
+	struct hny_bundle_run * const run = worker->run;
+	struct hny_bundle * const bundle = run->bundle;
+	size_t i;
+
+	while (!atomic_load(&run->failed) && (i = atomic_fetch_add(&run->next, 1), i < bundle->count)) {
+		const struct hny_bundle_member * const member = bundle->members + i;
+		struct hny_bundle_result * const result = run->results + i;
+		struct hny_extraction *extraction;
+
+		result->attempted = true;
+		result->status = HNY_EXTRACTION_STATUS_OK;
+		result->errcode = hny_extraction_create_static(&extraction, run->hny, member->package, worker->memory, run->memorysize,
+			CONFIG_HNY_EXTRACTION_BUFFERSIZE_DEFAULT, run->dictionary, run->flags);
+		if (result->errcode != 0) {
+			atomic_store(&run->failed, true);
+			continue;
+		}
+
+		/* The whole archive at once, the extraction consumes it by buffer-sized spans */
+		result->status = hny_extraction_extract(extraction, member->data, member->size);
+		result->errcode = hny_extraction_errcode(extraction);
+
+		if (result->status == HNY_EXTRACTION_STATUS_OK || HNY_EXTRACTION_STATUS_IS_ERROR(result->status)) {
+			/* Leave the prefix as it was before, for this member */
+			hny_extraction_abort(extraction);
+			atomic_store(&run->failed, true);
+		}
+
+		hny_extraction_destroy(extraction);
+	}
+
+	return NULL;
+}
+
+int
+hny_bundle_extract(struct hny_bundle *bundle, struct hny *hny, unsigned int jobs, size_t dictionarymax, int flags, struct hny_bundle_result *results) {
+	struct hny_bundle_worker *workers;
+	struct hny_bundle_run run;
+	unsigned int started;
+	int errcode = 0;
+
+	for (size_t i = 0; i < bundle->count; i++) {
+		results[i].attempted = false;
+		results[i].status = HNY_EXTRACTION_STATUS_OK;
+		results[i].errcode = 0;
+	}
+
+	if (bundle->count == 0) {
+		return 0;
+	}
+
+	if (jobs == 0) {
+		const long online = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = online > 0 ? online : 1;
+	}
+
+	if (jobs > bundle->count) {
+		jobs = bundle->count;
+	}
+
+	run.bundle = bundle;
+	run.hny = hny;
+	run.flags = flags;
+	/* Declared sizes aren't trusted, members declaring more fail rather than inflate every worker */
+	run.dictionary = bundle->dictionary < dictionarymax ? bundle->dictionary : dictionarymax;
+	run.memorysize = hny_extraction_static_size(bundle->longest, CONFIG_HNY_EXTRACTION_BUFFERSIZE_DEFAULT, run.dictionary);
+	run.results = results;
+	atomic_init(&run.next, 0);
+	atomic_init(&run.failed, false);
+
+	if (run.memorysize == SIZE_MAX) {
+		return ENOBUFS;
+	}
+
+	workers = calloc(jobs, sizeof (*workers));
+	if (workers == NULL) {
+		return errno;
+	}
+
+	/* Allocated once per worker, each extraction reuses its worker's decoder memory */
+	for (unsigned int i = 0; i < jobs; i++) {
+		workers[i].run = &run;
+		workers[i].memory = malloc(run.memorysize);
+		if (workers[i].memory == NULL) {
+			errcode = errno;
+			goto hny_bundle_extract_err0;
+		}
+	}
+
+	/* The calling thread is the first worker, members are still all extracted if some threads couldn't start */
+	for (started = 1; started < jobs; started++) {
+		if (pthread_create(&workers[started].thread, NULL, hny_bundle_worker_run, workers + started) != 0) {
+			break;
+		}
+	}
+
+	hny_bundle_worker_run(workers);
+
+	for (unsigned int i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	if (atomic_load(&run.failed)) {
+		errcode = ECANCELED;
+	}
+
+hny_bundle_extract_err0:
+	for (unsigned int i = 0; i < jobs; i++) {
+		free(workers[i].memory);
+	}
+	free(workers);
+
+	return errcode;
+}
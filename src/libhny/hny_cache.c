@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include <hny.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sha256.h"
+
+#define HNY_CACHE_BUFFER_SIZE 65536
+
+int
+hny_cache_key(int fd, char key[HNY_CACHE_KEY_SIZE]) {
+	static const char prefix[] = HNY_CACHE_KEY_PREFIX, digits[] = "0123456789abcdef";
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	struct sha256 sha256;
+	off_t offset = 0;
+	ssize_t readval;
+	char *buffer;
+
+	buffer = malloc(HNY_CACHE_BUFFER_SIZE);
+	if (buffer == NULL) {
+		return errno;
+	}
+
+	/* Positional reads, so the caller can still read the archive from where it was */
+	sha256_init(&sha256);
+	while (readval = pread(fd, buffer, HNY_CACHE_BUFFER_SIZE, offset), readval > 0) {
+		sha256_update(&sha256, buffer, readval);
+		offset += readval;
+	}
+
+	free(buffer);
+
+	if (readval < 0) {
+		return errno;
+	}
+
+	sha256_final(&sha256, digest);
+
+	char *current = key;
+	for (const char *p = prefix; *p != '\0'; p++) {
+		*current++ = *p;
+	}
+	for (unsigned int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+		*current++ = digits[digest[i] >> 4];
+		*current++ = digits[digest[i] & 0xF];
+	}
+	*current = '\0';
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#define _GNU_SOURCE
+#include "hny_prefix.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "config.h"
+
+#ifdef CONFIG_HAS_FICLONE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#define HNY_CLONE_BUFFER_SIZE 65536
+
+static inline bool
+hny_clone_is_dot_or_dot_dot(const char *name) {
+	return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static int
+hny_clone_copy(int srcfd, int dstfd, off_t size) {
+	off_t offset = 0;
+
+#ifdef CONFIG_HAS_FICLONE
+	if (ioctl(dstfd, FICLONE, srcfd) == 0) {
+		return 0;
+	}
+#endif
+
+#ifdef CONFIG_HAS_COPY_FILE_RANGE
+	/* Unsupported cases fall back to read/write */
+	while (offset < size) {
+		const ssize_t copied = copy_file_range(srcfd, &offset, dstfd, NULL, size - offset, 0);
+
+		if (copied <= 0) {
+			if (copied == 0 || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EINVAL) {
+				break;
+			}
+			return errno;
+		}
+	}
+#endif
+
+	if (offset < size) {
+		char * const buffer = malloc(HNY_CLONE_BUFFER_SIZE);
+		int errcode = 0;
+
+		if (buffer == NULL) {
+			return errno;
+		}
+
+		while (errcode == 0 && offset < size) {
+			const ssize_t readval = pread(srcfd, buffer, size - offset < HNY_CLONE_BUFFER_SIZE ? size - offset : HNY_CLONE_BUFFER_SIZE, offset);
+
+			if (readval <= 0) {
+				errcode = readval == 0 ? EIO : errno;
+			} else if (pwrite(dstfd, buffer, readval, offset) != readval) {
+				errcode = errno != 0 ? errno : EIO;
+			} else {
+				offset += readval;
+			}
+		}
+
+		free(buffer);
+
+		return errcode;
+	}
+
+	return 0;
+}
+
+static int
+hny_clone_regular(int srcdirfd, int dstdirfd, const char *name, const struct stat *st, int flags) {
+	int srcfd, dstfd, errcode;
+
+	/* The link shares the inode, and so its metadata */
+	if ((flags & HNY_EXTRACTION_FLAGS_LINK) && linkat(srcdirfd, name, dstdirfd, name, 0) == 0) {
+		return 0;
+	}
+
+	srcfd = openat(srcdirfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (srcfd < 0) {
+		errcode = errno;
+		goto hny_clone_regular_err0;
+	}
+
+	dstfd = openat(dstdirfd, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (dstfd < 0) {
+		errcode = errno;
+		goto hny_clone_regular_err1;
+	}
+
+	const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, st->st_mtim };
+
+	errcode = hny_clone_copy(srcfd, dstfd, st->st_size);
+	if (errcode == 0 && (((st->st_uid != geteuid() || st->st_gid != getegid()) && fchown(dstfd, st->st_uid, st->st_gid) != 0)
+		|| fchmod(dstfd, st->st_mode & 07777) != 0 || futimens(dstfd, times) != 0)) {
+		errcode = errno;
+	}
+
+	close(dstfd);
+hny_clone_regular_err1:
+	close(srcfd);
+hny_clone_regular_err0:
+	return errcode;
+}
+
+static int
+hny_clone_symlink(int srcdirfd, int dstdirfd, const char *name, const struct stat *st) {
+	char * const target = malloc(st->st_size + 1);
+	int errcode = 0;
+
+	if (target == NULL) {
+		return errno;
+	}
+
+	const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, st->st_mtim };
+	const ssize_t length = readlinkat(srcdirfd, name, target, st->st_size + 1);
+
+	if (length < 0 || length > st->st_size) {
+		/* Changed since it was stated */
+		errcode = length < 0 ? errno : EAGAIN;
+	} else {
+		target[length] = '\0';
+		if (symlinkat(target, dstdirfd, name) != 0
+			|| ((st->st_uid != geteuid() || st->st_gid != getegid()) && fchownat(dstdirfd, name, st->st_uid, st->st_gid, AT_SYMLINK_NOFOLLOW) != 0)
+			|| utimensat(dstdirfd, name, times, AT_SYMLINK_NOFOLLOW) != 0) {
+			errcode = errno;
+		}
+	}
+
+	free(target);
+
+	return errcode;
+}
+
+static int
+hny_clone_special(int dstdirfd, const char *name, const struct stat *st) {
+	const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, st->st_mtim };
+
+	if (mknodat(dstdirfd, name, (st->st_mode & ~07777) | 0600, st->st_rdev) != 0
+		|| ((st->st_uid != geteuid() || st->st_gid != getegid()) && fchownat(dstdirfd, name, st->st_uid, st->st_gid, AT_SYMLINK_NOFOLLOW) != 0)
+		|| fchmodat(dstdirfd, name, st->st_mode & 07777, 0) != 0
+		|| utimensat(dstdirfd, name, times, AT_SYMLINK_NOFOLLOW) != 0) {
+		return errno;
+	}
+
+	return 0;
+}
+
+static int
+hny_clone_directory(int srcfd, int dstfd, const struct stat *st, int flags) {
+	struct dirent *entry;
+	int errcode = 0;
+	DIR *dirp;
+
+	dirp = fdopendir(srcfd);
+	if (dirp == NULL) {
+		errcode = errno;
+		close(srcfd);
+		return errcode;
+	}
+
+	while (errcode == 0 && (errno = 0, entry = readdir(dirp)) != NULL) {
+		const char * const name = entry->d_name;
+		struct stat entryst;
+
+		if (hny_clone_is_dot_or_dot_dot(name)) {
+			continue;
+		}
+
+		if (fstatat(dirfd(dirp), name, &entryst, AT_SYMLINK_NOFOLLOW) != 0) {
+			errcode = errno;
+			break;
+		}
+
+		switch (entryst.st_mode & S_IFMT) {
+		case S_IFDIR: {
+			int subsrcfd, subdstfd;
+
+			if (mkdirat(dstfd, name, 0700) != 0) {
+				errcode = errno;
+			} else if (subsrcfd = openat(dirfd(dirp), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC), subsrcfd < 0) {
+				errcode = errno;
+			} else if (subdstfd = openat(dstfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC), subdstfd < 0) {
+				errcode = errno;
+				close(subsrcfd);
+			} else {
+				errcode = hny_clone_directory(subsrcfd, subdstfd, &entryst, flags);
+				close(subdstfd);
+			}
+		} break;
+		case S_IFREG:
+			errcode = hny_clone_regular(dirfd(dirp), dstfd, name, &entryst, flags);
+			break;
+		case S_IFLNK:
+			errcode = hny_clone_symlink(dirfd(dirp), dstfd, name, &entryst);
+			break;
+		default:
+			errcode = hny_clone_special(dstfd, name, &entryst);
+			break;
+		}
+	}
+
+	if (errcode == 0 && errno != 0) {
+		errcode = errno;
+	}
+
+	closedir(dirp);
+
+	/* Metadata last, as creating entries updates the modification time, and permissions may forbid it.
+	 * The package directory itself keeps the metadata it was created with, as with extractions. */
+	if (errcode != 0 || st == NULL) {
+		return errcode;
+	}
+
+	const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, st->st_mtim };
+
+	if (((st->st_uid != geteuid() || st->st_gid != getegid()) && fchown(dstfd, st->st_uid, st->st_gid) != 0)
+		|| fchmod(dstfd, st->st_mode & 07777) != 0 || futimens(dstfd, times) != 0) {
+		return errno;
+	}
+
+	return 0;
+}
+
+int
+hny_clone_content(int srcfd, int dstfd, int flags) {
+	const int fd = dup(srcfd);
+
+	if (fd < 0) {
+		return errno;
+	}
+
+	/* Takes ownership of fd */
+	return hny_clone_directory(fd, dstfd, NULL, flags);
+}
+
+int
+hny_clone(struct hny *hny, const char *package, struct hny *source, const char *sourcepackage, int flags) {
+	int srcfd, dstfd, errcode;
+
+	if (hny_type_of(package) != HNY_TYPE_PACKAGE || hny_type_of(sourcepackage) != HNY_TYPE_PACKAGE) {
+		errcode = EINVAL;
+		goto hny_clone_err0;
+	}
+
+	srcfd = openat(dirfd(source->dirp), sourcepackage, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (srcfd < 0) {
+		errcode = errno;
+		goto hny_clone_err0;
+	}
+
+	if (mkdirat(dirfd(hny->dirp), package, 0777) != 0) {
+		errcode = errno;
+		goto hny_clone_err1;
+	}
+
+	dstfd = openat(dirfd(hny->dirp), package, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (dstfd < 0) {
+		errcode = errno;
+		goto hny_clone_err3;
+	}
+
+	/* Takes ownership of srcfd */
+	errcode = hny_clone_directory(srcfd, dstfd, NULL, flags);
+
+	/* Every entry is new, syncing the whole filesystem is as durable as syncing them one by one */
+	if (errcode == 0 && (flags & (HNY_EXTRACTION_FLAGS_SYNCFS | HNY_EXTRACTION_FLAGS_FDATASYNC))) {
+#ifdef CONFIG_HAS_SYNCFS
+		if (syncfs(dstfd) != 0) {
+			errcode = errno;
+		}
+#else
+		sync();
+#endif
+	}
+
+	close(dstfd);
+	if (errcode != 0) {
+		goto hny_clone_err2;
+	}
+
+	return 0;
+hny_clone_err3:
+	close(srcfd);
+hny_clone_err2:
+	/* Leave the prefix as it was before */
+	hny_remove(hny, package);
+	return errcode;
+hny_clone_err1:
+	close(srcfd);
+hny_clone_err0:
+	return errcode;
+}
@@ -2,16 +2,45 @@
 #include "hny_prefix.h"
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include <errno.h>
 
 #include "config.h"
 
 #include "cpio_decoder.h"
+#include "ring_buffer.h"
 #include "xz_decoder.h"
 
+/* Flags whose extraction never allocates once created */
+#define HNY_EXTRACTION_FLAGS_STATIC (HNY_EXTRACTION_FLAGS_SPARSE | HNY_EXTRACTION_FLAGS_SYNCFS \
+	| HNY_EXTRACTION_FLAGS_WRITEBACK | HNY_EXTRACTION_FLAGS_METADATA)
+
+struct hny_extraction_mirror {
+	struct hny *hny;
+	char *package;
+	struct cpio_decoder cpio; /**< Materializes regular files from the primary decoder's. */
+};
+
 struct hny_extraction {
+	struct hny *hny;
+	char *package; /**< Name of the package directory, NULL if extracting to a sink. */
+	struct hny_extraction_mirror *mirrors; /**< Other targets of a fan-out, decoding after the primary decoder. */
+	size_t mirrorscount;
 	struct xz_decoder xz;
 	struct cpio_decoder cpio;
+	struct {
+		struct ring_buffer ring; /**< Decompressed spans, produced by the caller's thread. */
+		pthread_t thread; /**< Consumes spans and decodes entries. */
+		bool running; /**< Whether thread must be joined. */
+		enum cpio_decoder_status status; /**< Last status of the cpio decoder, valid once joined. */
+	} pipeline;
+	bool pipelined; /**< Whether decompression and entries decoding are done on different threads. */
+	bool fixed; /**< Whether the handler lives in caller memory, see hny_extraction_create_static(). */
+	unsigned long long uncompressed; /**< Bytes decompressed so far. */
 	size_t size;
 	char buffer[];
 };
@@ -27,11 +56,66 @@ xz_status_error_to_hny(enum xz_decoder_status status) {
 static enum hny_extraction_status
 cpio_status_error_to_hny(enum cpio_decoder_status status) {
 
-	_Static_assert(CPIO_DECODER_STATUS_ERROR_WRITE - CPIO_DECODER_STATUS_ERROR_HEADER_INVALID_MAGIC == HNY_EXTRACTION_STATUS_ERROR_CPIO_WRITE - HNY_EXTRACTION_STATUS_ERROR_CPIO_HEADER_INVALID_MAGIC, "Mismatch error codes count between enum xz_decoder_status and enum hny_extraction_status");
+	_Static_assert(CPIO_DECODER_STATUS_ERROR_DELTA - CPIO_DECODER_STATUS_ERROR_HEADER_INVALID_MAGIC == HNY_EXTRACTION_STATUS_ERROR_CPIO_DELTA - HNY_EXTRACTION_STATUS_ERROR_CPIO_HEADER_INVALID_MAGIC, "Mismatch error codes count between enum xz_decoder_status and enum hny_extraction_status");
 
 	return (status - CPIO_DECODER_STATUS_ERROR_HEADER_INVALID_MAGIC) + HNY_EXTRACTION_STATUS_ERROR_CPIO_HEADER_INVALID_MAGIC;
 }
 
+static enum cpio_decoder_status
+hny_extraction_decode(struct hny_extraction *extraction, const char *buffer, size_t size) {
+	enum cpio_decoder_status status = cpio_decoder_decode(&extraction->cpio, buffer, size);
+
+	/* Mirrors decode each span once the primary did, so the regular files they reach are complete */
+	for (size_t i = 0; i < extraction->mirrorscount && status <= CPIO_DECODER_STATUS_END; i++) {
+		struct cpio_decoder * const mirror = &extraction->mirrors[i].cpio;
+		const enum cpio_decoder_status mirrorstatus = cpio_decoder_decode(mirror, buffer, size);
+
+		if (mirrorstatus > CPIO_DECODER_STATUS_END) { /* CPIO_DECODER_STATUS_ERROR_* */
+			/* Reported through the primary, see hny_extraction_errcode() */
+			extraction->cpio.errcode = mirror->errcode;
+			status = mirrorstatus;
+		}
+	}
+
+	return status;
+}
+
+static void *
+hny_extraction_pipeline_run(void *data) {
+	struct hny_extraction * const extraction = data;
+	enum cpio_decoder_status status = CPIO_DECODER_STATUS_OK;
+	const char *span;
+	size_t size;
+
+	/* Drains every span, even after the trailer, until the producer closes the ring */
+	while (size = ring_buffer_peek(&extraction->pipeline.ring, &span), size != 0) {
+		status = hny_extraction_decode(extraction, span, size);
+		ring_buffer_consume(&extraction->pipeline.ring, size);
+
+		if (status > CPIO_DECODER_STATUS_END /* CPIO_DECODER_STATUS_ERROR_* */ || status == CPIO_DECODER_STATUS_STOP) {
+			/* Stops the producer, which joins us and reports the error, or ends early */
+			ring_buffer_close(&extraction->pipeline.ring);
+			break;
+		}
+	}
+
+	extraction->pipeline.status = status;
+
+	return NULL;
+}
+
+static enum cpio_decoder_status
+hny_extraction_pipeline_join(struct hny_extraction *extraction) {
+
+	if (extraction->pipeline.running) {
+		ring_buffer_close(&extraction->pipeline.ring);
+		pthread_join(extraction->pipeline.thread, NULL);
+		extraction->pipeline.running = false;
+	}
+
+	return extraction->pipeline.status;
+}
+
 int
 hny_extraction_create(struct hny_extraction **extractionp, struct hny *hny, const char *package) {
 	return hny_extraction_create2(extractionp, hny, package, CONFIG_HNY_EXTRACTION_BUFFERSIZE_DEFAULT, CONFIG_HNY_EXTRACTION_DICTIONARYMAX_DEFAULT);
@@ -39,6 +123,77 @@ hny_extraction_create(struct hny_extraction **extractionp, struct hny *hny, cons
 
 int
 hny_extraction_create2(struct hny_extraction **extractionp, struct hny *hny, const char *package, size_t size, size_t dictionarymax) {
+	return hny_extraction_create3(extractionp, hny, package, size, dictionarymax, HNY_EXTRACTION_FLAGS_NONE);
+}
+
+static void
+hny_extraction_mirrors_deinit(struct hny_extraction *extraction, bool abort) {
+
+	for (size_t i = 0; i < extraction->mirrorscount; i++) {
+		struct hny_extraction_mirror * const mirror = extraction->mirrors + i;
+
+		if (abort) {
+			cpio_decoder_abort(&mirror->cpio, dirfd(mirror->hny->dirp), mirror->package);
+		}
+		cpio_decoder_deinit(&mirror->cpio);
+		free(mirror->package);
+	}
+
+	free(extraction->mirrors);
+}
+
+static int
+hny_extraction_mirrors_init(struct hny_extraction *extraction, const struct hny_extraction_target *targets, size_t count, int flags) {
+	int errcode = 0;
+
+	extraction->mirrors = NULL;
+	extraction->mirrorscount = 0;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	extraction->mirrors = malloc(sizeof (*extraction->mirrors) * count);
+	if (extraction->mirrors == NULL) {
+		return errno;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		struct hny_extraction_mirror * const mirror = extraction->mirrors + i;
+
+		mirror->hny = targets[i].hny;
+		mirror->package = strdup(targets[i].package);
+		if (mirror->package == NULL) {
+			errcode = errno;
+			break;
+		}
+
+		errcode = cpio_decoder_init(&mirror->cpio, dirfd(mirror->hny->dirp), mirror->package, flags);
+		if (errcode != 0) {
+			free(mirror->package);
+			break;
+		}
+		extraction->mirrorscount++;
+
+		errcode = cpio_decoder_mirror(&mirror->cpio, extraction->cpio.dirfd);
+		if (errcode != 0) {
+			break;
+		}
+	}
+
+	if (errcode != 0) {
+		/* Removes package directories created so far */
+		hny_extraction_mirrors_deinit(extraction, true);
+	}
+
+	return errcode;
+}
+
+static int
+hny_extraction_create_common(struct hny_extraction **extractionp, const struct hny_extraction_target *targets, size_t count,
+	const struct hny_sink *sink, void *context, size_t size, size_t dictionarymax, int flags) {
+	struct hny * const hny = count != 0 ? targets->hny : NULL;
+	const char * const package = count != 0 ? targets->package : NULL;
 	struct hny_extraction *extraction;
 	int errcode;
 
@@ -46,45 +201,383 @@ hny_extraction_create2(struct hny_extraction **extractionp, struct hny *hny, con
 		size = CONFIG_HNY_EXTRACTION_BUFFERSIZE_MIN;
 	}
 
-	if (hny_type_of(package) != HNY_TYPE_PACKAGE) {
-		errcode = EINVAL;
-		goto hny_extraction_create_err0;
-	}
-
 	extraction = malloc(sizeof (*extraction) + size);
 	if (extraction == NULL) {
 		errcode = errno;
-		goto hny_extraction_create_err0;
+		goto hny_extraction_create_common_err0;
 	}
 
+	extraction->hny = hny;
 	extraction->size = size;
+	extraction->uncompressed = 0;
+	extraction->fixed = false;
+
+	if (package != NULL) {
+		extraction->package = strdup(package);
+		if (extraction->package == NULL) {
+			errcode = errno;
+			goto hny_extraction_create_common_err1;
+		}
+	} else {
+		extraction->package = NULL;
+	}
 
 	errcode = xz_decoder_init(&extraction->xz, dictionarymax);
 	if (errcode != 0) {
-		goto hny_extraction_create_err1;
+		goto hny_extraction_create_common_err2;
 	}
 
-	errcode = cpio_decoder_init(&extraction->cpio, dirfd(hny->dirp), package);
+	if (sink != NULL) {
+		errcode = cpio_decoder_init_sink(&extraction->cpio, sink, context, flags);
+	} else if (count > 1) {
+		/* Written in place, so regular files are complete once decoded */
+		errcode = cpio_decoder_init(&extraction->cpio, dirfd(hny->dirp), package, flags & ~(HNY_EXTRACTION_FLAGS_PARALLEL | HNY_EXTRACTION_FLAGS_URING));
+	} else {
+		errcode = cpio_decoder_init(&extraction->cpio, dirfd(hny->dirp), package, flags);
+	}
 	if (errcode != 0) {
-		goto hny_extraction_create_err2;
+		goto hny_extraction_create_common_err3;
+	}
+
+	errcode = hny_extraction_mirrors_init(extraction, targets + 1, count > 1 ? count - 1 : 0, flags);
+	if (errcode != 0) {
+		goto hny_extraction_create_common_err4;
+	}
+
+	extraction->pipelined = (flags & HNY_EXTRACTION_FLAGS_PIPELINE) != 0;
+	extraction->pipeline.running = false;
+	if (extraction->pipelined) {
+		errcode = ring_buffer_init(&extraction->pipeline.ring, CONFIG_HNY_EXTRACTION_PIPELINE_SIZE);
+		if (errcode != 0) {
+			goto hny_extraction_create_common_err5;
+		}
+
+		extraction->pipeline.status = CPIO_DECODER_STATUS_OK;
+		errcode = pthread_create(&extraction->pipeline.thread, NULL, hny_extraction_pipeline_run, extraction);
+		if (errcode != 0) {
+			goto hny_extraction_create_common_err6;
+		}
+		extraction->pipeline.running = true;
 	}
 
 	*extractionp = extraction;
 
 	return 0;
-hny_extraction_create_err2:
+hny_extraction_create_common_err6:
+	ring_buffer_deinit(&extraction->pipeline.ring);
+hny_extraction_create_common_err5:
+	hny_extraction_mirrors_deinit(extraction, true);
+hny_extraction_create_common_err4:
+	cpio_decoder_deinit(&extraction->cpio);
+hny_extraction_create_common_err3:
 	xz_decoder_deinit(&extraction->xz);
-hny_extraction_create_err1:
+hny_extraction_create_common_err2:
+	free(extraction->package);
+hny_extraction_create_common_err1:
 	free(extraction);
-hny_extraction_create_err0:
+hny_extraction_create_common_err0:
+	return errcode;
+}
+
+int
+hny_extraction_create3(struct hny_extraction **extractionp, struct hny *hny, const char *package, size_t size, size_t dictionarymax, int flags) {
+
+	if (hny_type_of(package) != HNY_TYPE_PACKAGE) {
+		return EINVAL;
+	}
+
+	const struct hny_extraction_target target = { .hny = hny, .package = package };
+
+	return hny_extraction_create_common(extractionp, &target, 1, NULL, NULL, size, dictionarymax, flags);
+}
+
+int
+hny_extraction_create_fanout(struct hny_extraction **extractionp, const struct hny_extraction_target *targets, size_t count, size_t size, size_t dictionarymax, int flags) {
+
+	if (count == 0) {
+		return EINVAL;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (hny_type_of(targets[i].package) != HNY_TYPE_PACKAGE) {
+			return EINVAL;
+		}
+	}
+
+	return hny_extraction_create_common(extractionp, targets, count, NULL, NULL, size, dictionarymax, flags);
+}
+
+/* Static extractions' memory: the aligned handle and its buffer, the lzma2 dictionary,
+ * entries' path and symbolic links' target buffers, then the package name. */
+struct hny_extraction_layout {
+	size_t dictionary;
+	size_t filename;
+	size_t sltarget;
+	size_t package;
+	size_t total; /**< Including the slack to align the handle, SIZE_MAX if it overflows. */
+};
+
+static void
+hny_extraction_layout(struct hny_extraction_layout *layout, const char *package, size_t size, size_t dictionarymax) {
+	const size_t fixed = sizeof (struct hny_extraction) + PATH_MAX * 2 + strlen(package) + 1 + _Alignof (max_align_t) - 1;
+
+	if (size < CONFIG_HNY_EXTRACTION_BUFFERSIZE_MIN) {
+		size = CONFIG_HNY_EXTRACTION_BUFFERSIZE_MIN;
+	}
+
+	if (dictionarymax > UINT32_MAX || size > SIZE_MAX - fixed || dictionarymax > SIZE_MAX - fixed - size) {
+		layout->total = SIZE_MAX;
+		return;
+	}
+
+	layout->dictionary = sizeof (struct hny_extraction) + size;
+	layout->filename = layout->dictionary + dictionarymax;
+	layout->sltarget = layout->filename + PATH_MAX;
+	layout->package = layout->sltarget + PATH_MAX;
+	layout->total = fixed + size + dictionarymax;
+}
+
+size_t
+hny_extraction_static_size(const char *package, size_t size, size_t dictionarymax) {
+	struct hny_extraction_layout layout;
+
+	hny_extraction_layout(&layout, package, size, dictionarymax);
+
+	return layout.total;
+}
+
+int
+hny_extraction_create_static(struct hny_extraction **extractionp, struct hny *hny, const char *package,
+	void *memory, size_t memorysize, size_t size, size_t dictionarymax, int flags) {
+	struct hny_extraction_layout layout;
+	struct hny_extraction *extraction;
+	int errcode;
+
+	if (hny_type_of(package) != HNY_TYPE_PACKAGE || (flags & ~HNY_EXTRACTION_FLAGS_STATIC) != 0) {
+		return EINVAL;
+	}
+
+	hny_extraction_layout(&layout, package, size, dictionarymax);
+	if (layout.total == SIZE_MAX || memorysize < layout.total) {
+		return ENOBUFS;
+	}
+
+	/* Everything is carved from the region, at offsets from the aligned handle */
+	const uintptr_t alignment = _Alignof (max_align_t);
+	char * const base = (char *)(((uintptr_t)memory + alignment - 1) & ~(alignment - 1));
+
+	extraction = (struct hny_extraction *)base;
+	extraction->hny = hny;
+	extraction->package = strcpy(base + layout.package, package);
+	extraction->mirrors = NULL;
+	extraction->mirrorscount = 0;
+	extraction->pipelined = false;
+	extraction->pipeline.running = false;
+	extraction->fixed = true;
+	extraction->uncompressed = 0;
+	extraction->size = layout.dictionary - sizeof (*extraction);
+
+	xz_decoder_init_static(&extraction->xz, (uint8_t *)base + layout.dictionary, dictionarymax);
+
+	errcode = cpio_decoder_init(&extraction->cpio, dirfd(hny->dirp), package, flags);
+	if (errcode != 0) {
+		goto hny_extraction_create_static_err0;
+	}
+
+	cpio_decoder_fixed(&extraction->cpio, base + layout.filename, base + layout.sltarget, PATH_MAX);
+
+	*extractionp = extraction;
+
+	return 0;
+hny_extraction_create_static_err0:
+	xz_decoder_deinit(&extraction->xz);
+	return errcode;
+}
+
+static int
+hny_null_sink_entry(void *context, const struct hny_sink_entry *entry) {
+	return 0;
+}
+
+static int
+hny_null_sink_data(void *context, const char *buffer, size_t size) {
+	return 0;
+}
+
+const struct hny_sink hny_null_sink = {
+	.begin = hny_null_sink_entry,
+	.data = hny_null_sink_data,
+	.commit = hny_null_sink_entry,
+};
+
+int
+hny_extraction_create_sink(struct hny_extraction **extractionp, const struct hny_sink *sink, void *context, size_t size, size_t dictionarymax, int flags) {
+	return hny_extraction_create_common(extractionp, NULL, 0, sink, context, size, dictionarymax, flags);
+}
+
+int
+hny_extraction_base(struct hny_extraction *extraction, const char *base) {
+
+	/* Base files are compared through a growing buffer */
+	if (extraction->hny == NULL || extraction->fixed || hny_type_of(base) != HNY_TYPE_PACKAGE) {
+		return EINVAL;
+	}
+
+	return cpio_decoder_base(&extraction->cpio, dirfd(extraction->hny->dirp), base);
+}
+
+int
+hny_extraction_delta(struct hny_extraction *extraction, const char *base) {
+	const int unsupported = HNY_EXTRACTION_FLAGS_MANIFEST | HNY_EXTRACTION_FLAGS_METADATA | HNY_EXTRACTION_FLAGS_REINSTALL | HNY_EXTRACTION_FLAGS_FDATASYNC;
+	struct cpio_decoder * const cpio = &extraction->cpio;
+
+	/* The package is populated before any entry is decoded */
+	if (extraction->hny == NULL || extraction->fixed || extraction->mirrorscount != 0 || extraction->uncompressed != 0
+		|| cpio->base.delta || (cpio->flags & unsupported) || hny_type_of(base) != HNY_TYPE_PACKAGE) {
+		return EINVAL;
+	}
+
+	return cpio_decoder_delta(cpio, dirfd(extraction->hny->dirp), base);
+}
+
+int
+hny_extraction_filter(struct hny_extraction *extraction, const char *pattern, enum hny_extraction_filter filter) {
+
+	if (extraction->fixed || *pattern == '\0' || (filter != HNY_EXTRACTION_FILTER_ONLY && filter != HNY_EXTRACTION_FILTER_EXCLUDE)) {
+		return EINVAL;
+	}
+
+	const bool exclude = filter == HNY_EXTRACTION_FILTER_EXCLUDE;
+	int errcode = cpio_decoder_filter(&extraction->cpio, pattern, exclude);
+
+	for (size_t i = 0; errcode == 0 && i < extraction->mirrorscount; i++) {
+		errcode = cpio_decoder_filter(&extraction->mirrors[i].cpio, pattern, exclude);
+	}
+
 	return errcode;
 }
 
 void
 hny_extraction_destroy(struct hny_extraction *extraction) {
+
+	if (extraction->pipelined) {
+		hny_extraction_pipeline_join(extraction);
+		ring_buffer_deinit(&extraction->pipeline.ring);
+	}
+
+	hny_extraction_mirrors_deinit(extraction, false);
 	cpio_decoder_deinit(&extraction->cpio);
 	xz_decoder_deinit(&extraction->xz);
-	free(extraction);
+
+	if (!extraction->fixed) {
+		free(extraction->package);
+		free(extraction);
+	}
+}
+
+int
+hny_extraction_abort(struct hny_extraction *extraction) {
+
+	if (extraction->hny == NULL) {
+		return EINVAL;
+	}
+
+	/* Entries must not be created anymore while removing them */
+	if (extraction->pipelined) {
+		hny_extraction_pipeline_join(extraction);
+	}
+
+	int errcode = cpio_decoder_abort(&extraction->cpio, dirfd(extraction->hny->dirp), extraction->package);
+
+	if ((extraction->fixed || extraction->cpio.base.delta) && errcode == 0) {
+		/* Nothing was journaled, the package directory was created by the extraction anyway */
+		errcode = hny_remove(extraction->hny, extraction->package);
+	}
+
+	for (size_t i = 0; i < extraction->mirrorscount; i++) {
+		struct hny_extraction_mirror * const mirror = extraction->mirrors + i;
+		const int mirrorerrcode = cpio_decoder_abort(&mirror->cpio, dirfd(mirror->hny->dirp), mirror->package);
+
+		if (errcode == 0) {
+			errcode = mirrorerrcode;
+		}
+	}
+
+	return errcode;
+}
+
+static enum hny_extraction_status
+hny_extraction_end(struct hny_extraction *extraction, enum cpio_decoder_status status2) {
+
+	if (status2 > CPIO_DECODER_STATUS_END) { /* CPIO_DECODER_STATUS_ERROR_* */
+		return cpio_status_error_to_hny(status2);
+	}
+
+	if (status2 != CPIO_DECODER_STATUS_END && status2 != CPIO_DECODER_STATUS_STOP) {
+		return HNY_EXTRACTION_STATUS_ERROR_UNFINISHED_CPIO;
+	}
+
+	const enum cpio_decoder_status status3 = cpio_decoder_sync(&extraction->cpio, extraction->hny != NULL ? dirfd(extraction->hny->dirp) : -1);
+	if (status3 != CPIO_DECODER_STATUS_OK) {
+		return cpio_status_error_to_hny(status3);
+	}
+
+	for (size_t i = 0; i < extraction->mirrorscount; i++) {
+		struct hny_extraction_mirror * const mirror = extraction->mirrors + i;
+		const enum cpio_decoder_status mirrorstatus = cpio_decoder_sync(&mirror->cpio, dirfd(mirror->hny->dirp));
+
+		if (mirrorstatus != CPIO_DECODER_STATUS_OK) {
+			extraction->cpio.errcode = mirror->cpio.errcode;
+			return cpio_status_error_to_hny(mirrorstatus);
+		}
+	}
+
+	return status2 == CPIO_DECODER_STATUS_STOP ? HNY_EXTRACTION_STATUS_STOPPED : HNY_EXTRACTION_STATUS_END;
+}
+
+static enum hny_extraction_status
+hny_extraction_extract_pipelined(struct hny_extraction *extraction, const char *buffer, size_t size) {
+	enum hny_extraction_status status = HNY_EXTRACTION_STATUS_OK;
+	struct xz_stream stream = { .input = { .next = buffer, .available = size } };
+
+	while (stream.input.available != 0) {
+		char *span;
+		const size_t capacity = ring_buffer_reserve(&extraction->pipeline.ring, &span);
+
+		if (capacity == 0) {
+			/* The cpio thread stopped, on an error or early end, unless the extraction already ended */
+			const enum cpio_decoder_status status2 = hny_extraction_pipeline_join(extraction);
+
+			if (status2 > CPIO_DECODER_STATUS_END) { /* CPIO_DECODER_STATUS_ERROR_* */
+				status = cpio_status_error_to_hny(status2);
+			} else if (status2 == CPIO_DECODER_STATUS_STOP) {
+				status = hny_extraction_end(extraction, status2);
+			} else {
+				status = HNY_EXTRACTION_STATUS_ERROR_UNFINISHED_CPIO;
+			}
+			break;
+		}
+
+		stream.output.next = span;
+		stream.output.available = capacity;
+
+		const enum xz_decoder_status status1 = xz_decoder_decode(&extraction->xz, &stream);
+		if (status1 > XZ_DECODER_STATUS_END) { /* XZ_DECODER_STATUS_ERROR_* */
+			hny_extraction_pipeline_join(extraction);
+			status = xz_status_error_to_hny(status1);
+			break;
+		}
+
+		ring_buffer_produce(&extraction->pipeline.ring, capacity - stream.output.available);
+		extraction->uncompressed += capacity - stream.output.available;
+
+		if (status1 == XZ_DECODER_STATUS_END) {
+			status = hny_extraction_end(extraction, hny_extraction_pipeline_join(extraction));
+			break;
+		}
+	}
+
+	return status;
 }
 
 enum hny_extraction_status
@@ -92,7 +585,11 @@ hny_extraction_extract(struct hny_extraction *extraction, const char *buffer, si
 	enum hny_extraction_status status = HNY_EXTRACTION_STATUS_OK;
 	struct xz_stream stream = { .input = { .next = buffer, .available = size } };
 
-	while (size != 0) {
+	if (extraction->pipelined) {
+		return hny_extraction_extract_pipelined(extraction, buffer, size);
+	}
+
+	while (stream.input.available != 0) {
 		stream.output.next = extraction->buffer;
 		stream.output.available = extraction->size;
 
@@ -102,18 +599,16 @@ hny_extraction_extract(struct hny_extraction *extraction, const char *buffer, si
 			break;
 		}
 
-		const enum cpio_decoder_status status2 = cpio_decoder_decode(&extraction->cpio, extraction->buffer, extraction->size - stream.output.available);
+		extraction->uncompressed += extraction->size - stream.output.available;
+
+		const enum cpio_decoder_status status2 = hny_extraction_decode(extraction, extraction->buffer, extraction->size - stream.output.available);
 		if (status2 > CPIO_DECODER_STATUS_END) { /* CPIO_DECODER_STATUS_ERROR_* */
 			status = cpio_status_error_to_hny(status2);
 			break;
 		}
 
-		if (status1 == XZ_DECODER_STATUS_END) {
-			if (status2 == CPIO_DECODER_STATUS_END) {
-				status = HNY_EXTRACTION_STATUS_END;
-			} else {
-				status = HNY_EXTRACTION_STATUS_ERROR_UNFINISHED_CPIO;
-			}
+		if (status1 == XZ_DECODER_STATUS_END || status2 == CPIO_DECODER_STATUS_STOP) {
+			status = hny_extraction_end(extraction, status2);
 			break;
 		}
 	}
@@ -129,3 +624,9 @@ hny_extraction_errcode(struct hny_extraction *extraction) {
 
 	return errcode;
 }
+
+void
+hny_extraction_stats(const struct hny_extraction *extraction, struct hny_extraction_stats *stats) {
+	*stats = extraction->cpio.stats;
+	stats->uncompressed = extraction->uncompressed;
+}
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include <hny.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+struct hny_memory {
+	struct hny_memory_entry *entries; /**< Entries in archive order, the last one may be receiving data. */
+	size_t count;
+	size_t capacity;
+	size_t offset; /**< Bytes received for the last entry. */
+};
+
+int
+hny_memory_create(struct hny_memory **memoryp) {
+	struct hny_memory * const memory = malloc(sizeof (*memory));
+
+	if (memory == NULL) {
+		return errno;
+	}
+
+	memory->entries = NULL;
+	memory->count = 0;
+	memory->capacity = 0;
+	memory->offset = 0;
+
+	*memoryp = memory;
+
+	return 0;
+}
+
+void
+hny_memory_destroy(struct hny_memory *memory) {
+
+	for (size_t i = 0; i < memory->count; i++) {
+		free((char *)memory->entries[i].path);
+		free((char *)memory->entries[i].data);
+	}
+
+	free(memory->entries);
+	free(memory);
+}
+
+size_t
+hny_memory_entries(const struct hny_memory *memory, const struct hny_memory_entry **entriesp) {
+
+	*entriesp = memory->entries;
+
+	return memory->count;
+}
+
+const struct hny_memory_entry *
+hny_memory_find(const struct hny_memory *memory, const char *path) {
+
+	for (size_t i = 0; i < memory->count; i++) {
+		if (strcmp(memory->entries[i].path, path) == 0) {
+			return memory->entries + i;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+hny_memory_begin(void *context, const struct hny_sink_entry *entry) {
+	struct hny_memory * const memory = context;
+	char *path, *data = NULL;
+
+	if (memory->count == memory->capacity) {
+		const size_t newcapacity = memory->capacity * 2 + 16;
+		struct hny_memory_entry * const newentries = realloc(memory->entries, sizeof (*newentries) * newcapacity);
+
+		if (newentries == NULL) {
+			return errno;
+		}
+
+		memory->entries = newentries;
+		memory->capacity = newcapacity;
+	}
+
+	path = strdup(entry->path);
+	if (path == NULL) {
+		return errno;
+	}
+
+	if (S_ISREG(entry->mode) || S_ISLNK(entry->mode)) {
+		/* One more byte to null-terminate symbolic link targets */
+		data = malloc(entry->size + 1);
+		if (data == NULL) {
+			const int errcode = errno;
+			free(path);
+			return errcode;
+		}
+	}
+
+	struct hny_memory_entry * const current = memory->entries + memory->count;
+
+	current->path = path;
+	current->mode = entry->mode;
+	current->uid = entry->uid;
+	current->gid = entry->gid;
+	current->rdev = entry->rdev;
+	current->mtime = entry->mtime;
+	current->data = data;
+	current->size = entry->size;
+
+	memory->count++;
+	memory->offset = 0;
+
+	return 0;
+}
+
+static int
+hny_memory_data(void *context, const char *buffer, size_t size) {
+	struct hny_memory * const memory = context;
+	struct hny_memory_entry * const current = memory->entries + memory->count - 1;
+
+	if (current->data == NULL || current->size - memory->offset < size) {
+		return EINVAL;
+	}
+
+	memcpy((char *)current->data + memory->offset, buffer, size);
+	memory->offset += size;
+
+	return 0;
+}
+
+static int
+hny_memory_commit(void *context, const struct hny_sink_entry *entry) {
+	struct hny_memory * const memory = context;
+	struct hny_memory_entry * const current = memory->entries + memory->count - 1;
+
+	if (current->data != NULL) {
+		((char *)current->data)[current->size] = '\0';
+	}
+
+	return 0;
+}
+
+const struct hny_sink hny_memory_sink = {
+	.begin = hny_memory_begin,
+	.data = hny_memory_data,
+	.commit = hny_memory_commit,
+};
@@ -0,0 +1,760 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#define _GNU_SOURCE
+#include <hny.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <search.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#include "cpio_encoder.h"
+#include "toc.h"
+#include "util.h"
+#include "worker_pool.h"
+#include "xz_encoder.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+struct hny_pack_block {
+	struct worker_job job;
+	struct lzma2_encoder *encoder;
+	uint8_t *input; /**< Archive bytes, CONFIG_HNY_PACK_BLOCK_SIZE at most. */
+	size_t size;
+	uint8_t *output; /**< Encoded xz block, XZ_ENCODER_BLOCK_BOUND() of the block size. */
+	size_t written;
+	struct xz_encoder_record record;
+};
+
+struct hny_pack_entry {
+	char *path;
+	char *target; /**< Symbolic links' target, read along their metadata. */
+	struct stat st;
+};
+
+struct hny_pack_path {
+	char *buffer;
+	size_t length;
+	size_t capacity;
+};
+
+struct hny_pack {
+	int fd;
+	struct worker_pool *pool;
+	unsigned int jobs;
+	struct lzma2_encoder *encoders; /**< One per job, only one batch is compressed at a time. */
+	struct hny_pack_block *blocks; /**< Two batches of jobs blocks, one filled while the other is compressed. */
+	unsigned int batch; /**< Batch being filled. */
+	unsigned int filled; /**< Full blocks in the batch being filled, the next one is the current one. */
+	unsigned int compressing; /**< Blocks of the other batch being compressed. */
+	struct {
+		struct xz_encoder_record *records;
+		size_t count;
+		size_t capacity;
+	} index;
+	struct {
+		struct hny_pack_entry *array; /**< Every entry is known before writing, to size the table of contents. */
+		size_t count;
+		size_t capacity;
+	} entries;
+	uint32_t ino;
+	void *directories; /**< tsearch(3) tree of directories already archived, when entries are given. */
+};
+
+static int
+hny_pack_block_run(struct worker_job *job) {
+	struct hny_pack_block * const block = (struct hny_pack_block *)job;
+
+	block->written = xz_encoder_block(block->encoder, block->input, block->size, block->output, &block->record);
+
+	return 0;
+}
+
+static inline struct hny_pack_block *
+hny_pack_current(struct hny_pack *pack) {
+	return pack->blocks + pack->batch * pack->jobs + pack->filled;
+}
+
+/* Waits for the batch being compressed and writes it in order */
+static int
+hny_pack_collect(struct hny_pack *pack) {
+	const struct hny_pack_block * const blocks = pack->blocks + (pack->batch ^ 1) * pack->jobs;
+	int errcode;
+
+	if (pack->compressing == 0) {
+		return 0;
+	}
+
+	errcode = worker_pool_wait(pack->pool);
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	if (pack->index.count + pack->compressing > pack->index.capacity) {
+		const size_t capacity = pack->index.capacity * 2 + pack->compressing;
+		struct xz_encoder_record * const records = realloc(pack->index.records, sizeof (*records) * capacity);
+
+		if (records == NULL) {
+			return errno;
+		}
+
+		pack->index.records = records;
+		pack->index.capacity = capacity;
+	}
+
+	for (unsigned int i = 0; i < pack->compressing; i++) {
+		errcode = util_write_all(pack->fd, blocks[i].output, blocks[i].written);
+		if (errcode != 0) {
+			return errcode;
+		}
+
+		pack->index.records[pack->index.count++] = blocks[i].record;
+	}
+
+	pack->compressing = 0;
+
+	return 0;
+}
+
+/* Compresses the filled blocks of the current batch, and starts filling the other one */
+static int
+hny_pack_submit(struct hny_pack *pack) {
+	struct hny_pack_block * const blocks = pack->blocks + pack->batch * pack->jobs;
+	const int errcode = hny_pack_collect(pack);
+
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	for (unsigned int i = 0; i < pack->filled; i++) {
+		blocks[i].job.run = hny_pack_block_run;
+		blocks[i].encoder = pack->encoders + i;
+		worker_pool_push(pack->pool, &blocks[i].job);
+	}
+
+	pack->compressing = pack->filled;
+	pack->filled = 0;
+	pack->batch ^= 1;
+
+	for (unsigned int i = 0; i < pack->jobs; i++) {
+		hny_pack_current(pack)[i].size = 0;
+	}
+
+	return 0;
+}
+
+static inline int
+hny_pack_advance(struct hny_pack *pack, struct hny_pack_block *block) {
+
+	if (block->size == CONFIG_HNY_PACK_BLOCK_SIZE && ++pack->filled == pack->jobs) {
+		return hny_pack_submit(pack);
+	}
+
+	return 0;
+}
+
+static int
+hny_pack_append(struct hny_pack *pack, const void *data, size_t size) {
+
+	while (size != 0) {
+		struct hny_pack_block * const block = hny_pack_current(pack);
+		const size_t length = MIN(size, CONFIG_HNY_PACK_BLOCK_SIZE - block->size);
+		int errcode;
+
+		memcpy(block->input + block->size, data, length);
+		block->size += length;
+		data = (const uint8_t *)data + length;
+		size -= length;
+
+		errcode = hny_pack_advance(pack, block);
+		if (errcode != 0) {
+			return errcode;
+		}
+	}
+
+	return 0;
+}
+
+/* Reads files straight into blocks, the archived size is the one declared in their header */
+static int
+hny_pack_append_file(struct hny_pack *pack, int fd, uint64_t size) {
+
+	while (size != 0) {
+		struct hny_pack_block * const block = hny_pack_current(pack);
+		const size_t length = MIN(size, CONFIG_HNY_PACK_BLOCK_SIZE - block->size);
+		const ssize_t readval = read(fd, block->input + block->size, length);
+		int errcode;
+
+		if (readval <= 0) {
+			if (readval < 0 && errno == EINTR) {
+				continue;
+			}
+			/* The file shrank since its header was written */
+			return readval < 0 ? errno : EIO;
+		}
+
+		block->size += readval;
+		size -= readval;
+
+		errcode = hny_pack_advance(pack, block);
+		if (errcode != 0) {
+			return errcode;
+		}
+	}
+
+	return 0;
+}
+
+static inline uint64_t
+hny_pack_entry_filesize(const struct hny_pack_entry *entry) {
+
+	if (entry->target != NULL) {
+		return strlen(entry->target);
+	}
+
+	return S_ISREG(entry->st.st_mode) ? entry->st.st_size : 0;
+}
+
+static int
+hny_pack_add(struct hny_pack *pack, int dirfd, const char *name, const char *path, const struct stat *st) {
+	struct hny_pack_entry *entry;
+
+	if (pack->entries.count == pack->entries.capacity) {
+		const size_t capacity = pack->entries.capacity * 2 + 64;
+		struct hny_pack_entry * const array = realloc(pack->entries.array, sizeof (*array) * capacity);
+
+		if (array == NULL) {
+			return errno;
+		}
+
+		pack->entries.array = array;
+		pack->entries.capacity = capacity;
+	}
+
+	entry = pack->entries.array + pack->entries.count;
+	entry->path = strdup(path);
+	entry->target = NULL;
+	entry->st = *st;
+
+	if (entry->path == NULL) {
+		return errno;
+	}
+
+	if (S_ISLNK(st->st_mode)) {
+		char target[PATH_MAX];
+		const ssize_t length = readlinkat(dirfd, name, target, sizeof (target));
+
+		if (length < 0 || length == sizeof (target)) {
+			const int errcode = length < 0 ? errno : ENAMETOOLONG;
+			free(entry->path);
+			return errcode;
+		}
+
+		entry->target = strndup(target, length);
+		if (entry->target == NULL) {
+			const int errcode = errno;
+			free(entry->path);
+			return errcode;
+		}
+	}
+
+	pack->entries.count++;
+
+	return 0;
+}
+
+static int
+hny_pack_write_entry(struct hny_pack *pack, int dirfd, const struct hny_pack_entry *entry) {
+	const size_t namesize = strlen(entry->path) + 1;
+	const uint64_t filesize = hny_pack_entry_filesize(entry);
+	char header[CPIO_ENCODER_HEADER_SIZE];
+	int errcode, fd = -1;
+
+	if (S_ISREG(entry->st.st_mode)) {
+		fd = openat(dirfd, entry->path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) {
+			return errno;
+		}
+	}
+
+	errcode = cpio_encoder_header(header, &entry->st, ++pack->ino, namesize, filesize);
+	if (errcode != 0) {
+		goto hny_pack_write_entry_err0;
+	}
+
+	errcode = hny_pack_append(pack, header, sizeof (header));
+	if (errcode != 0) {
+		goto hny_pack_write_entry_err0;
+	}
+
+	errcode = hny_pack_append(pack, entry->path, namesize);
+	if (errcode != 0) {
+		goto hny_pack_write_entry_err0;
+	}
+
+	if (entry->target != NULL) {
+		errcode = hny_pack_append(pack, entry->target, filesize);
+	} else if (fd >= 0) {
+		errcode = hny_pack_append_file(pack, fd, filesize);
+	}
+
+hny_pack_write_entry_err0:
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	return errcode;
+}
+
+/* Ends the current block early, even if not full */
+static int
+hny_pack_cut(struct hny_pack *pack) {
+
+	if (hny_pack_current(pack)->size != 0 && ++pack->filled == pack->jobs) {
+		return hny_pack_submit(pack);
+	}
+
+	return 0;
+}
+
+/* Writes the table of contents in blocks of its own, entries' offsets follow its size */
+static int
+hny_pack_toc(struct hny_pack *pack) {
+	const struct stat st = { .st_mode = S_IFREG | 0644 };
+	char header[CPIO_ENCODER_HEADER_SIZE];
+	size_t size = TOC_HEADER_SIZE;
+	uint64_t offset;
+	uint8_t *toc, *record;
+	int errcode;
+
+	for (size_t i = 0; i < pack->entries.count; i++) {
+		size += TOC_RECORD_SIZE + strlen(pack->entries.array[i].path) + 1;
+	}
+
+	toc = malloc(size);
+	if (toc == NULL) {
+		return errno;
+	}
+
+	memcpy(toc, TOC_MAGIC, TOC_MAGIC_SIZE);
+	util_store64(toc + TOC_MAGIC_SIZE, pack->entries.count);
+
+	offset = sizeof (header) + sizeof (HNY_TOC_FILE) + size;
+	record = toc + TOC_HEADER_SIZE;
+	for (size_t i = 0; i < pack->entries.count; i++) {
+		const struct hny_pack_entry * const entry = pack->entries.array + i;
+		const size_t pathsize = strlen(entry->path) + 1;
+		const uint64_t filesize = hny_pack_entry_filesize(entry);
+
+		util_store64(record, offset);
+		util_store64(record + 8, filesize);
+		util_store32(record + 16, entry->st.st_mode);
+		util_store32(record + 20, pathsize);
+		memcpy(record + TOC_RECORD_SIZE, entry->path, pathsize);
+
+		record += TOC_RECORD_SIZE + pathsize;
+		offset += sizeof (header) + pathsize + filesize;
+	}
+
+	errcode = cpio_encoder_header(header, &st, ++pack->ino, sizeof (HNY_TOC_FILE), size);
+	if (errcode == 0) {
+		errcode = hny_pack_append(pack, header, sizeof (header));
+	}
+	if (errcode == 0) {
+		errcode = hny_pack_append(pack, HNY_TOC_FILE, sizeof (HNY_TOC_FILE));
+	}
+	if (errcode == 0) {
+		errcode = hny_pack_append(pack, toc, size);
+	}
+	if (errcode == 0) {
+		errcode = hny_pack_cut(pack);
+	}
+
+	free(toc);
+
+	return errcode;
+}
+
+static int
+hny_pack_path_push(struct hny_pack_path *path, const char *name) {
+	const size_t length = strlen(name), required = path->length + 1 + length + 1;
+
+	if (required > path->capacity) {
+		char * const buffer = realloc(path->buffer, required * 2);
+
+		if (buffer == NULL) {
+			return errno;
+		}
+
+		path->buffer = buffer;
+		path->capacity = required * 2;
+	}
+
+	if (path->length != 0) {
+		path->buffer[path->length++] = '/';
+	}
+
+	memcpy(path->buffer + path->length, name, length + 1);
+	path->length += length;
+
+	return 0;
+}
+
+static int
+hny_pack_compare_names(const void *lhs, const void *rhs) {
+	return strcmp(*(const char * const *)lhs, *(const char * const *)rhs);
+}
+
+/* Lists the content of a directory, in name order, descending into directories right after listing them */
+static int
+hny_pack_directory(struct hny_pack *pack, int dirfd, struct hny_pack_path *path) {
+	const size_t length = path->length;
+	DIR * const dirp = fdopendir(dirfd);
+	char **names = NULL;
+	size_t count = 0, capacity = 0;
+	struct dirent *entry;
+	int errcode = 0;
+
+	if (dirp == NULL) {
+		errcode = errno;
+		close(dirfd);
+		return errcode;
+	}
+
+	while (errno = 0, entry = readdir(dirp), entry != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		/* Never archive a stale table of contents, a new one is written if requested */
+		if (length == 0 && strcmp(entry->d_name, HNY_TOC_FILE) == 0) {
+			continue;
+		}
+
+		if (count == capacity) {
+			char ** const newnames = realloc(names, sizeof (*names) * (capacity * 2 + 16));
+
+			if (newnames == NULL) {
+				errcode = errno;
+				goto hny_pack_directory_err0;
+			}
+
+			names = newnames;
+			capacity = capacity * 2 + 16;
+		}
+
+		names[count] = strdup(entry->d_name);
+		if (names[count] == NULL) {
+			errcode = errno;
+			goto hny_pack_directory_err0;
+		}
+		count++;
+	}
+
+	if (errno != 0) {
+		errcode = errno;
+		goto hny_pack_directory_err0;
+	}
+
+	qsort(names, count, sizeof (*names), hny_pack_compare_names);
+
+	/* The metadata directory comes first at the root, so its files are extracted before the rest is decoded */
+	if (length == 0) {
+		for (size_t i = 0; i < count; i++) {
+			if (strcmp(names[i], HNY_METADATA_DIRECTORY) == 0) {
+				char * const metadata = names[i];
+
+				memmove(names + 1, names, sizeof (*names) * i);
+				*names = metadata;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		struct stat st;
+
+		if (fstatat(dirfd, names[i], &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			errcode = errno;
+			break;
+		}
+
+		errcode = hny_pack_path_push(path, names[i]);
+		if (errcode != 0) {
+			break;
+		}
+
+		errcode = hny_pack_add(pack, dirfd, names[i], path->buffer, &st);
+		if (errcode != 0) {
+			break;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			const int subdirfd = openat(dirfd, names[i], O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+			if (subdirfd < 0) {
+				errcode = errno;
+				break;
+			}
+
+			errcode = hny_pack_directory(pack, subdirfd, path);
+			if (errcode != 0) {
+				break;
+			}
+		}
+
+		path->length = length;
+	}
+
+hny_pack_directory_err0:
+	for (size_t i = 0; i < count; i++) {
+		free(names[i]);
+	}
+	free(names);
+	closedir(dirp);
+
+	return errcode;
+}
+
+static int
+hny_pack_compare_paths(const void *lhs, const void *rhs) {
+	return strcmp(lhs, rhs);
+}
+
+/* Explicit entries must be normalized, and follow the directory they're in */
+static int
+hny_pack_check(struct hny_pack *pack, const char *path, const struct stat *st) {
+	const char * const slash = strrchr(path, '/');
+	const char *component = path;
+
+	if (strcmp(path, HNY_TOC_FILE) == 0) {
+		return EINVAL;
+	}
+
+	do {
+		const char * const end = strchrnul(component, '/');
+		const size_t length = end - component;
+
+		if (length == 0 || (length == 1 && *component == '.')
+			|| (length == 2 && component[0] == '.' && component[1] == '.')) {
+			return EINVAL;
+		}
+
+		component = *end == '/' ? end + 1 : NULL;
+	} while (component != NULL);
+
+	if (slash != NULL) {
+		const size_t length = slash - path;
+		char parent[length + 1];
+
+		memcpy(parent, path, length);
+		parent[length] = '\0';
+
+		if (tfind(parent, &pack->directories, hny_pack_compare_paths) == NULL) {
+			return EINVAL;
+		}
+	}
+
+	if (S_ISDIR(st->st_mode)) {
+		char * const directory = strdup(path);
+		const char * const *node;
+
+		if (directory == NULL) {
+			return errno;
+		}
+
+		node = tsearch(directory, &pack->directories, hny_pack_compare_paths);
+		if (node == NULL || *node != directory) {
+			free(directory);
+			return node == NULL ? ENOMEM : EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int
+hny_pack_entries(struct hny_pack *pack, int dirfd, const char * const *entries, size_t count) {
+
+	for (size_t i = 0; i < count; i++) {
+		const char * const path = entries[i];
+		struct stat st;
+		int errcode;
+
+		if (fstatat(dirfd, path, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			return errno;
+		}
+
+		errcode = hny_pack_check(pack, path, &st);
+		if (errcode != 0) {
+			return errcode;
+		}
+
+		errcode = hny_pack_add(pack, dirfd, path, path, &st);
+		if (errcode != 0) {
+			return errcode;
+		}
+	}
+
+	return 0;
+}
+
+static int
+hny_pack_archive(struct hny_pack *pack, int dirfd, int flags) {
+	char trailer[CPIO_ENCODER_HEADER_SIZE];
+	uint8_t *end;
+	int errcode;
+
+	if (flags & HNY_PACK_FLAGS_TOC) {
+		errcode = hny_pack_toc(pack);
+		if (errcode != 0) {
+			return errcode;
+		}
+	}
+
+	for (size_t i = 0; i < pack->entries.count; i++) {
+		errcode = hny_pack_write_entry(pack, dirfd, pack->entries.array + i);
+		if (errcode != 0) {
+			return errcode;
+		}
+	}
+
+	cpio_encoder_trailer_header(trailer);
+
+	errcode = hny_pack_append(pack, trailer, sizeof (trailer));
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	errcode = hny_pack_append(pack, CPIO_ENCODER_TRAILER, sizeof (CPIO_ENCODER_TRAILER));
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	if (hny_pack_current(pack)->size != 0) {
+		pack->filled++;
+	}
+
+	errcode = hny_pack_submit(pack);
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	errcode = hny_pack_collect(pack);
+	if (errcode != 0) {
+		return errcode;
+	}
+
+	end = malloc(XZ_ENCODER_END_BOUND(pack->index.count));
+	if (end == NULL) {
+		return errno;
+	}
+
+	errcode = util_write_all(pack->fd, end, xz_encoder_end(pack->index.records, pack->index.count, end));
+
+	free(end);
+
+	return errcode;
+}
+
+int
+hny_pack(int dirfd, const char * const *entries, size_t count, int fd, unsigned int jobs, int flags) {
+	struct hny_pack pack = { .fd = fd };
+	uint8_t header[XZ_ENCODER_STREAM_HEADER_SIZE];
+	unsigned int initialized = 0;
+	int errcode;
+
+	/* Every entry is listed first, so invalid ones are reported before anything is compressed */
+	if (entries == NULL) {
+		struct hny_pack_path path = { 0 };
+		const int rootfd = dup(dirfd);
+
+		if (rootfd < 0) {
+			return errno;
+		}
+
+		errcode = hny_pack_directory(&pack, rootfd, &path);
+		free(path.buffer);
+	} else {
+		errcode = hny_pack_entries(&pack, dirfd, entries, count);
+		tdestroy(pack.directories, free);
+	}
+
+	if (errcode != 0) {
+		goto hny_pack_err0;
+	}
+
+	if (jobs == 0) {
+		const long online = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = online > 0 ? online : 1;
+	}
+	pack.jobs = jobs;
+
+	pack.encoders = calloc(jobs, sizeof (*pack.encoders));
+	pack.blocks = calloc(jobs * 2, sizeof (*pack.blocks));
+	if (pack.encoders == NULL || pack.blocks == NULL) {
+		errcode = errno;
+		goto hny_pack_err0;
+	}
+
+	for (unsigned int i = 0; i < jobs * 2; i++) {
+		pack.blocks[i].input = malloc(CONFIG_HNY_PACK_BLOCK_SIZE);
+		pack.blocks[i].output = malloc(XZ_ENCODER_BLOCK_BOUND(CONFIG_HNY_PACK_BLOCK_SIZE));
+		if (pack.blocks[i].input == NULL || pack.blocks[i].output == NULL) {
+			errcode = errno;
+			goto hny_pack_err0;
+		}
+	}
+
+	for (; initialized < jobs; initialized++) {
+		if (lzma2_encoder_init(pack.encoders + initialized, CONFIG_HNY_PACK_BLOCK_SIZE) != 0) {
+			errcode = errno;
+			goto hny_pack_err0;
+		}
+	}
+
+	errcode = worker_pool_create(&pack.pool, jobs, jobs);
+	if (errcode != 0) {
+		goto hny_pack_err0;
+	}
+
+	errcode = util_write_all(fd, header, xz_encoder_stream_header(header));
+	if (errcode == 0) {
+		errcode = hny_pack_archive(&pack, dirfd, flags);
+	}
+
+	/* Blocks may still be compressed on failure, they must not be freed under the workers */
+	worker_pool_wait(pack.pool);
+	worker_pool_destroy(pack.pool);
+hny_pack_err0:
+	while (initialized != 0) {
+		lzma2_encoder_deinit(pack.encoders + --initialized);
+	}
+
+	if (pack.blocks != NULL) {
+		for (unsigned int i = 0; i < jobs * 2; i++) {
+			free(pack.blocks[i].input);
+			free(pack.blocks[i].output);
+		}
+	}
+
+	for (size_t i = 0; i < pack.entries.count; i++) {
+		free(pack.entries.array[i].path);
+		free(pack.entries.array[i].target);
+	}
+
+	free(pack.entries.array);
+	free(pack.index.records);
+	free(pack.blocks);
+	free(pack.encoders);
+
+	return errcode;
+}
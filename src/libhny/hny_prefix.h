@@ -12,5 +12,9 @@ struct hny {
 	int flags;
 };
 
+/* Recreates srcfd's hierarchy into the existing directory dstfd, only HNY_EXTRACTION_FLAGS_LINK is honored */
+int
+hny_clone_content(int srcfd, int dstfd, int flags);
+
 /* HNY_PREFIX_H */
 #endif
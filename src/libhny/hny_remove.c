@@ -3,11 +3,14 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
 
+#include "manifest.h"
 #include "config.h"
 
 struct hny_dir {
@@ -21,6 +24,13 @@ struct hny_dirstack {
 	int top;              /**< Current stack top */
 };
 
+struct hny_links {
+	ino_t *inodes;   /**< Regular files unlinked while still linked elsewhere, sorted before lookups */
+	size_t count;    /**< Number of elements in inodes */
+	size_t capacity; /**< Capacity of inodes */
+	bool all;        /**< Whether some couldn't be recorded, every object must be examined */
+};
+
 static int
 hny_dirstack_push(struct hny_dirstack *stack, int dirfd, const char *path) {
 	const int newtop = stack->top + 1, fd = openat(dirfd, path, O_RDONLY);
@@ -69,8 +79,79 @@ hny_is_dot_or_dot_dot(const char *name) {
 	return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
 }
 
+static void
+hny_links_record(struct hny_links *links, int dirfd, const char *name) {
+	struct stat st;
+
+	/* Only a file linked elsewhere may be an object, which its removal can leave unused */
+	if (links->all || fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode) || st.st_nlink < 2) {
+		return;
+	}
+
+	if (links->count == links->capacity) {
+		const size_t newcapacity = links->capacity == 0 ? 16 : links->capacity * 2;
+		ino_t * const newinodes = realloc(links->inodes, newcapacity * sizeof (*newinodes));
+
+		if (newinodes == NULL) {
+			links->all = true;
+			return;
+		}
+
+		links->inodes = newinodes;
+		links->capacity = newcapacity;
+	}
+
+	links->inodes[links->count] = st.st_ino;
+	links->count++;
+}
+
+static int
+hny_links_compare(const void *lhs, const void *rhs) {
+	const ino_t left = *(const ino_t *)lhs, right = *(const ino_t *)rhs;
+
+	return left < right ? -1 : left > right;
+}
+
+/* Whether an object may have been linked by a removed file, an unused object is collected either way,
+ * so inodes of another filesystem matching by chance only cost a stat */
+static bool
+hny_links_may_use(const struct hny_links *links, ino_t ino) {
+	return links->all || bsearch(&ino, links->inodes, links->count, sizeof (*links->inodes), hny_links_compare) != NULL;
+}
+
+static void
+hny_remove_manifest(struct hny *hny, const char *package, struct hny_links *links) {
+	const int fd = openat(dirfd(hny->dirp), package, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	struct manifest_map map;
+
+	if (fd < 0) {
+		return;
+	}
+
+	if (manifest_map(&map, fd, HNY_MANIFEST_FILE) == 0) {
+		/* Sorted paths put directories before their content, unlinking in reverse order empties them first.
+		 * Failures are ignored, whatever remains is left to the directory walk. */
+		for (size_t i = map.count; i != 0; i--) {
+			const struct manifest_record * const record = map.records + i - 1;
+			const char * const path = map.strings + record->path;
+
+			if (*path != '/' && strstr(path, "..") == NULL) {
+				if (S_ISREG(record->mode)) {
+					hny_links_record(links, fd, path);
+				}
+				unlinkat(fd, path, S_ISDIR(record->mode) ? AT_REMOVEDIR : 0);
+			}
+		}
+
+		manifest_unmap(&map);
+		unlinkat(fd, HNY_MANIFEST_FILE, 0);
+	}
+
+	close(fd);
+}
+
 static int
-hny_remove_package(struct hny *hny, const char *package) {
+hny_remove_package(struct hny *hny, const char *package, struct hny_links *links) {
 	struct hny_dirstack stack;
 	int errcode;
 
@@ -94,6 +175,9 @@ hny_remove_package(struct hny *hny, const char *package) {
 
 				if (entry->d_type != DT_DIR) {
 					/* If the entry is not a directory, unlink it */
+					if (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) {
+						hny_links_record(links, dirfd(dirp), entry->d_name);
+					}
 					if (unlinkat(dirfd(dirp), entry->d_name, 0) != 0) {
 						errcode = errno;
 						break;
@@ -137,14 +221,71 @@ hny_remove_package(struct hny *hny, const char *package) {
 	return errcode;
 }
 
+static int
+hny_remove_objects(struct hny *hny, struct hny_links *links) {
+	struct dirent *entry;
+	int fd, errcode = 0;
+	DIR *dirp;
+
+	/* Nothing removed was shared, so no object lost a user */
+	if (!links->all && links->count == 0) {
+		return 0;
+	}
+
+	fd = openat(dirfd(hny->dirp), HNY_OBJECTS_DIRECTORY, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	if (fd < 0) {
+		/* No objects store, nothing to collect */
+		return errno == ENOENT ? 0 : errno;
+	}
+
+	dirp = fdopendir(fd);
+	if (dirp == NULL) {
+		errcode = errno;
+		close(fd);
+		return errcode;
+	}
+
+	if (!links->all) {
+		qsort(links->inodes, links->count, sizeof (*links->inodes), hny_links_compare);
+	}
+
+	/* Object names can't be derived from removed files, but their inodes are listed along names */
+	while (errno = 0, entry = readdir(dirp)) {
+		struct stat st;
+
+		/* The link count is the reference count, an object only linked by the store is unused */
+		if (entry->d_type != DT_DIR && hny_links_may_use(links, entry->d_ino)
+			&& fstatat(dirfd(dirp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+			&& st.st_nlink == 1 && unlinkat(dirfd(dirp), entry->d_name, 0) != 0) {
+			errcode = errno;
+			break;
+		}
+	}
+
+	if (errcode == 0 && errno != 0) {
+		errcode = errno;
+	}
+
+	closedir(dirp);
+
+	return errcode;
+}
+
 int
 hny_remove(struct hny *hny, const char *entry) {
 	int errcode = 0;
 
 	switch (hny_type_of(entry)) {
-	case HNY_TYPE_PACKAGE:
-		errcode = hny_remove_package(hny, entry);
-		break;
+	case HNY_TYPE_PACKAGE: {
+		struct hny_links links = { .inodes = NULL };
+
+		hny_remove_manifest(hny, entry, &links);
+		errcode = hny_remove_package(hny, entry, &links);
+		if (errcode == 0) {
+			errcode = hny_remove_objects(hny, &links);
+		}
+		free(links.inodes);
+	}	break;
 	case HNY_TYPE_GEIST:
 		if (unlinkat(dirfd(hny->dirp), entry, 0) != 0) {
 			errcode = errno;
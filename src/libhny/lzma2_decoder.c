@@ -631,9 +631,19 @@ lzma2_decoder_init(struct lzma2_decoder *decoder, enum lzma2_decoder_mode mode,
 	return 0;
 }
 
+void
+lzma2_decoder_init_static(struct lzma2_decoder *decoder, uint8_t *dictionary, uint32_t dictionarymax) {
+	decoder->dictionary.mode = LZMA2_DECODER_MODE_STATIC;
+	decoder->dictionary.sizelimit = dictionarymax;
+	decoder->dictionary.buffer = dictionary;
+	decoder->dictionary.allocated = dictionarymax;
+}
+
 void
 lzma2_decoder_deinit(struct lzma2_decoder *decoder) {
-	free(decoder->dictionary.buffer);
+	if (decoder->dictionary.mode != LZMA2_DECODER_MODE_STATIC) {
+		free(decoder->dictionary.buffer);
+	}
 }
 
 int
@@ -643,12 +653,7 @@ lzma2_decoder_reset(struct lzma2_decoder *decoder, uint8_t props) {
 		return LZMA2_DECODER_STATUS_ERROR_INVALID_DICTIONARY_BITS;
 	}
 
-	if (props == 40) {
-		decoder->dictionary.size = UINT32_MAX;
-	} else {
-		decoder->dictionary.size = 2 + (props & 1);
-		decoder->dictionary.size <<= (props >> 1) + 11;
-	}
+	decoder->dictionary.size = lzma2_dictionary_size(props);
 
 	if (decoder->dictionary.size > decoder->dictionary.sizelimit) {
 		return LZMA2_DECODER_STATUS_ERROR_MEMORY_LIMIT;
@@ -668,6 +673,7 @@ lzma2_decoder_reset(struct lzma2_decoder *decoder, uint8_t props) {
 			}
 
 			decoder->dictionary.buffer = newbuffer;
+			decoder->dictionary.allocated = decoder->dictionary.size;
 		}
 	}
 
@@ -681,6 +687,16 @@ lzma2_decoder_reset(struct lzma2_decoder *decoder, uint8_t props) {
 	return LZMA2_DECODER_STATUS_OK;
 }
 
+uint32_t
+lzma2_dictionary_size(uint8_t props) {
+
+	if (props >= 40) {
+		return props == 40 ? UINT32_MAX : 0;
+	}
+
+	return (uint32_t)(2 + (props & 1)) << ((props >> 1) + 11);
+}
+
 enum lzma2_decoder_status
 lzma2_decoder_decode(struct lzma2_decoder *decoder, struct lzma2_stream *stream) {
 	uint32_t byte;
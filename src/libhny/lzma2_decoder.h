@@ -16,7 +16,8 @@ enum lzma2_decoder_status {
 
 enum lzma2_decoder_mode {
 	LZMA2_DECODER_MODE_PREALLOC,
-	LZMA2_DECODER_MODE_DYNAMIC
+	LZMA2_DECODER_MODE_DYNAMIC,
+	LZMA2_DECODER_MODE_STATIC /**< Dictionary provided by the caller, never reallocated nor freed. */
 };
 
 struct lzma2_stream {
@@ -179,12 +180,18 @@ int
 lzma2_decoder_init(struct lzma2_decoder *decoder,
 	enum lzma2_decoder_mode mode, uint32_t dictionarymax);
 
+void
+lzma2_decoder_init_static(struct lzma2_decoder *decoder, uint8_t *dictionary, uint32_t dictionarymax);
+
 void
 lzma2_decoder_deinit(struct lzma2_decoder *decoder);
 
 int
 lzma2_decoder_reset(struct lzma2_decoder *decoder, uint8_t properties);
 
+uint32_t
+lzma2_dictionary_size(uint8_t properties);
+
 enum lzma2_decoder_status
 lzma2_decoder_decode(struct lzma2_decoder *decoder, struct lzma2_stream *stream);
 
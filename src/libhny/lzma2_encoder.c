@@ -0,0 +1,582 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+	Mirrors the model of lzma2_decoder.c, itself derivated from
+	an original work of Lasse Collin and Igor Pavlov put into public domain.
+*/
+#include "lzma2_encoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RANGE_ENCODER_SHIFT_BITS 8
+#define RANGE_ENCODER_TOP_BITS 24
+#define RANGE_ENCODER_TOP_VALUE (1 << RANGE_ENCODER_TOP_BITS)
+#define RANGE_ENCODER_BIT_MODEL_TOTAL_BITS 11
+#define RANGE_ENCODER_BIT_MODEL_TOTAL (1 << RANGE_ENCODER_BIT_MODEL_TOTAL_BITS)
+#define RANGE_ENCODER_MOVE_BITS 5
+
+#define RANGE_ENCODER_FLUSH_BYTES 5
+
+#define LZMA2_CHUNK_UNCOMPRESSED_MAX (1 << 21)
+#define LZMA2_CHUNK_COMPRESSED_MAX (1 << 16)
+#define LZMA2_CHUNK_COPY_MAX (1 << 16)
+
+/* Upper bound of the bytes a single symbol and the final flush add to a chunk */
+#define LZMA2_SYMBOL_MARGIN 64
+
+/* lc=3, lp=0, pb=2 */
+#define LZMA_LC 3
+#define LZMA_PB 2
+#define LZMA_PROPERTIES (LZMA_PB * 5 * 9 + LZMA_LC)
+
+#define MATCHFINDER_HASH_BITS 20
+#define MATCHFINDER_HASH_SIZE (1 << MATCHFINDER_HASH_BITS)
+#define MATCHFINDER_DEPTH 32
+#define MATCHFINDER_NICE_LEN 64
+#define MATCHFINDER_MIN_LEN 3
+
+/* Shortest matches further than this cost more than their literals */
+#define MATCHFINDER_SHORT_DIST_MAX (1 << 14)
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+static inline void
+lzma_state_literal(enum lzma_state *state) {
+	if (*state <= LZMA_STATE_SHORTREP_LIT_LIT) {
+		*state = LZMA_STATE_LIT_LIT;
+	} else if (*state <= LZMA_STATE_LIT_SHORTREP) {
+		*state -= 3;
+	} else {
+		*state -= 6;
+	}
+}
+
+static inline void
+lzma_state_match(enum lzma_state *state) {
+	*state = *state < LIT_STATES ? LZMA_STATE_LIT_MATCH : LZMA_STATE_NONLIT_MATCH;
+}
+
+static inline void
+lzma_state_long_rep(enum lzma_state *state) {
+	*state = *state < LIT_STATES ? LZMA_STATE_LIT_LONGREP : LZMA_STATE_NONLIT_REP;
+}
+
+static inline void
+lzma_state_short_rep(enum lzma_state *state) {
+	*state = *state < LIT_STATES ? LZMA_STATE_LIT_SHORTREP : LZMA_STATE_NONLIT_REP;
+}
+
+static inline bool
+lzma_state_is_literal(enum lzma_state state) {
+	return state < LIT_STATES;
+}
+
+static inline uint32_t
+lzma_get_dist_state(uint32_t length) {
+	return length < DIST_STATES + MATCH_LEN_MIN ? length - MATCH_LEN_MIN : DIST_STATES - 1;
+}
+
+/*****************
+ * Range encoder *
+ *****************/
+
+static void
+range_encoder_reset(struct range_encoder *rangeencoder, uint8_t *buffer) {
+	rangeencoder->low = 0;
+	rangeencoder->cachesize = 1;
+	rangeencoder->range = (uint32_t)-1;
+	rangeencoder->cache = 0;
+	rangeencoder->buffer = buffer;
+	rangeencoder->position = 0;
+}
+
+static void
+range_encoder_shift_low(struct range_encoder *rangeencoder) {
+
+	if ((uint32_t)rangeencoder->low < 0xFF000000 || (rangeencoder->low >> 32) != 0) {
+		const uint8_t carry = rangeencoder->low >> 32;
+		uint8_t byte = rangeencoder->cache;
+
+		/* Pending 0xFF bytes are only known once a carry did or can't happen */
+		do {
+			rangeencoder->buffer[rangeencoder->position++] = byte + carry;
+			byte = 0xFF;
+		} while (--rangeencoder->cachesize != 0);
+
+		rangeencoder->cache = rangeencoder->low >> 24;
+	}
+
+	rangeencoder->cachesize++;
+	rangeencoder->low = (rangeencoder->low & 0x00FFFFFF) << RANGE_ENCODER_SHIFT_BITS;
+}
+
+static inline void
+range_encoder_normalize(struct range_encoder *rangeencoder) {
+	if (rangeencoder->range < RANGE_ENCODER_TOP_VALUE) {
+		rangeencoder->range <<= RANGE_ENCODER_SHIFT_BITS;
+		range_encoder_shift_low(rangeencoder);
+	}
+}
+
+static inline void
+range_encoder_bit(struct range_encoder *rangeencoder, uint16_t *prob, uint32_t bit) {
+	const uint32_t bound = (rangeencoder->range >> RANGE_ENCODER_BIT_MODEL_TOTAL_BITS) * *prob;
+
+	if (bit == 0) {
+		rangeencoder->range = bound;
+		*prob += (RANGE_ENCODER_BIT_MODEL_TOTAL - *prob) >> RANGE_ENCODER_MOVE_BITS;
+	} else {
+		rangeencoder->low += bound;
+		rangeencoder->range -= bound;
+		*prob -= *prob >> RANGE_ENCODER_MOVE_BITS;
+	}
+
+	range_encoder_normalize(rangeencoder);
+}
+
+static inline void
+range_encoder_bittree(struct range_encoder *rangeencoder, uint16_t *probs, uint32_t bits, uint32_t symbol) {
+	uint32_t model = 1;
+
+	while (bits-- > 0) {
+		const uint32_t bit = (symbol >> bits) & 1;
+
+		range_encoder_bit(rangeencoder, probs + model, bit);
+		model = (model << 1) + bit;
+	}
+}
+
+static inline void
+range_encoder_bittree_reverse(struct range_encoder *rangeencoder, uint16_t *probs, uint32_t bits, uint32_t symbol) {
+	uint32_t model = 1;
+
+	while (bits-- > 0) {
+		const uint32_t bit = symbol & 1;
+
+		range_encoder_bit(rangeencoder, probs + model, bit);
+		model = (model << 1) + bit;
+		symbol >>= 1;
+	}
+}
+
+static inline void
+range_encoder_direct(struct range_encoder *rangeencoder, uint32_t value, uint32_t bits) {
+
+	while (bits-- > 0) {
+		rangeencoder->range >>= 1;
+		rangeencoder->low += rangeencoder->range & (0 - ((value >> bits) & 1));
+		range_encoder_normalize(rangeencoder);
+	}
+}
+
+static void
+range_encoder_flush(struct range_encoder *rangeencoder) {
+	for (unsigned int i = 0; i < RANGE_ENCODER_FLUSH_BYTES; i++) {
+		range_encoder_shift_low(rangeencoder);
+	}
+}
+
+/****************
+ * Match finder *
+ ****************/
+
+static inline uint32_t
+matchfinder_hash(const uint8_t *bytes) {
+	const uint32_t value = (uint32_t)bytes[0] << 16 | (uint32_t)bytes[1] << 8 | bytes[2];
+
+	return (value * 2654435761u) >> (32 - MATCHFINDER_HASH_BITS);
+}
+
+static inline uint32_t
+matchfinder_common(const uint8_t *bytes, const uint8_t *previous, uint32_t max) {
+	uint32_t length = 0;
+
+	while (length < max && bytes[length] == previous[length]) {
+		length++;
+	}
+
+	return length;
+}
+
+static inline void
+matchfinder_insert(struct lzma2_encoder *encoder, const uint8_t *input, size_t size, size_t position) {
+
+	if (position + MATCHFINDER_MIN_LEN <= size) {
+		const uint32_t hash = matchfinder_hash(input + position);
+
+		encoder->matchfinder.chain[position] = encoder->matchfinder.head[hash];
+		encoder->matchfinder.head[hash] = position + 1;
+	}
+}
+
+/* Longest match among the most recent positions sharing the hash, not inserting position */
+static uint32_t
+matchfinder_find(const struct lzma2_encoder *encoder, const uint8_t *input, size_t size, size_t position, uint32_t *distp) {
+	const uint32_t max = MIN(size - position, MATCH_LEN_MAX);
+	uint32_t best = 0;
+
+	if (max < MATCHFINDER_MIN_LEN) {
+		return 0;
+	}
+
+	uint32_t candidate = encoder->matchfinder.head[matchfinder_hash(input + position)];
+	for (unsigned int depth = MATCHFINDER_DEPTH; candidate != 0 && depth != 0; depth--) {
+		const size_t previous = candidate - 1;
+
+		if (input[previous + best] == input[position + best]) {
+			const uint32_t length = matchfinder_common(input + position, input + previous, max);
+
+			if (length > best) {
+				best = length;
+				*distp = position - previous - 1;
+				if (length >= MATCHFINDER_NICE_LEN || length == max) {
+					break;
+				}
+			}
+		}
+
+		candidate = encoder->matchfinder.chain[previous];
+	}
+
+	return best >= MATCHFINDER_MIN_LEN ? best : 0;
+}
+
+/********
+ * LZMA *
+ ********/
+
+static void
+lzma_reset(struct lzma *lzma) {
+	uint16_t * const probs = *lzma->ismatch;
+
+	lzma->state = LZMA_STATE_LIT_LIT;
+	lzma->rep0 = 0;
+	lzma->rep1 = 0;
+	lzma->rep2 = 0;
+	lzma->rep3 = 0;
+
+	for (unsigned int i = 0; i < PROBS_TOTAL; i++) {
+		probs[i] = RANGE_ENCODER_BIT_MODEL_TOTAL / 2;
+	}
+}
+
+static void
+lzma_length_encode(struct range_encoder *rangeencoder, struct length_decoder *l, uint32_t length, uint32_t posstate) {
+
+	length -= MATCH_LEN_MIN;
+
+	if (length < LEN_LOW_SYMBOLS) {
+		range_encoder_bit(rangeencoder, &l->choice, 0);
+		range_encoder_bittree(rangeencoder, l->low[posstate], LEN_LOW_BITS, length);
+	} else {
+		range_encoder_bit(rangeencoder, &l->choice, 1);
+		length -= LEN_LOW_SYMBOLS;
+
+		if (length < LEN_MID_SYMBOLS) {
+			range_encoder_bit(rangeencoder, &l->choice2, 0);
+			range_encoder_bittree(rangeencoder, l->mid[posstate], LEN_MID_BITS, length);
+		} else {
+			range_encoder_bit(rangeencoder, &l->choice2, 1);
+			range_encoder_bittree(rangeencoder, l->high, LEN_HIGH_BITS, length - LEN_MID_SYMBOLS);
+		}
+	}
+}
+
+static void
+lzma_literal(struct lzma2_encoder *encoder, const uint8_t *input, size_t position) {
+	struct lzma * const lzma = &encoder->lzma;
+	const uint32_t previousbyte = position != 0 ? input[position - 1] : 0;
+	uint16_t * const probs = lzma->literal[previousbyte >> (8 - lzma->lc)];
+	const uint32_t byte = input[position];
+
+	range_encoder_bit(&encoder->rangeencoder, lzma->ismatch[lzma->state] + (position & lzma->pos_mask), 0);
+
+	if (lzma_state_is_literal(lzma->state)) {
+		range_encoder_bittree(&encoder->rangeencoder, probs, 8, byte);
+	} else {
+		uint32_t matchbyte = input[position - lzma->rep0 - 1];
+		uint32_t offset = 0x100;
+		uint32_t symbol = 1;
+
+		/* Bits are modeled after the byte at rep0 as long as they match it */
+		for (int i = 7; i >= 0; i--) {
+			const uint32_t bit = (byte >> i) & 1;
+			uint32_t matchbit;
+
+			matchbyte <<= 1;
+			matchbit = matchbyte & offset;
+			range_encoder_bit(&encoder->rangeencoder, probs + offset + matchbit + symbol, bit);
+			symbol = (symbol << 1) + bit;
+			offset &= bit != 0 ? matchbit : ~matchbit;
+		}
+	}
+
+	lzma_state_literal(&lzma->state);
+}
+
+static void
+lzma_match(struct lzma2_encoder *encoder, size_t position, uint32_t dist, uint32_t length) {
+	struct lzma * const lzma = &encoder->lzma;
+	const uint32_t posstate = position & lzma->pos_mask;
+	uint32_t distslot;
+
+	range_encoder_bit(&encoder->rangeencoder, lzma->ismatch[lzma->state] + posstate, 1);
+	range_encoder_bit(&encoder->rangeencoder, lzma->isrep + lzma->state, 0);
+
+	lzma_length_encode(&encoder->rangeencoder, &lzma->matchlength, length, posstate);
+
+	if (dist < DIST_MODEL_START) {
+		distslot = dist;
+	} else {
+		const uint32_t bits = 31 - __builtin_clz(dist);
+
+		distslot = (bits << 1) + ((dist >> (bits - 1)) & 1);
+	}
+
+	range_encoder_bittree(&encoder->rangeencoder, lzma->distslot[lzma_get_dist_state(length)], DIST_SLOT_BITS, distslot);
+
+	if (distslot >= DIST_MODEL_START) {
+		const uint32_t limit = (distslot >> 1) - 1;
+		const uint32_t base = (2 + (distslot & 1)) << limit;
+		const uint32_t reduced = dist - base;
+
+		if (distslot < DIST_MODEL_END) {
+			range_encoder_bittree_reverse(&encoder->rangeencoder, lzma->distspecial + base - distslot - 1, limit, reduced);
+		} else {
+			range_encoder_direct(&encoder->rangeencoder, reduced >> ALIGN_BITS, limit - ALIGN_BITS);
+			range_encoder_bittree_reverse(&encoder->rangeencoder, lzma->distalign, ALIGN_BITS, reduced & ALIGN_MASK);
+		}
+	}
+
+	lzma->rep3 = lzma->rep2;
+	lzma->rep2 = lzma->rep1;
+	lzma->rep1 = lzma->rep0;
+	lzma->rep0 = dist;
+
+	lzma_state_match(&lzma->state);
+}
+
+static void
+lzma_rep_match(struct lzma2_encoder *encoder, size_t position, unsigned int rep, uint32_t length) {
+	struct lzma * const lzma = &encoder->lzma;
+	const uint32_t posstate = position & lzma->pos_mask;
+
+	range_encoder_bit(&encoder->rangeencoder, lzma->ismatch[lzma->state] + posstate, 1);
+	range_encoder_bit(&encoder->rangeencoder, lzma->isrep + lzma->state, 1);
+
+	if (rep == 0) {
+		range_encoder_bit(&encoder->rangeencoder, lzma->isrep0 + lzma->state, 0);
+		range_encoder_bit(&encoder->rangeencoder, lzma->isrep0long[lzma->state] + posstate, length != 1);
+
+		if (length == 1) {
+			lzma_state_short_rep(&lzma->state);
+			return;
+		}
+	} else {
+		uint32_t dist;
+
+		range_encoder_bit(&encoder->rangeencoder, lzma->isrep0 + lzma->state, 1);
+
+		if (rep == 1) {
+			range_encoder_bit(&encoder->rangeencoder, lzma->isrep1 + lzma->state, 0);
+			dist = lzma->rep1;
+		} else {
+			range_encoder_bit(&encoder->rangeencoder, lzma->isrep1 + lzma->state, 1);
+
+			if (rep == 2) {
+				range_encoder_bit(&encoder->rangeencoder, lzma->isrep2 + lzma->state, 0);
+				dist = lzma->rep2;
+			} else {
+				range_encoder_bit(&encoder->rangeencoder, lzma->isrep2 + lzma->state, 1);
+				dist = lzma->rep3;
+				lzma->rep3 = lzma->rep2;
+			}
+
+			lzma->rep2 = lzma->rep1;
+		}
+
+		lzma->rep1 = lzma->rep0;
+		lzma->rep0 = dist;
+	}
+
+	lzma_length_encode(&encoder->rangeencoder, &lzma->repeatedmatchlength, length, posstate);
+	lzma_state_long_rep(&lzma->state);
+}
+
+/* Greedy parsing with one step of lazy evaluation, returns the number of bytes encoded */
+static uint32_t
+lzma_symbol(struct lzma2_encoder *encoder, const uint8_t *input, size_t size, size_t position) {
+	struct lzma * const lzma = &encoder->lzma;
+	const uint32_t max = MIN(size - position, MATCH_LEN_MAX);
+	const uint32_t reps[REPS] = { lzma->rep0, lzma->rep1, lzma->rep2, lzma->rep3 };
+	uint32_t replength = 0, length = 0, dist = 0;
+	unsigned int rep = 0;
+
+	if (max >= MATCH_LEN_MIN) {
+		for (unsigned int i = 0; i < REPS; i++) {
+			if (reps[i] < position) {
+				const uint32_t current = matchfinder_common(input + position, input + position - reps[i] - 1, max);
+
+				if (current > replength) {
+					replength = current;
+					rep = i;
+				}
+			}
+		}
+
+		if (replength < MATCHFINDER_NICE_LEN) {
+			length = matchfinder_find(encoder, input, size, position, &dist);
+			if (length == MATCHFINDER_MIN_LEN && dist >= MATCHFINDER_SHORT_DIST_MAX) {
+				length = 0;
+			}
+		}
+	}
+
+	if (replength >= MATCH_LEN_MIN && replength + 1 >= length) {
+		/* Repeated distances are cheaper than slightly longer new ones */
+		length = replength;
+		lzma_rep_match(encoder, position, rep, length);
+	} else if (length != 0 && (length >= MATCHFINDER_NICE_LEN || position + 1 == size
+		|| matchfinder_find(encoder, input, size, position + 1, &(uint32_t){ 0 }) <= length + 1)) {
+		lzma_match(encoder, position, dist, length);
+	} else {
+		length = 1;
+		if (lzma->rep0 < position && input[position] == input[position - lzma->rep0 - 1]) {
+			lzma_rep_match(encoder, position, 0, length);
+		} else {
+			lzma_literal(encoder, input, position);
+		}
+	}
+
+	for (uint32_t i = 0; i < length; i++) {
+		matchfinder_insert(encoder, input, size, position + i);
+	}
+
+	return length;
+}
+
+/*********
+ * LZMA2 *
+ *********/
+
+int
+lzma2_encoder_init(struct lzma2_encoder *encoder, size_t capacity) {
+
+	encoder->matchfinder.head = malloc(MATCHFINDER_HASH_SIZE * sizeof (*encoder->matchfinder.head));
+	encoder->matchfinder.chain = malloc(capacity * sizeof (*encoder->matchfinder.chain));
+	encoder->matchfinder.capacity = capacity;
+	encoder->chunk = malloc(LZMA2_CHUNK_COMPRESSED_MAX + LZMA2_SYMBOL_MARGIN);
+
+	if (encoder->matchfinder.head == NULL || encoder->matchfinder.chain == NULL || encoder->chunk == NULL) {
+		lzma2_encoder_deinit(encoder);
+		return -1;
+	}
+
+	encoder->lzma.lc = LZMA_LC;
+	encoder->lzma.literal_pos_mask = 0;
+	encoder->lzma.pos_mask = (1 << LZMA_PB) - 1;
+
+	return 0;
+}
+
+void
+lzma2_encoder_deinit(struct lzma2_encoder *encoder) {
+	free(encoder->matchfinder.head);
+	free(encoder->matchfinder.chain);
+	free(encoder->chunk);
+}
+
+size_t
+lzma2_encoder_encode(struct lzma2_encoder *encoder, const uint8_t *input, size_t size, uint8_t *output) {
+	struct range_encoder * const rangeencoder = &encoder->rangeencoder;
+	size_t position = 0, written = 0;
+
+	/* Every call encodes an independent stream, starting with a dictionary reset */
+	memset(encoder->matchfinder.head, 0, MATCHFINDER_HASH_SIZE * sizeof (*encoder->matchfinder.head));
+	encoder->needed.dictionaryreset = true;
+	encoder->needed.properties = true;
+	encoder->needed.statereset = true;
+	lzma_reset(&encoder->lzma);
+
+	while (position < size) {
+		const size_t start = position;
+
+		range_encoder_reset(rangeencoder, encoder->chunk);
+
+		while (position < size && position - start <= LZMA2_CHUNK_UNCOMPRESSED_MAX - MATCH_LEN_MAX
+			&& rangeencoder->position + rangeencoder->cachesize + LZMA2_SYMBOL_MARGIN <= LZMA2_CHUNK_COMPRESSED_MAX) {
+			position += lzma_symbol(encoder, input, size, position);
+		}
+
+		range_encoder_flush(rangeencoder);
+
+		const size_t uncompressed = position - start, compressed = rangeencoder->position;
+		const bool properties = encoder->needed.dictionaryreset || encoder->needed.properties;
+
+		if (compressed + 5 + properties < uncompressed) {
+			uint8_t control = 0x80;
+
+			if (encoder->needed.dictionaryreset) {
+				control = 0xE0;
+			} else if (encoder->needed.properties) {
+				control = 0xC0;
+			} else if (encoder->needed.statereset) {
+				control = 0xA0;
+			}
+
+			output[written++] = control | (uncompressed - 1) >> 16;
+			output[written++] = (uncompressed - 1) >> 8;
+			output[written++] = uncompressed - 1;
+			output[written++] = (compressed - 1) >> 8;
+			output[written++] = compressed - 1;
+			if (properties) {
+				output[written++] = LZMA_PROPERTIES;
+			}
+
+			memcpy(output + written, encoder->chunk, compressed);
+			written += compressed;
+
+			encoder->needed.dictionaryreset = false;
+			encoder->needed.properties = false;
+			encoder->needed.statereset = false;
+		} else {
+			/* Stored as is, the decoder's model won't learn from it, so both restart from scratch */
+			for (size_t copied = start; copied < position;) {
+				const size_t length = MIN(position - copied, LZMA2_CHUNK_COPY_MAX);
+
+				if (encoder->needed.dictionaryreset) {
+					output[written++] = 0x01;
+					encoder->needed.dictionaryreset = false;
+					encoder->needed.properties = true;
+				} else {
+					output[written++] = 0x02;
+				}
+				output[written++] = (length - 1) >> 8;
+				output[written++] = length - 1;
+
+				memcpy(output + written, input + copied, length);
+				written += length;
+				copied += length;
+			}
+
+			encoder->needed.statereset = true;
+			lzma_reset(&encoder->lzma);
+		}
+	}
+
+	/* End marker */
+	output[written++] = 0x00;
+
+	return written;
+}
+
+uint8_t
+lzma2_encoder_dictionary_properties(uint32_t size) {
+	uint8_t properties = 0;
+
+	while (properties < 40 && lzma2_dictionary_size(properties) < size) {
+		properties++;
+	}
+
+	return properties;
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LZMA2_ENCODER_H
+#define LZMA2_ENCODER_H
+
+#include "lzma2_decoder.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Worst-case size of the LZMA2 encoding of size bytes: incompressible chunks are stored
+ * with 3 bytes headers, and a failed compression attempt always spans more than 4KiB but the last one */
+#define LZMA2_ENCODER_BOUND(size) ((size) + ((size) / 4096 + 2) * 3 + 1)
+
+struct range_encoder {
+	uint64_t low;
+	uint64_t cachesize; /**< Bytes pending a carry propagation, including cache. */
+	uint32_t range;
+	uint8_t cache;
+	uint8_t *buffer;
+	size_t position;
+};
+
+struct lzma2_encoder {
+	struct range_encoder rangeencoder;
+	uint8_t *chunk; /**< Compressed chunk being encoded, before it's known to be smaller than its content. */
+	struct lzma lzma; /**< Same model as the decoder, only pos_mask and lc are fixed. */
+	struct {
+		uint32_t *head; /**< Last position of each hash plus one, or 0. */
+		uint32_t *chain; /**< Previous position with the same hash plus one for each position, or 0. */
+		size_t capacity; /**< Maximum input size. */
+	} matchfinder;
+	struct {
+		bool dictionaryreset;
+		bool properties;
+		bool statereset;
+	} needed; /**< Resets the next chunk must announce. */
+};
+
+int
+lzma2_encoder_init(struct lzma2_encoder *encoder, size_t capacity);
+
+void
+lzma2_encoder_deinit(struct lzma2_encoder *encoder);
+
+size_t
+lzma2_encoder_encode(struct lzma2_encoder *encoder, const uint8_t *input, size_t size, uint8_t *output);
+
+uint8_t
+lzma2_encoder_dictionary_properties(uint32_t size);
+
+/* LZMA2_ENCODER_H */
+#endif
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "manifest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util.h"
+
+struct manifest_sorted {
+	const char *path;
+	const struct manifest_record *record;
+};
+
+void
+manifest_init(struct manifest *manifest) {
+	manifest->records = NULL;
+	manifest->count = 0;
+	manifest->capacity = 0;
+
+	manifest->strings = NULL;
+	manifest->size = 0;
+	manifest->stringscapacity = 0;
+}
+
+void
+manifest_deinit(struct manifest *manifest) {
+	free(manifest->records);
+	free(manifest->strings);
+}
+
+int
+manifest_append(struct manifest *manifest, const char *path, mode_t mode, off_t size, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+	const size_t length = strlen(path) + 1;
+
+	if (manifest->count == UINT32_MAX || manifest->size + length > UINT32_MAX) {
+		return EOVERFLOW;
+	}
+
+	if (manifest->count == manifest->capacity) {
+		const size_t newcapacity = manifest->capacity * 2 + 16;
+		struct manifest_record * const newrecords = realloc(manifest->records, sizeof (*newrecords) * newcapacity);
+
+		if (newrecords == NULL) {
+			return errno;
+		}
+
+		manifest->records = newrecords;
+		manifest->capacity = newcapacity;
+	}
+
+	if (manifest->stringscapacity - manifest->size < length) {
+		const size_t newcapacity = manifest->stringscapacity * 2 + length;
+		char * const newstrings = realloc(manifest->strings, newcapacity);
+
+		if (newstrings == NULL) {
+			return errno;
+		}
+
+		manifest->strings = newstrings;
+		manifest->stringscapacity = newcapacity;
+	}
+
+	struct manifest_record * const record = manifest->records + manifest->count;
+
+	record->size = size;
+	record->path = manifest->size;
+	record->mode = mode;
+	if (digest != NULL) {
+		memcpy(record->digest, digest, sizeof (record->digest));
+	} else {
+		memset(record->digest, 0, sizeof (record->digest));
+	}
+
+	memcpy(manifest->strings + manifest->size, path, length);
+	manifest->size += length;
+	manifest->count++;
+
+	return 0;
+}
+
+static int
+manifest_sorted_compare(const void *lhs, const void *rhs) {
+	return strcmp(((const struct manifest_sorted *)lhs)->path, ((const struct manifest_sorted *)rhs)->path);
+}
+
+int
+manifest_write(struct manifest *manifest, int dirfd, const char *name) {
+	const size_t recordsoffset = sizeof (struct manifest_header);
+	const size_t stringsoffset = recordsoffset + sizeof (struct manifest_record) * manifest->count;
+	const size_t length = stringsoffset + manifest->size;
+	struct manifest_sorted *sorted;
+	char *buffer;
+	int errcode;
+
+	sorted = malloc(sizeof (*sorted) * (manifest->count + 1));
+	if (sorted == NULL) {
+		errcode = errno;
+		goto manifest_write_err0;
+	}
+
+	buffer = malloc(length);
+	if (buffer == NULL) {
+		errcode = errno;
+		goto manifest_write_err1;
+	}
+
+	/* Paths are only resolved now, as appending may have moved the table */
+	for (size_t i = 0; i < manifest->count; i++) {
+		sorted[i].path = manifest->strings + manifest->records[i].path;
+		sorted[i].record = manifest->records + i;
+	}
+	qsort(sorted, manifest->count, sizeof (*sorted), manifest_sorted_compare);
+
+	struct manifest_header * const header = (struct manifest_header *)buffer;
+	memcpy(header->magic, MANIFEST_MAGIC, sizeof (header->magic));
+	header->count = manifest->count;
+	header->strings = manifest->size;
+
+	struct manifest_record * const records = (struct manifest_record *)(buffer + recordsoffset);
+	for (size_t i = 0; i < manifest->count; i++) {
+		records[i] = *sorted[i].record;
+	}
+
+	if (manifest->size != 0) {
+		memcpy(buffer + stringsoffset, manifest->strings, manifest->size);
+	}
+
+	const int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		errcode = errno;
+		goto manifest_write_err2;
+	}
+
+	errcode = util_write_all(fd, buffer, length);
+
+	if (close(fd) != 0 && errcode == 0) {
+		errcode = errno;
+	}
+
+	if (errcode != 0) {
+		unlinkat(dirfd, name, 0);
+	}
+
+manifest_write_err2:
+	free(buffer);
+manifest_write_err1:
+	free(sorted);
+manifest_write_err0:
+	return errcode;
+}
+
+int
+manifest_map(struct manifest_map *map, int dirfd, const char *name) {
+	const struct manifest_header *header;
+	struct stat st;
+	int errcode;
+
+	const int fd = openat(dirfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		errcode = errno;
+		goto manifest_map_err0;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		errcode = errno;
+		goto manifest_map_err1;
+	}
+
+	if (!S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof (*header)) {
+		errcode = EINVAL;
+		goto manifest_map_err1;
+	}
+
+	map->length = st.st_size;
+	map->address = mmap(NULL, map->length, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map->address == MAP_FAILED) {
+		errcode = errno;
+		goto manifest_map_err1;
+	}
+
+	header = map->address;
+	map->count = header->count;
+	map->records = (const struct manifest_record *)(header + 1);
+	map->strings = (const char *)(map->records + map->count);
+
+	/* Validate once, so lookups never read out of the mapping */
+	if (memcmp(header->magic, MANIFEST_MAGIC, sizeof (header->magic)) != 0
+		|| (map->length - sizeof (*header)) / sizeof (*map->records) < map->count
+		|| sizeof (*header) + sizeof (*map->records) * map->count + header->strings != map->length
+		|| (header->strings != 0 && map->strings[header->strings - 1] != '\0')) {
+		errcode = EINVAL;
+		goto manifest_map_err2;
+	}
+
+	for (size_t i = 0; i < map->count; i++) {
+		if (map->records[i].path >= header->strings) {
+			errcode = EINVAL;
+			goto manifest_map_err2;
+		}
+	}
+
+	close(fd);
+
+	return 0;
+manifest_map_err2:
+	munmap(map->address, map->length);
+manifest_map_err1:
+	close(fd);
+manifest_map_err0:
+	return errcode;
+}
+
+void
+manifest_unmap(struct manifest_map *map) {
+	munmap(map->address, map->length);
+}
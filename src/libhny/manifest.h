@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "sha256.h"
+
+/* Binary manifest, in host byte order: a header, records sorted by path,
+ * then the null-terminated paths records refer to. Sorting by path puts
+ * each directory before its content. */
+
+#define MANIFEST_MAGIC "HNYMNFST"
+#define MANIFEST_MAGIC_SIZE 8
+
+struct manifest_header {
+	char magic[MANIFEST_MAGIC_SIZE]; /**< Always MANIFEST_MAGIC. */
+	uint32_t count; /**< Number of records. */
+	uint32_t strings; /**< Size of the paths table, following records. */
+};
+
+struct manifest_record {
+	uint64_t size; /**< Size of regular files and symbolic links' targets, 0 else. */
+	uint32_t path; /**< Offset of the path in the paths table. */
+	uint32_t mode; /**< Type and permissions, as in st_mode. */
+	uint8_t digest[SHA256_DIGEST_SIZE]; /**< Digest of regular files' content or symbolic links' targets, zeroes else. */
+};
+
+struct manifest {
+	struct manifest_record *records; /**< Records in extraction order. */
+	size_t count;
+	size_t capacity;
+
+	char *strings; /**< Paths table. */
+	size_t size;
+	size_t stringscapacity;
+};
+
+struct manifest_map {
+	void *address;
+	size_t length;
+
+	const struct manifest_record *records; /**< Sorted records. */
+	size_t count;
+	const char *strings; /**< Paths table, every offset checked to be null-terminated. */
+};
+
+void
+manifest_init(struct manifest *manifest);
+
+void
+manifest_deinit(struct manifest *manifest);
+
+int
+manifest_append(struct manifest *manifest, const char *path, mode_t mode, off_t size, const uint8_t digest[SHA256_DIGEST_SIZE]);
+
+int
+manifest_write(struct manifest *manifest, int dirfd, const char *name);
+
+int
+manifest_map(struct manifest_map *map, int dirfd, const char *name);
+
+void
+manifest_unmap(struct manifest_map *map);
+
+/* MANIFEST_H */
+#endif
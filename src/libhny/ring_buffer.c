@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "ring_buffer.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+int
+ring_buffer_init(struct ring_buffer *ring, size_t capacity) {
+	int errcode;
+
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+		errcode = EINVAL;
+		goto ring_buffer_init_err0;
+	}
+
+	ring->buffer = malloc(capacity);
+	if (ring->buffer == NULL) {
+		errcode = errno;
+		goto ring_buffer_init_err0;
+	}
+
+	errcode = pthread_mutex_init(&ring->mutex, NULL);
+	if (errcode != 0) {
+		goto ring_buffer_init_err1;
+	}
+
+	errcode = pthread_cond_init(&ring->changed, NULL);
+	if (errcode != 0) {
+		goto ring_buffer_init_err2;
+	}
+
+	ring->capacity = capacity;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->closed, false);
+	atomic_init(&ring->waiting, 0);
+
+	return 0;
+ring_buffer_init_err2:
+	pthread_mutex_destroy(&ring->mutex);
+ring_buffer_init_err1:
+	free(ring->buffer);
+ring_buffer_init_err0:
+	return errcode;
+}
+
+void
+ring_buffer_deinit(struct ring_buffer *ring) {
+	pthread_cond_destroy(&ring->changed);
+	pthread_mutex_destroy(&ring->mutex);
+	free(ring->buffer);
+}
+
+static bool
+ring_buffer_is_full(struct ring_buffer *ring) {
+	return atomic_load(&ring->tail) - atomic_load(&ring->head) == ring->capacity;
+}
+
+static bool
+ring_buffer_is_empty(struct ring_buffer *ring) {
+	return atomic_load(&ring->tail) == atomic_load(&ring->head);
+}
+
+static void
+ring_buffer_wait(struct ring_buffer *ring, bool (*blocked)(struct ring_buffer *)) {
+
+	pthread_mutex_lock(&ring->mutex);
+	/* Announced before checking again, so the other side either sees us waiting or we see its update */
+	atomic_fetch_add(&ring->waiting, 1);
+	while (blocked(ring) && !atomic_load(&ring->closed)) {
+		pthread_cond_wait(&ring->changed, &ring->mutex);
+	}
+	atomic_fetch_sub(&ring->waiting, 1);
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+static void
+ring_buffer_notify(struct ring_buffer *ring) {
+
+	if (atomic_load(&ring->waiting) != 0) {
+		pthread_mutex_lock(&ring->mutex);
+		pthread_cond_broadcast(&ring->changed);
+		pthread_mutex_unlock(&ring->mutex);
+	}
+}
+
+size_t
+ring_buffer_reserve(struct ring_buffer *ring, char **spanp) {
+
+	if (ring_buffer_is_full(ring)) {
+		ring_buffer_wait(ring, ring_buffer_is_full);
+	}
+
+	/* Nothing more will ever be consumed */
+	if (atomic_load(&ring->closed)) {
+		return 0;
+	}
+
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	const size_t offset = tail & (ring->capacity - 1);
+
+	*spanp = ring->buffer + offset;
+
+	return MIN(ring->capacity - (tail - atomic_load(&ring->head)), ring->capacity - offset);
+}
+
+void
+ring_buffer_produce(struct ring_buffer *ring, size_t size) {
+
+	if (size != 0) {
+		atomic_fetch_add(&ring->tail, size);
+		ring_buffer_notify(ring);
+	}
+}
+
+size_t
+ring_buffer_peek(struct ring_buffer *ring, const char **spanp) {
+
+	if (ring_buffer_is_empty(ring)) {
+		ring_buffer_wait(ring, ring_buffer_is_empty);
+	}
+
+	/* Once closed, what was produced before is still available */
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const size_t offset = head & (ring->capacity - 1);
+
+	*spanp = ring->buffer + offset;
+
+	return MIN(atomic_load(&ring->tail) - head, ring->capacity - offset);
+}
+
+void
+ring_buffer_consume(struct ring_buffer *ring, size_t size) {
+
+	if (size != 0) {
+		atomic_fetch_add(&ring->head, size);
+		ring_buffer_notify(ring);
+	}
+}
+
+void
+ring_buffer_close(struct ring_buffer *ring) {
+
+	atomic_store(&ring->closed, true);
+
+	pthread_mutex_lock(&ring->mutex);
+	pthread_cond_broadcast(&ring->changed);
+	pthread_mutex_unlock(&ring->mutex);
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* Single producer, single consumer byte ring. Positions are lock-free,
+ * the mutex and condition are only used to sleep when blocked. */
+struct ring_buffer {
+	char *buffer;
+	size_t capacity; /**< Power of two. */
+
+	atomic_size_t head; /**< Bytes consumed so far, only written by the consumer. */
+	atomic_size_t tail; /**< Bytes produced so far, only written by the producer. */
+	atomic_bool closed; /**< Whether one side stopped, see ring_buffer_close(). */
+
+	atomic_uint waiting; /**< Number of sides sleeping. */
+	pthread_mutex_t mutex;
+	pthread_cond_t changed; /**< Signaled when positions change or the ring is closed, if a side sleeps. */
+};
+
+int
+ring_buffer_init(struct ring_buffer *ring, size_t capacity);
+
+void
+ring_buffer_deinit(struct ring_buffer *ring);
+
+size_t
+ring_buffer_reserve(struct ring_buffer *ring, char **spanp);
+
+void
+ring_buffer_produce(struct ring_buffer *ring, size_t size);
+
+size_t
+ring_buffer_peek(struct ring_buffer *ring, const char **spanp);
+
+void
+ring_buffer_consume(struct ring_buffer *ring, size_t size);
+
+void
+ring_buffer_close(struct ring_buffer *ring);
+
+/* RING_BUFFER_H */
+#endif
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+struct sha256 {
+	uint32_t state[8]; /**< Intermediate hash value. */
+	uint64_t length; /**< Total number of bytes hashed so far. */
+	uint8_t block[64]; /**< Pending bytes of the current block. */
+};
+
+void
+sha256_init(struct sha256 *sha256);
+
+void
+sha256_update(struct sha256 *sha256, const void *data, size_t size);
+
+void
+sha256_final(struct sha256 *sha256, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/* SHA256_H */
+#endif
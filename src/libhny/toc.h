@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef TOC_H
+#define TOC_H
+
+#include <hny.h>
+
+/* Content of an archive's HNY_TOC_FILE, see hny.h */
+
+#define TOC_MAGIC "HNYTABLE"
+#define TOC_MAGIC_SIZE 8
+#define TOC_HEADER_SIZE 16 /* Magic, number of records */
+#define TOC_RECORD_SIZE 24 /* Offset, size, mode, size of the path which follows */
+
+/* TOC_H */
+#endif
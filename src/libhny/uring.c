@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "uring.h"
+
+#include "config.h"
+
+#ifdef CONFIG_HAS_IO_URING
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct uring {
+	int fd;
+	unsigned int entries; /**< Submission queue size, completion queue is at least as large. */
+	unsigned int inflight; /**< Requests prepared and not completed yet. */
+	unsigned int unsubmitted; /**< Requests prepared since last submission. */
+
+	struct {
+		unsigned int *head;
+		unsigned int *tail;
+		unsigned int mask;
+		unsigned int local; /**< Tail including prepared requests, published on submission. */
+		struct io_uring_sqe *sqes;
+	} sq;
+
+	struct {
+		unsigned int *head;
+		unsigned int *tail;
+		unsigned int mask;
+		struct io_uring_cqe *cqes;
+	} cq;
+
+	void *sqmap;
+	size_t sqmapsize;
+	void *cqmap;
+	size_t cqmapsize;
+	size_t sqessize;
+};
+
+static int
+uring_setup(unsigned int entries, struct io_uring_params *params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+uring_enter(int fd, unsigned int submit, unsigned int wait, unsigned int flags) {
+	return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int
+uring_register(int fd, unsigned int opcode, const void *arg, unsigned int count) {
+	return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static int
+uring_probe(int fd) {
+	/* Symbolic links creation and direct descriptors were both introduced in Linux 5.15 */
+	static const unsigned char required[] = {
+		IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_CLOSE, IORING_OP_SYMLINKAT, IORING_OP_UNLINKAT,
+	};
+	const unsigned int count = 256;
+	struct io_uring_probe * const probe = calloc(1, sizeof (*probe) + count * sizeof (*probe->ops));
+	int errcode = 0;
+
+	if (probe == NULL) {
+		return errno;
+	}
+
+	if (uring_register(fd, IORING_REGISTER_PROBE, probe, count) == 0) {
+		for (unsigned int i = 0; i < sizeof (required) / sizeof (*required); i++) {
+			if (required[i] > probe->last_op || !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) {
+				errcode = EOPNOTSUPP;
+				break;
+			}
+		}
+	} else {
+		errcode = errno;
+	}
+
+	free(probe);
+
+	return errcode;
+}
+
+static int
+uring_register_files(int fd, unsigned int files) {
+	int * const fds = malloc(sizeof (*fds) * files);
+	int errcode = 0;
+
+	if (fds == NULL) {
+		return errno;
+	}
+
+	/* Sparse table, slots are filled by direct opens and emptied by direct closes */
+	for (unsigned int i = 0; i < files; i++) {
+		fds[i] = -1;
+	}
+
+	if (uring_register(fd, IORING_REGISTER_FILES, fds, files) != 0) {
+		errcode = errno;
+	}
+
+	free(fds);
+
+	return errcode;
+}
+
+int
+uring_create(struct uring **ringp, unsigned int entries, unsigned int files) {
+	struct io_uring_params params;
+	struct uring *ring;
+	int errcode;
+
+	ring = malloc(sizeof (*ring));
+	if (ring == NULL) {
+		errcode = errno;
+		goto uring_create_err0;
+	}
+
+	memset(&params, 0, sizeof (params));
+	ring->fd = uring_setup(entries, &params);
+	if (ring->fd < 0) {
+		errcode = errno;
+		goto uring_create_err1;
+	}
+
+	errcode = uring_probe(ring->fd);
+	if (errcode != 0) {
+		goto uring_create_err2;
+	}
+
+	errcode = uring_register_files(ring->fd, files);
+	if (errcode != 0) {
+		goto uring_create_err2;
+	}
+
+	ring->sqmapsize = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+	ring->cqmapsize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cqmapsize > ring->sqmapsize) {
+			ring->sqmapsize = ring->cqmapsize;
+		}
+		ring->cqmapsize = ring->sqmapsize;
+	}
+
+	ring->sqmap = mmap(NULL, ring->sqmapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sqmap == MAP_FAILED) {
+		errcode = errno;
+		goto uring_create_err2;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cqmap = ring->sqmap;
+	} else {
+		ring->cqmap = mmap(NULL, ring->cqmapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cqmap == MAP_FAILED) {
+			errcode = errno;
+			goto uring_create_err3;
+		}
+	}
+
+	ring->sqessize = params.sq_entries * sizeof (struct io_uring_sqe);
+	ring->sq.sqes = mmap(NULL, ring->sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sq.sqes == MAP_FAILED) {
+		errcode = errno;
+		goto uring_create_err4;
+	}
+
+	ring->sq.head = (unsigned int *)((char *)ring->sqmap + params.sq_off.head);
+	ring->sq.tail = (unsigned int *)((char *)ring->sqmap + params.sq_off.tail);
+	ring->sq.mask = *(unsigned int *)((char *)ring->sqmap + params.sq_off.ring_mask);
+	ring->sq.local = *ring->sq.tail;
+
+	/* Entries are always used in order, the indirection array is the identity */
+	unsigned int * const array = (unsigned int *)((char *)ring->sqmap + params.sq_off.array);
+	for (unsigned int i = 0; i < params.sq_entries; i++) {
+		array[i] = i;
+	}
+
+	ring->cq.head = (unsigned int *)((char *)ring->cqmap + params.cq_off.head);
+	ring->cq.tail = (unsigned int *)((char *)ring->cqmap + params.cq_off.tail);
+	ring->cq.mask = *(unsigned int *)((char *)ring->cqmap + params.cq_off.ring_mask);
+	ring->cq.cqes = (struct io_uring_cqe *)((char *)ring->cqmap + params.cq_off.cqes);
+
+	ring->entries = params.sq_entries;
+	ring->inflight = 0;
+	ring->unsubmitted = 0;
+
+	*ringp = ring;
+
+	return 0;
+uring_create_err4:
+	if (ring->cqmap != ring->sqmap) {
+		munmap(ring->cqmap, ring->cqmapsize);
+	}
+uring_create_err3:
+	munmap(ring->sqmap, ring->sqmapsize);
+uring_create_err2:
+	close(ring->fd);
+uring_create_err1:
+	free(ring);
+uring_create_err0:
+	return errcode;
+}
+
+void
+uring_destroy(struct uring *ring) {
+
+	munmap(ring->sq.sqes, ring->sqessize);
+	if (ring->cqmap != ring->sqmap) {
+		munmap(ring->cqmap, ring->cqmapsize);
+	}
+	munmap(ring->sqmap, ring->sqmapsize);
+	close(ring->fd);
+	free(ring);
+}
+
+unsigned int
+uring_available(const struct uring *ring) {
+	/* Bounding requests in flight to the submission queue size ensures completions never overflow */
+	return ring->entries - ring->inflight;
+}
+
+unsigned int
+uring_inflight(const struct uring *ring) {
+	return ring->inflight;
+}
+
+unsigned int
+uring_unsubmitted(const struct uring *ring) {
+	return ring->unsubmitted;
+}
+
+static struct io_uring_sqe *
+uring_sqe(struct uring *ring, unsigned char opcode, unsigned char flags, uint64_t data, enum uring_stage stage) {
+	struct io_uring_sqe * const sqe = &ring->sq.sqes[ring->sq.local & ring->sq.mask];
+
+	memset(sqe, 0, sizeof (*sqe));
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->user_data = data | stage;
+
+	ring->sq.local++;
+	ring->unsubmitted++;
+	ring->inflight++;
+
+	return sqe;
+}
+
+unsigned int
+uring_file(struct uring *ring, int dirfd, const char *path, mode_t mode, unsigned int slot,
+	const void *buffer, size_t size, bool datasync, uint64_t data) {
+	const unsigned int inflight = ring->inflight;
+	struct io_uring_sqe *sqe;
+
+	/* A failed open cancels the whole chain, once opened the close always happens */
+	sqe = uring_sqe(ring, IORING_OP_OPENAT, IOSQE_IO_LINK, data, URING_STAGE_OPEN);
+	sqe->fd = dirfd;
+	sqe->addr = (uintptr_t)path;
+	sqe->len = mode;
+	sqe->open_flags = O_CREAT | O_WRONLY | O_EXCL; /* Direct descriptors reject O_CLOEXEC */
+	sqe->file_index = slot + 1;
+
+	if (size != 0) {
+		sqe = uring_sqe(ring, IORING_OP_WRITE, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK, data, URING_STAGE_WRITE);
+		sqe->fd = slot;
+		sqe->addr = (uintptr_t)buffer;
+		sqe->len = size;
+	}
+
+	if (datasync) {
+		sqe = uring_sqe(ring, IORING_OP_FSYNC, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK, data, URING_STAGE_SYNC);
+		sqe->fd = slot;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	}
+
+	sqe = uring_sqe(ring, IORING_OP_CLOSE, 0, data, URING_STAGE_CLOSE);
+	sqe->file_index = slot + 1;
+
+	return ring->inflight - inflight;
+}
+
+void
+uring_symlinkat(struct uring *ring, const char *target, int dirfd, const char *path, uint64_t data) {
+	struct io_uring_sqe * const sqe = uring_sqe(ring, IORING_OP_SYMLINKAT, 0, data, URING_STAGE_SYMLINK);
+
+	sqe->fd = dirfd;
+	sqe->addr = (uintptr_t)target;
+	sqe->addr2 = (uintptr_t)path;
+}
+
+void
+uring_unlinkat(struct uring *ring, int dirfd, const char *path, int flags, uint64_t data) {
+	struct io_uring_sqe * const sqe = uring_sqe(ring, IORING_OP_UNLINKAT, 0, data, URING_STAGE_UNLINK);
+
+	sqe->fd = dirfd;
+	sqe->addr = (uintptr_t)path;
+	sqe->unlink_flags = flags;
+}
+
+int
+uring_submit(struct uring *ring, unsigned int wait) {
+
+	__atomic_store_n(ring->sq.tail, ring->sq.local, __ATOMIC_RELEASE);
+
+	while (true) {
+		const int enterval = uring_enter(ring->fd, ring->unsubmitted, wait, wait != 0 ? IORING_ENTER_GETEVENTS : 0);
+
+		if (enterval >= 0) {
+			ring->unsubmitted -= enterval;
+			return 0;
+		}
+
+		if (errno != EINTR) {
+			return errno;
+		}
+	}
+}
+
+bool
+uring_complete(struct uring *ring, uint64_t *datap, enum uring_stage *stagep, int *resp) {
+	const unsigned int head = *ring->cq.head;
+
+	if (head == __atomic_load_n(ring->cq.tail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	const struct io_uring_cqe * const cqe = &ring->cq.cqes[head & ring->cq.mask];
+
+	*datap = cqe->user_data & ~(uint64_t)URING_STAGE_MASK;
+	*stagep = cqe->user_data & URING_STAGE_MASK;
+	*resp = cqe->res;
+
+	__atomic_store_n(ring->cq.head, head + 1, __ATOMIC_RELEASE);
+	ring->inflight--;
+
+	return true;
+}
+
+/* CONFIG_HAS_IO_URING */
+#endif
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Low bits of request data are reserved to identify the stage which completed. */
+#define URING_STAGE_MASK 7
+
+enum uring_stage {
+	URING_STAGE_OPEN,
+	URING_STAGE_WRITE,
+	URING_STAGE_SYNC,
+	URING_STAGE_CLOSE,
+	URING_STAGE_SYMLINK,
+	URING_STAGE_UNLINK,
+};
+
+struct uring;
+
+int
+uring_create(struct uring **ringp, unsigned int entries, unsigned int files);
+
+void
+uring_destroy(struct uring *ring);
+
+unsigned int
+uring_available(const struct uring *ring);
+
+unsigned int
+uring_inflight(const struct uring *ring);
+
+unsigned int
+uring_unsubmitted(const struct uring *ring);
+
+unsigned int
+uring_file(struct uring *ring, int dirfd, const char *path, mode_t mode, unsigned int slot,
+	const void *buffer, size_t size, bool datasync, uint64_t data);
+
+void
+uring_symlinkat(struct uring *ring, const char *target, int dirfd, const char *path, uint64_t data);
+
+void
+uring_unlinkat(struct uring *ring, int dirfd, const char *path, int flags, uint64_t data);
+
+int
+uring_submit(struct uring *ring, unsigned int wait);
+
+bool
+uring_complete(struct uring *ring, uint64_t *datap, enum uring_stage *stagep, int *resp);
+
+/* URING_H */
+#endif
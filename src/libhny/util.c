@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "util.h"
+
+#include <unistd.h>
+#include <errno.h>
+
+int
+util_write_all(int fd, const void *buffer, size_t size) {
+
+	for (size_t written = 0; written != size;) {
+		const ssize_t writeval = write(fd, (const char *)buffer + written, size - written);
+
+		if (writeval < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+
+		written += writeval;
+	}
+
+	return 0;
+}
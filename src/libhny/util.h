@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Integers of the library's own formats and xz's are little-endian */
+
+static inline uint32_t
+util_load32(const uint8_t *bytes) {
+	return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static inline uint64_t
+util_load64(const uint8_t *bytes) {
+	return util_load32(bytes) | (uint64_t)util_load32(bytes + 4) << 32;
+}
+
+static inline void
+util_store32(uint8_t *bytes, uint32_t value) {
+	bytes[0] = value;
+	bytes[1] = value >> 8;
+	bytes[2] = value >> 16;
+	bytes[3] = value >> 24;
+}
+
+static inline void
+util_store64(uint8_t *bytes, uint64_t value) {
+	util_store32(bytes, value);
+	util_store32(bytes + 4, value >> 32);
+}
+
+/* Writes all of buffer, retrying short and interrupted writes, returns 0 or an error code */
+int
+util_write_all(int fd, const void *buffer, size_t size);
+
+/* UTIL_H */
+#endif
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "worker_pool.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+static void *
+worker_pool_thread(void *data) {
+	struct worker_pool * const pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (true) {
+		struct worker_job *job;
+		int errcode;
+
+		while (pool->head == NULL && !pool->stopping) {
+			pthread_cond_wait(&pool->queued, &pool->mutex);
+		}
+
+		if (pool->head == NULL) {
+			break;
+		}
+
+		job = pool->head;
+		pool->head = job->next;
+		if (pool->head == NULL) {
+			pool->tail = &pool->head;
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+		errcode = job->run(job);
+		pthread_mutex_lock(&pool->mutex);
+
+		if (pool->errcode == 0) {
+			pool->errcode = errcode;
+		}
+
+		pool->pending--;
+		pthread_cond_broadcast(&pool->finished);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+int
+worker_pool_create(struct worker_pool **poolp, unsigned int count, unsigned int limit) {
+	struct worker_pool * const pool = malloc(sizeof (*pool) + count * sizeof (*pool->threads));
+	int errcode;
+
+	if (pool == NULL) {
+		errcode = errno;
+		goto worker_pool_create_err0;
+	}
+
+	pool->head = NULL;
+	pool->tail = &pool->head;
+	pool->pending = 0;
+	pool->limit = limit;
+	pool->errcode = 0;
+	pool->stopping = false;
+	pool->count = 0;
+
+	errcode = pthread_mutex_init(&pool->mutex, NULL);
+	if (errcode != 0) {
+		goto worker_pool_create_err1;
+	}
+
+	errcode = pthread_cond_init(&pool->queued, NULL);
+	if (errcode != 0) {
+		goto worker_pool_create_err2;
+	}
+
+	errcode = pthread_cond_init(&pool->finished, NULL);
+	if (errcode != 0) {
+		goto worker_pool_create_err3;
+	}
+
+	while (pool->count < count) {
+		errcode = pthread_create(pool->threads + pool->count, NULL, worker_pool_thread, pool);
+		if (errcode != 0) {
+			goto worker_pool_create_err4;
+		}
+		pool->count++;
+	}
+
+	*poolp = pool;
+
+	return 0;
+worker_pool_create_err4:
+	worker_pool_destroy(pool);
+	return errcode;
+worker_pool_create_err3:
+	pthread_cond_destroy(&pool->queued);
+worker_pool_create_err2:
+	pthread_mutex_destroy(&pool->mutex);
+worker_pool_create_err1:
+	free(pool);
+worker_pool_create_err0:
+	return errcode;
+}
+
+void
+worker_pool_destroy(struct worker_pool *pool) {
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->queued);
+	pthread_mutex_unlock(&pool->mutex);
+
+	/* Threads drain the queue before exiting */
+	for (unsigned int i = 0; i < pool->count; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->finished);
+	pthread_cond_destroy(&pool->queued);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+void
+worker_pool_push(struct worker_pool *pool, struct worker_job *job) {
+
+	job->next = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->pending >= pool->limit) {
+		pthread_cond_wait(&pool->finished, &pool->mutex);
+	}
+
+	*pool->tail = job;
+	pool->tail = &job->next;
+	pool->pending++;
+
+	pthread_cond_signal(&pool->queued);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+int
+worker_pool_wait(struct worker_pool *pool) {
+	int errcode;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->pending != 0) {
+		pthread_cond_wait(&pool->finished, &pool->mutex);
+	}
+
+	errcode = pool->errcode;
+	pool->errcode = 0;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return errcode;
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+struct worker_job {
+	struct worker_job *next; /**< Next job in the queue. */
+	int (*run)(struct worker_job *job); /**< Job routine, owns the job, returns an error code. */
+};
+
+struct worker_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t queued; /**< Signaled when a job is queued, or when stopping. */
+	pthread_cond_t finished; /**< Signaled when a job finished. */
+
+	struct worker_job *head; /**< First job in the queue. */
+	struct worker_job **tail; /**< Next pointer of the last job in the queue. */
+	unsigned int pending; /**< Jobs queued or running. */
+	unsigned int limit; /**< Maximum pending jobs before worker_pool_push() blocks. */
+	int errcode; /**< First error code reported by a job since last worker_pool_wait(). */
+	bool stopping; /**< Whether threads must exit. */
+
+	unsigned int count; /**< Number of threads. */
+	pthread_t threads[]; /**< Worker threads. */
+};
+
+int
+worker_pool_create(struct worker_pool **poolp, unsigned int count, unsigned int limit);
+
+void
+worker_pool_destroy(struct worker_pool *pool);
+
+void
+worker_pool_push(struct worker_pool *pool, struct worker_job *job);
+
+int
+worker_pool_wait(struct worker_pool *pool);
+
+/* WORKER_POOL_H */
+#endif
@@ -144,11 +144,17 @@ struct xz_decoder {
 int
 xz_decoder_init(struct xz_decoder *xz, size_t dictionarymax);
 
+void
+xz_decoder_init_static(struct xz_decoder *xz, uint8_t *dictionary, uint32_t dictionarymax);
+
 void
 xz_decoder_deinit(struct xz_decoder *xz);
 
 enum xz_decoder_status
 xz_decoder_decode(struct xz_decoder *xz, struct xz_stream *stream);
 
+int
+xz_dictionary_size(const char *data, size_t size, uint32_t *dictionaryp);
+
 /* XZ_DECODER_H */
 #endif
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#include "xz_encoder.h"
+
+#include <string.h>
+
+#include "crc32.h"
+#include "util.h"
+
+/* Only a crc32 check is written, the decoder also accepts none */
+#define XZ_STREAM_FLAGS_CHECK_CRC32 0x01
+
+#define XZ_BLOCK_FLAGS_COMPRESSED_SIZE 0x40
+#define XZ_BLOCK_FLAGS_UNCOMPRESSED_SIZE 0x80
+
+#define XZ_FILTER_LZMA2 0x21
+
+static size_t
+xz_encoder_multibyte(uint8_t *output, uint64_t value) {
+	size_t i = 0;
+
+	while (value >= 0x80) {
+		output[i++] = value | 0x80;
+		value >>= 7;
+	}
+
+	output[i++] = value;
+
+	return i;
+}
+
+static inline size_t
+xz_encoder_padding(uint8_t *output, size_t size) {
+	size_t i = 0;
+
+	while ((size + i) % 4 != 0) {
+		output[i++] = 0x00;
+	}
+
+	return i;
+}
+
+size_t
+xz_encoder_stream_header(uint8_t *output) {
+	static const uint8_t magic[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+	const uint8_t flags[] = { 0x00, XZ_STREAM_FLAGS_CHECK_CRC32 };
+
+	memcpy(output, magic, sizeof (magic));
+	memcpy(output + sizeof (magic), flags, sizeof (flags));
+	util_store32(output + sizeof (magic) + sizeof (flags), crc32_end(crc32_update(CRC32_INIT, flags, sizeof (flags))));
+
+	return XZ_ENCODER_STREAM_HEADER_SIZE;
+}
+
+size_t
+xz_encoder_block(struct lzma2_encoder *encoder, const uint8_t *input, size_t size, uint8_t *output, struct xz_encoder_record *record) {
+	uint8_t header[XZ_ENCODER_BLOCK_HEADER_MAX];
+	size_t headersize = 2, compressed, written;
+
+	/* Header is written last, its size depends on the compressed size, data is placed after the largest one */
+	compressed = lzma2_encoder_encode(encoder, input, size, output + XZ_ENCODER_BLOCK_HEADER_MAX);
+
+	header[1] = XZ_BLOCK_FLAGS_COMPRESSED_SIZE | XZ_BLOCK_FLAGS_UNCOMPRESSED_SIZE;
+	headersize += xz_encoder_multibyte(header + headersize, compressed);
+	headersize += xz_encoder_multibyte(header + headersize, size);
+	header[headersize++] = XZ_FILTER_LZMA2;
+	header[headersize++] = 1;
+	header[headersize++] = lzma2_encoder_dictionary_properties(size);
+	headersize += xz_encoder_padding(header + headersize, headersize + 4);
+	header[0] = (headersize + 4) / 4 - 1;
+	util_store32(header + headersize, crc32_end(crc32_update(CRC32_INIT, header, headersize)));
+	headersize += 4;
+
+	memmove(output + headersize, output + XZ_ENCODER_BLOCK_HEADER_MAX, compressed);
+	memcpy(output, header, headersize);
+
+	written = headersize + compressed;
+	written += xz_encoder_padding(output + written, compressed);
+	util_store32(output + written, crc32_end(crc32_update(CRC32_INIT, input, size)));
+	written += 4;
+
+	record->unpadded = headersize + compressed + 4;
+	record->uncompressed = size;
+
+	return written;
+}
+
+size_t
+xz_encoder_end(const struct xz_encoder_record *records, size_t count, uint8_t *output) {
+	static const uint8_t magic[] = { 'Y', 'Z' };
+	size_t written = 0, indexsize;
+	uint8_t *footer;
+
+	output[written++] = 0x00;
+	written += xz_encoder_multibyte(output + written, count);
+	for (size_t i = 0; i < count; i++) {
+		written += xz_encoder_multibyte(output + written, records[i].unpadded);
+		written += xz_encoder_multibyte(output + written, records[i].uncompressed);
+	}
+	written += xz_encoder_padding(output + written, written);
+	util_store32(output + written, crc32_end(crc32_update(CRC32_INIT, output, written)));
+	written += 4;
+	indexsize = written;
+
+	/* Stream footer, its crc32 covers the backward size and stream flags */
+	footer = output + written;
+	written += 4;
+	util_store32(output + written, indexsize / 4 - 1);
+	written += 4;
+	output[written++] = 0x00;
+	output[written++] = XZ_STREAM_FLAGS_CHECK_CRC32;
+	util_store32(footer, crc32_end(crc32_update(CRC32_INIT, footer + 4, 6)));
+	memcpy(output + written, magic, sizeof (magic));
+	written += sizeof (magic);
+
+	return written;
+}
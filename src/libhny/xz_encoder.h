@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef XZ_ENCODER_H
+#define XZ_ENCODER_H
+
+#include "lzma2_encoder.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define XZ_ENCODER_STREAM_HEADER_SIZE 12
+
+/* Block header, at most 23 bytes padded to 24, and its crc32 */
+#define XZ_ENCODER_BLOCK_HEADER_MAX 28
+
+/* Worst-case size of an encoded block of size bytes: header, LZMA2 data padded to four bytes and crc32 */
+#define XZ_ENCODER_BLOCK_BOUND(size) (XZ_ENCODER_BLOCK_HEADER_MAX + LZMA2_ENCODER_BOUND(size) + 3 + 4)
+
+/* Worst-case size of the index of count blocks followed by the stream footer */
+#define XZ_ENCODER_END_BOUND(count) (1 + 9 + (count) * 18 + 3 + 4 + 12)
+
+struct xz_encoder_record {
+	uint64_t unpadded; /**< Size of the block header, compressed data and check, without padding. */
+	uint64_t uncompressed;
+};
+
+size_t
+xz_encoder_stream_header(uint8_t *output);
+
+size_t
+xz_encoder_block(struct lzma2_encoder *encoder, const uint8_t *input, size_t size, uint8_t *output, struct xz_encoder_record *record);
+
+size_t
+xz_encoder_end(const struct xz_encoder_record *records, size_t count, uint8_t *output);
+
+/* XZ_ENCODER_H */
+#endif
@@ -2,6 +2,7 @@
 #include <cover/suite.h>
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
@@ -10,13 +11,25 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <errno.h>
 #include <err.h>
 
+#include <hny.h>
+
 #define HNY_TEST_ARCHIVE "test/archive.hny"
 #define HNY_TEST_PREFIX "test/prefix"
+#define HNY_TEST_CACHE "test/cache"
+#define HNY_TEST_BUNDLE "test/bundle.hnyb"
+#define HNY_TEST_DELTA "test/delta.hny"
+#define HNY_TEST_PACKED "test/packed.hny"
+#define HNY_TEST_LARGE "test/large.hny"
+
+/* Larger than the extraction's coalescing buffer */
+#define HNY_TEST_LARGE_SIZE (4 << 20)
 
-#define hny(args) hny_at(args, __FILE__, __LINE__)
+#define hny(args) hny_at(args, false, __FILE__, __LINE__)
+#define hny_failing(args) hny_at(args, true, __FILE__, __LINE__)
 
 static void
 removeall_at(int atfd, const char *path) {
@@ -93,6 +106,109 @@ cover_suite_init(int argc, char **argv) {
 			fputc('\0', output);
 			fprintf(output, "#!/bin/sh\necho \"Test Archive - Setup\"\n");
 
+			fprintf(output, "070707004021002171100644%.6o%.6o0000010000000000000000000001300004000000pkg/sparse", uid, gid);
+			fputc('\0', output);
+			for (unsigned int i = 0; i < 04000000; i++) {
+				fputc('\0', output);
+			}
+			fprintf(output, "070707004021002172040755%.6o%.6o0000020000000000000000000000500000000000doc/", uid, gid);
+			fputc('\0', output);
+
+			fprintf(output, "0707070000000000000000000000000000000000010000000000000000000001300000000000TRAILER!!!");
+			fputc('\0', output);
+		}
+
+		if (pclose(output) < 0) {
+			err(EXIT_FAILURE, "pclose %s", xzcommand);
+		}
+
+		free(xzcommand);
+	}
+
+	{ /* Create the test delta archive, against the test archive */
+		const char * const xzexe = getenv("XZ_EXE");
+		char *xzcommand;
+		FILE *output;
+
+		if (asprintf(&xzcommand, "%s -C crc32 --lzma2 > "HNY_TEST_DELTA, xzexe) < 0) {
+			err(EXIT_FAILURE, "asprintf");
+		}
+
+		output = popen(xzcommand, "w");
+		if (output == NULL) {
+			err(EXIT_FAILURE, "popen");
+		}
+
+		{ /* Print archive entries in CPIO ODC format */
+			/* Patching pkg/setup's "Archive" into "Delta" */
+			static const unsigned char patch[] = {
+				'H', 'N', 'Y', 'P', 'A', 'T', 'C', 'H',
+				'C', 0, 0, 0, 0, 0, 0, 0, 0, 21, 0, 0, 0, 0, 0, 0, 0,
+				'I', 5, 0, 0, 0, 0, 0, 0, 0, 'D', 'e', 'l', 't', 'a',
+				'C', 28, 0, 0, 0, 0, 0, 0, 0, 10, 0, 0, 0, 0, 0, 0, 0,
+			};
+			const uid_t uid = geteuid();
+			const gid_t gid = getegid();
+
+			fprintf(output, "070707004021002173040755%.6o%.6o0000020000000000000000000001400000000000.hny-delta/", uid, gid);
+			fputc('\0', output);
+
+			fprintf(output, "070707004021002174100644%.6o%.6o0000010000000000000000000002300000000012.hny-delta/removed", uid, gid);
+			fputc('\0', output);
+			fwrite("pkg/clean", 1, sizeof ("pkg/clean"), output);
+
+			fprintf(output, "070707004021002175040755%.6o%.6o0000020000000000000000000002400000000000.hny-delta/patches/", uid, gid);
+			fputc('\0', output);
+
+			fprintf(output, "070707004021002176040755%.6o%.6o0000020000000000000000000003000000000000.hny-delta/patches/pkg/", uid, gid);
+			fputc('\0', output);
+
+			fprintf(output, "070707004021002177100755%.6o%.6o0000010000000000000000000003500000000070.hny-delta/patches/pkg/setup", uid, gid);
+			fputc('\0', output);
+			fwrite(patch, 1, sizeof (patch), output);
+
+			fprintf(output, "070707004021002200100644%.6o%.6o0000010000000000000000000001300000000006doc/readme", uid, gid);
+			fputc('\0', output);
+			fprintf(output, "Delta\n");
+
+			fprintf(output, "0707070000000000000000000000000000000000010000000000000000000001300000000000TRAILER!!!");
+			fputc('\0', output);
+		}
+
+		if (pclose(output) < 0) {
+			err(EXIT_FAILURE, "pclose %s", xzcommand);
+		}
+
+		free(xzcommand);
+	}
+
+	{ /* Create the test large archive */
+		const char * const xzexe = getenv("XZ_EXE");
+		char *xzcommand;
+		FILE *output;
+
+		if (asprintf(&xzcommand, "%s -C crc32 --lzma2 > "HNY_TEST_LARGE, xzexe) < 0) {
+			err(EXIT_FAILURE, "asprintf");
+		}
+
+		output = popen(xzcommand, "w");
+		if (output == NULL) {
+			err(EXIT_FAILURE, "popen");
+		}
+
+		{ /* Print archive entries in CPIO ODC format */
+			const uid_t uid = geteuid();
+			const gid_t gid = getegid();
+
+			fprintf(output, "070707004021002201040755%.6o%.6o0000020000000000000000000000500000000000pkg/", uid, gid);
+			fputc('\0', output);
+
+			fprintf(output, "070707004021002202100644%.6o%.6o00000100000000000000000000012%.11opkg/large", uid, gid, HNY_TEST_LARGE_SIZE);
+			fputc('\0', output);
+			for (unsigned int i = 0; i < HNY_TEST_LARGE_SIZE; i++) {
+				fputc('a' + i % 26, output);
+			}
+
 			fprintf(output, "0707070000000000000000000000000000000000010000000000000000000001300000000000TRAILER!!!");
 			fputc('\0', output);
 		}
@@ -121,12 +237,22 @@ cover_suite_init(int argc, char **argv) {
 		free(path);
 	}
 
+	{ /* Setup cache directory */
+		if (mkdir(HNY_TEST_CACHE, 0777) != 0) {
+			if (errno == EEXIST) {
+				removeall_at(AT_FDCWD, HNY_TEST_CACHE);
+			} else {
+				err(EXIT_FAILURE, "mkdir %s", HNY_TEST_CACHE);
+			}
+		}
+	}
+
 	/* Empty umask to assert file modes */
 	umask(0);
 }
 
 static void
-hny_at(char * const arguments[], const char *filename, int lineno) {
+hny_at(char * const arguments[], bool failing, const char *filename, int lineno) {
 	const char * const hnyexe = getenv("HNY_EXE");
 
 	/* Write command on stderr */
@@ -160,7 +286,7 @@ hny_at(char * const arguments[], const char *filename, int lineno) {
 		/* Simple status check */
 		if (WIFEXITED(wstatus)) {
 			const int status = WEXITSTATUS(wstatus);
-			if (status != 0) {
+			if ((status != 0) != failing) {
 				fprintf(stderr, "exit status: %d\n", status);
 				cover_fail_at("Invalid return status", filename, lineno);
 			}
@@ -173,6 +299,43 @@ hny_at(char * const arguments[], const char *filename, int lineno) {
 	}
 }
 
+struct hny_test_extraction {
+	struct hny *hny;
+	const char *package;
+	enum hny_extraction_status status;
+	int errcode;
+};
+
+static void *
+hny_test_extraction_run(void *arg) {
+	struct hny_test_extraction * const test = arg;
+	struct hny_extraction *extraction;
+	char buffer[4096];
+	ssize_t readval;
+	int fd;
+
+	test->status = HNY_EXTRACTION_STATUS_ERROR_UNFINISHED_CPIO;
+
+	fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+	if (fd < 0) {
+		test->errcode = errno;
+		return NULL;
+	}
+
+	test->errcode = hny_extraction_create(&extraction, test->hny, test->package);
+	if (test->errcode == 0) {
+		while ((readval = read(fd, buffer, sizeof (buffer)), readval > 0)
+			&& (test->status = hny_extraction_extract(extraction, buffer, readval), test->status == HNY_EXTRACTION_STATUS_OK));
+
+		test->errcode = hny_extraction_errcode(extraction);
+		hny_extraction_destroy(extraction);
+	}
+
+	close(fd);
+
+	return NULL;
+}
+
 static void
 test_hny(void) {
 	struct stat st;
@@ -195,6 +358,654 @@ test_hny(void) {
 		cover_assert(st.st_mode == (S_IFREG | 0755), "archive-1.0.0/pkg/setup is not an executable regular file");
 	}
 
+	{ /* honey extract --sparse */
+		char * const cmd0[] = { "hny", "extract", "--sparse", "archive-1.0.1", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.1/pkg/sparse", &st) == 0, "stat archive-1.0.1/pkg/sparse");
+		cover_assert(st.st_size == 04000000, "archive-1.0.1/pkg/sparse has an invalid size");
+		cover_assert(st.st_blocks * 512 < st.st_size, "archive-1.0.1/pkg/sparse is not sparse");
+	}
+
+	{ /* honey extract --base --link */
+		char * const cmd0[] = { "hny", "extract", "--base", "archive-1.0.0", "--link", "archive-1.0.2", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.2/pkg/setup", &st) == 0, "stat archive-1.0.2/pkg/setup");
+		cover_assert(st.st_nlink == 2, "archive-1.0.2/pkg/setup is not linked to archive-1.0.0/pkg/setup");
+	}
+
+	{ /* honey extract --deduplicate */
+		char * const cmd0[] = { "hny", "extract", "--deduplicate", "archive-1.0.3", HNY_TEST_ARCHIVE, NULL };
+		char * const cmd1[] = { "hny", "extract", "--deduplicate", "archive-1.0.4", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+		hny(cmd1);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.4/pkg/setup", &st) == 0, "stat archive-1.0.4/pkg/setup");
+		cover_assert(st.st_nlink == 3, "archive-1.0.4/pkg/setup is not shared through the objects store");
+	}
+
+	{ /* honey remove, only examining objects the package linked */
+		char * const cmd0[] = { "hny", "extract", "--deduplicate", "archive-1.0.34", HNY_TEST_ARCHIVE, NULL };
+		char * const cmd1[] = { "hny", "remove", "archive-1.0.34", NULL };
+		const int fd = open(HNY_TEST_PREFIX"/.objects/unrelated", O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+		cover_assert(fd >= 0, "open .objects/unrelated");
+		close(fd);
+
+		hny(cmd0);
+		hny(cmd1);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.4/pkg/setup", &st) == 0, "stat archive-1.0.4/pkg/setup");
+		cover_assert(st.st_nlink == 3, "archive-1.0.4/pkg/setup object was collected while still used");
+		cover_assert(access(HNY_TEST_PREFIX"/.objects/unrelated", F_OK) == 0, "removal examined an object the package never linked");
+		cover_assert(unlink(HNY_TEST_PREFIX"/.objects/unrelated") == 0, "unlink .objects/unrelated");
+	}
+
+	{ /* honey extract --durability */
+		char * const cmd0[] = { "hny", "extract", "--durability", "fdatasync", "archive-1.0.5", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.5/pkg/setup", &st) == 0, "stat archive-1.0.5/pkg/setup");
+		cover_assert(st.st_mode == (S_IFREG | 0755), "archive-1.0.5/pkg/setup is not an executable regular file");
+	}
+
+	{ /* honey extract --stats */
+		char * const cmd0[] = { "hny", "extract", "--stats", "archive-1.0.6", HNY_TEST_ARCHIVE, NULL };
+		const mode_t mask = umask(0077);
+
+		hny(cmd0);
+
+		umask(mask);
+
+		/* Permissions masked at creation must still be applied */
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.6/pkg", &st) == 0, "stat archive-1.0.6/pkg");
+		cover_assert(st.st_mode == (S_IFDIR | 0755), "archive-1.0.6/pkg has invalid permissions");
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.6/pkg/setup", &st) == 0, "stat archive-1.0.6/pkg/setup");
+		cover_assert(st.st_mode == (S_IFREG | 0755), "archive-1.0.6/pkg/setup has invalid permissions");
+	}
+
+	{ /* honey extract --parallel */
+		char * const cmd0[] = { "hny", "extract", "--parallel", "--deduplicate", "archive-1.0.7", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.7/pkg/setup", &st) == 0, "stat archive-1.0.7/pkg/setup");
+		cover_assert(st.st_mode == (S_IFREG | 0755), "archive-1.0.7/pkg/setup is not an executable regular file");
+		cover_assert(st.st_nlink == 4, "archive-1.0.7/pkg/setup is not shared through the objects store");
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.7/pkg/sparse", &st) == 0, "stat archive-1.0.7/pkg/sparse");
+		cover_assert(st.st_size == 04000000, "archive-1.0.7/pkg/sparse has an invalid size");
+	}
+
+	{ /* honey extract --uring */
+		char * const cmd0[] = { "hny", "extract", "--uring", "--durability", "fdatasync", "archive-1.0.8", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.8/pkg/setup", &st) == 0, "stat archive-1.0.8/pkg/setup");
+		cover_assert(st.st_mode == (S_IFREG | 0755), "archive-1.0.8/pkg/setup is not an executable regular file");
+		cover_assert(st.st_size == 046, "archive-1.0.8/pkg/setup has an invalid size");
+	}
+
+	{ /* honey extract --pipeline */
+		char * const cmd0[] = { "hny", "extract", "--pipeline", "archive-1.0.9", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.9/pkg/sparse", &st) == 0, "stat archive-1.0.9/pkg/sparse");
+		cover_assert(st.st_size == 04000000, "archive-1.0.9/pkg/sparse has an invalid size");
+	}
+
+	{ /* honey extract --writeback */
+		char * const cmd0[] = { "hny", "extract", "--writeback", "--sparse", "archive-1.0.14", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.14/pkg/sparse", &st) == 0, "stat archive-1.0.14/pkg/sparse");
+		cover_assert(st.st_size == 04000000, "archive-1.0.14/pkg/sparse has an invalid size");
+	}
+
+	{ /* honey extract --only, --exclude */
+		char * const cmd0[] = { "hny", "extract", "--only", "pkg/*", "--exclude", "pkg/clean", "--manifest", "archive-1.0.15", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.15/pkg/setup", &st) == 0, "stat archive-1.0.15/pkg/setup");
+		cover_assert(st.st_size == 046, "archive-1.0.15/pkg/setup has an invalid size");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.15/pkg/clean", &st) != 0, "archive-1.0.15/pkg/clean was not excluded");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.15/doc", &st) != 0, "archive-1.0.15/doc was not filtered out");
+	}
+
+	{ /* honey extract --manifest */
+		char * const cmd0[] = { "hny", "extract", "--manifest", "archive-1.0.12", HNY_TEST_ARCHIVE, NULL };
+		struct {
+			char magic[8];
+			uint32_t count;
+			uint32_t strings;
+		} header;
+		FILE *manifest;
+
+		hny(cmd0);
+
+		manifest = fopen(HNY_TEST_PREFIX"/archive-1.0.12/.manifest", "r");
+		cover_assert(manifest != NULL, "open archive-1.0.12/.manifest");
+		cover_assert(fread(&header, sizeof (header), 1, manifest) == 1, "read archive-1.0.12/.manifest");
+		cover_assert(memcmp(header.magic, "HNYMNFST", sizeof (header.magic)) == 0, "archive-1.0.12/.manifest has an invalid magic");
+		cover_assert(header.count == 5, "archive-1.0.12/.manifest has an invalid number of entries");
+		fclose(manifest);
+	}
+
+	{ /* honey extract --mtime, then --reinstall */
+		char * const cmd0[] = { "hny", "extract", "--mtime", "archive-1.0.13", HNY_TEST_ARCHIVE, NULL };
+		char * const cmd1[] = { "hny", "extract", "--reinstall", "archive-1.0.13", HNY_TEST_ARCHIVE, NULL };
+		FILE *clean;
+		ino_t ino;
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.13/pkg", &st) == 0, "stat archive-1.0.13/pkg");
+		cover_assert(st.st_mtime == 0, "archive-1.0.13/pkg has an invalid modification time");
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.13/pkg/setup", &st) == 0, "stat archive-1.0.13/pkg/setup");
+		cover_assert(st.st_mtime == 0, "archive-1.0.13/pkg/setup has an invalid modification time");
+		ino = st.st_ino;
+
+		/* Damage a file, only this one must be rewritten */
+		clean = fopen(HNY_TEST_PREFIX"/archive-1.0.13/pkg/clean", "a");
+		cover_assert(clean != NULL, "open archive-1.0.13/pkg/clean");
+		fputs("exit 1\n", clean);
+		fclose(clean);
+
+		hny(cmd1);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.13/pkg/setup", &st) == 0, "stat archive-1.0.13/pkg/setup");
+		cover_assert(st.st_ino == ino, "archive-1.0.13/pkg/setup was rewritten");
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.13/pkg/clean", &st) == 0, "stat archive-1.0.13/pkg/clean");
+		cover_assert(st.st_size == 046 && st.st_mtime == 0, "archive-1.0.13/pkg/clean was not reinstalled");
+
+		/* A kept file with other links must be replaced rather than fixed in place */
+		cover_assert(link(HNY_TEST_PREFIX"/archive-1.0.13/pkg/setup", "test/setup.link") == 0, "link archive-1.0.13/pkg/setup");
+		cover_assert(chmod("test/setup.link", 0644) == 0, "chmod archive-1.0.13/pkg/setup");
+
+		hny(cmd1);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.13/pkg/setup", &st) == 0, "stat archive-1.0.13/pkg/setup");
+		cover_assert(st.st_mode == (S_IFREG | 0755) && st.st_nlink == 1, "archive-1.0.13/pkg/setup was not replaced");
+		cover_assert(lstat("test/setup.link", &st) == 0 && st.st_mode == (S_IFREG | 0644), "archive-1.0.13/pkg/setup was modified in place");
+		unlink("test/setup.link");
+	}
+
+	{ /* Concurrent extractions on the same prefix, neither may alter the process umask */
+		struct hny_test_extraction tests[] = {
+			{ .package = "archive-1.0.10" },
+			{ .package = "archive-1.0.11" },
+		};
+		pthread_t threads[sizeof (tests) / sizeof (*tests)];
+		struct hny *hny;
+
+		cover_assert(hny_open(&hny, getenv("HNY_PREFIX"), HNY_FLAGS_NONE) == 0, "hny_open");
+
+		umask(0027);
+
+		for (unsigned int i = 0; i < sizeof (tests) / sizeof (*tests); i++) {
+			tests[i].hny = hny;
+			cover_assert(pthread_create(&threads[i], NULL, hny_test_extraction_run, &tests[i]) == 0, "pthread_create");
+		}
+
+		for (unsigned int i = 0; i < sizeof (tests) / sizeof (*tests); i++) {
+			pthread_join(threads[i], NULL);
+			cover_assert(tests[i].status == HNY_EXTRACTION_STATUS_END && tests[i].errcode == 0, "concurrent extraction failed");
+		}
+
+		cover_assert(umask(0) == 0027, "extraction altered the process umask");
+
+		hny_close(hny);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.10/pkg", &st) == 0, "stat archive-1.0.10/pkg");
+		cover_assert(st.st_mode == (S_IFDIR | 0755), "archive-1.0.10/pkg has invalid permissions");
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.11/pkg/setup", &st) == 0, "stat archive-1.0.11/pkg/setup");
+		cover_assert(st.st_mode == (S_IFREG | 0755), "archive-1.0.11/pkg/setup has invalid permissions");
+		cover_assert(st.st_size == 046, "archive-1.0.11/pkg/setup has an invalid size");
+	}
+
+	{ /* Rolling back an unfinished extraction */
+		struct hny_extraction *extraction;
+		enum hny_extraction_status status;
+		struct hny *hny;
+		char buffer[4096];
+		ssize_t readval;
+		off_t remaining;
+		int fd;
+
+		cover_assert(hny_open(&hny, getenv("HNY_PREFIX"), HNY_FLAGS_NONE) == 0, "hny_open");
+		cover_assert(hny_extraction_create(&extraction, hny, "archive-1.0.17") == 0, "hny_extraction_create");
+
+		/* Everything but the end of the xz stream, so every entry is created */
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_ARCHIVE);
+		remaining = lseek(fd, 0, SEEK_END) - 1;
+		lseek(fd, 0, SEEK_SET);
+		while (remaining != 0 && (readval = read(fd, buffer, remaining < (off_t)sizeof (buffer) ? remaining : (off_t)sizeof (buffer)), readval > 0)
+			&& (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK)) {
+			remaining -= readval;
+		}
+		close(fd);
+
+		cover_assert(status == HNY_EXTRACTION_STATUS_OK, "unfinished extraction failed");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.17/pkg/setup", &st) == 0, "stat archive-1.0.17/pkg/setup");
+
+		cover_assert(hny_extraction_abort(extraction) == 0, "hny_extraction_abort");
+		hny_extraction_destroy(extraction);
+		hny_close(hny);
+
+		cover_assert(access(HNY_TEST_PREFIX"/archive-1.0.17", F_OK) != 0, "aborted extraction left archive-1.0.17");
+	}
+
+	{ /* Fan-out extraction into two packages */
+		struct hny_extraction *extraction;
+		enum hny_extraction_status status;
+		struct stat st2;
+		struct hny *hny;
+		char buffer[4096];
+		ssize_t readval;
+		int fd;
+
+		cover_assert(hny_open(&hny, getenv("HNY_PREFIX"), HNY_FLAGS_NONE) == 0, "hny_open");
+
+		const struct hny_extraction_target targets[] = {
+			{ .hny = hny, .package = "archive-1.0.18" },
+			{ .hny = hny, .package = "archive-1.0.19" },
+		};
+
+		cover_assert(hny_extraction_create_fanout(&extraction, targets, 2, 4096, UINT32_MAX, HNY_EXTRACTION_FLAGS_LINK | HNY_EXTRACTION_FLAGS_PIPELINE) == 0, "hny_extraction_create_fanout");
+
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_ARCHIVE);
+		while ((readval = read(fd, buffer, sizeof (buffer)), readval > 0)
+			&& (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK));
+		close(fd);
+
+		cover_assert(status == HNY_EXTRACTION_STATUS_END, "fan-out extraction failed");
+		hny_extraction_destroy(extraction);
+		hny_close(hny);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.18/pkg/setup", &st) == 0, "stat archive-1.0.18/pkg/setup");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.19/pkg/setup", &st2) == 0, "stat archive-1.0.19/pkg/setup");
+		cover_assert(st2.st_size == 046 && st2.st_mode == (S_IFREG | 0755), "archive-1.0.19/pkg/setup has invalid attributes");
+		cover_assert(st.st_ino == st2.st_ino, "archive-1.0.19/pkg/setup was not linked to archive-1.0.18's");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.19/doc", &st) == 0 && S_ISDIR(st.st_mode), "archive-1.0.19/doc is not a directory");
+	}
+
+	{ /* honey extract --cache */
+		char * const cmd0[] = { "hny", "extract", "--cache", HNY_TEST_CACHE, "archive-1.0.20", HNY_TEST_ARCHIVE, NULL };
+		char * const cmd1[] = { "hny", "extract", "--cache", HNY_TEST_CACHE, "--link", "archive-1.0.21", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.20/pkg/setup", &st) == 0, "stat archive-1.0.20/pkg/setup");
+		cover_assert(st.st_nlink == 1, "archive-1.0.20/pkg/setup was linked on a cache miss");
+
+		/* Cloned from the cache, so hard linked to the cached tree */
+		hny(cmd1);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.21/pkg/setup", &st) == 0, "stat archive-1.0.21/pkg/setup");
+		cover_assert(st.st_size == 046 && st.st_mode == (S_IFREG | 0755), "archive-1.0.21/pkg/setup has invalid attributes");
+		cover_assert(st.st_nlink == 2, "archive-1.0.21/pkg/setup was not cloned from the cache");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.21/pkg/sparse", &st) == 0 && st.st_size == 04000000, "archive-1.0.21/pkg/sparse has an invalid size");
+	}
+
+	{ /* honey extract --cache, options a cache hit can't honour */
+		char * const cmd0[] = { "hny", "extract", "--cache", HNY_TEST_CACHE, "--durability", "fdatasync", "archive-1.0.32", HNY_TEST_ARCHIVE, NULL };
+		char * const cmd1[] = { "hny", "extract", "--cache", HNY_TEST_CACHE, "--manifest", "archive-1.0.33", HNY_TEST_ARCHIVE, NULL };
+
+		/* Durability syncs the clone */
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.32/pkg/setup", &st) == 0 && st.st_size == 046, "archive-1.0.32/pkg/setup has an invalid size");
+
+		/* No manifest is ever written for a clone */
+		hny_failing(cmd1);
+
+		cover_assert(access(HNY_TEST_PREFIX"/archive-1.0.33", F_OK) != 0, "archive-1.0.33 was created with an unsupported option");
+	}
+
+	{ /* Extraction in caller-provided memory */
+		struct hny_extraction *extraction;
+		enum hny_extraction_status status;
+		struct hny *hny;
+		char buffer[4096];
+		ssize_t readval;
+		size_t size;
+		void *memory;
+		int fd;
+
+		cover_assert(hny_open(&hny, getenv("HNY_PREFIX"), HNY_FLAGS_NONE) == 0, "hny_open");
+
+		/* Exactly the test archive's dictionary */
+		size = hny_extraction_static_size("archive-1.0.22", 4096, 8 << 20);
+		memory = malloc(size);
+		cover_assert(memory != NULL, "malloc");
+
+		cover_assert(hny_extraction_create_static(&extraction, hny, "archive-1.0.22", memory, size - 1, 4096, 8 << 20, HNY_EXTRACTION_FLAGS_NONE) == ENOBUFS, "static extraction accepted a too small region");
+		cover_assert(hny_extraction_create_static(&extraction, hny, "archive-1.0.22", memory, size, 4096, 8 << 20, HNY_EXTRACTION_FLAGS_MANIFEST) == EINVAL, "static extraction accepted allocating flags");
+		cover_assert(hny_extraction_create_static(&extraction, hny, "archive-1.0.22", memory, size, 4096, 8 << 20, HNY_EXTRACTION_FLAGS_LINK) == EINVAL, "static extraction accepted linking to a base");
+		cover_assert(hny_extraction_create_static(&extraction, hny, "archive-1.0.22", memory, size, 4096, 8 << 20, HNY_EXTRACTION_FLAGS_SPARSE) == 0, "hny_extraction_create_static");
+
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_ARCHIVE);
+		while ((readval = read(fd, buffer, sizeof (buffer)), readval > 0)
+			&& (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK));
+		close(fd);
+
+		cover_assert(status == HNY_EXTRACTION_STATUS_END, "static extraction failed");
+		hny_extraction_destroy(extraction);
+		free(memory);
+		hny_close(hny);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.22/pkg/setup", &st) == 0, "stat archive-1.0.22/pkg/setup");
+		cover_assert(st.st_size == 046 && st.st_mode == (S_IFREG | 0755), "archive-1.0.22/pkg/setup has invalid attributes");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.22/pkg/sparse", &st) == 0 && st.st_blocks * 512 < st.st_size, "archive-1.0.22/pkg/sparse is not sparse");
+	}
+
+	{ /* honey extract-bundle */
+		char * const cmd0[] = { "hny", "extract-bundle", "--jobs", "2", HNY_TEST_BUNDLE, NULL };
+		const struct hny_bundle_member *members;
+		struct hny_bundle *bundle;
+		char *data;
+		int fd;
+
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0 && fstat(fd, &st) == 0, "open "HNY_TEST_ARCHIVE);
+		data = malloc(st.st_size);
+		cover_assert(data != NULL && read(fd, data, st.st_size) == st.st_size, "read "HNY_TEST_ARCHIVE);
+		close(fd);
+
+		const struct hny_bundle_member written[] = {
+			{ .package = "archive-1.0.23", .data = data, .size = st.st_size },
+			{ .package = "archive-1.0.24", .data = data, .size = st.st_size },
+		};
+
+		fd = open(HNY_TEST_BUNDLE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		cover_assert(fd >= 0, "open "HNY_TEST_BUNDLE);
+		cover_assert(hny_bundle_write(fd, written, 2) == 0, "hny_bundle_write");
+		close(fd);
+
+		fd = open(HNY_TEST_BUNDLE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_BUNDLE);
+		cover_assert(hny_bundle_open(&bundle, fd) == 0, "hny_bundle_open");
+		close(fd);
+
+		cover_assert(hny_bundle_members(bundle, &members) == 2, "bundle has an invalid number of members");
+		cover_assert(strcmp(members[1].package, "archive-1.0.24") == 0 && members[1].size == st.st_size
+			&& memcmp(members[1].data, data, st.st_size) == 0, "bundle member archive-1.0.24 is invalid");
+		hny_bundle_close(bundle);
+		free(data);
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.23/pkg/setup", &st) == 0, "stat archive-1.0.23/pkg/setup");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.24/pkg/setup", &st) == 0, "stat archive-1.0.24/pkg/setup");
+		cover_assert(st.st_size == 046 && st.st_mode == (S_IFREG | 0755), "archive-1.0.24/pkg/setup has invalid attributes");
+	}
+
+	{ /* honey extract --delta */
+		char * const cmd0[] = { "hny", "extract", "--delta", "archive-1.0.0", "--link", "archive-1.0.25", HNY_TEST_DELTA, NULL };
+		char buffer[64];
+		struct stat basest;
+		int fd;
+
+		hny(cmd0);
+
+		fd = open(HNY_TEST_PREFIX"/archive-1.0.25/pkg/setup", O_RDONLY);
+		cover_assert(fd >= 0 && fstat(fd, &st) == 0, "open archive-1.0.25/pkg/setup");
+		cover_assert(st.st_size == 044 && st.st_mode == (S_IFREG | 0755), "archive-1.0.25/pkg/setup has invalid attributes");
+		cover_assert(read(fd, buffer, sizeof (buffer)) == 044 && memcmp(buffer, "#!/bin/sh\necho \"Test Delta - Setup\"\n", 044) == 0, "archive-1.0.25/pkg/setup was not patched");
+		close(fd);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.0/pkg/setup", &basest) == 0 && basest.st_size == 046, "archive-1.0.0/pkg/setup was modified");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.0/pkg/sparse", &basest) == 0, "stat archive-1.0.0/pkg/sparse");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.25/pkg/sparse", &st) == 0 && st.st_ino == basest.st_ino, "archive-1.0.25/pkg/sparse is not linked to the base");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.25/doc/readme", &st) == 0 && st.st_size == 6, "archive-1.0.25/doc/readme was not added");
+		cover_assert(access(HNY_TEST_PREFIX"/archive-1.0.25/pkg/clean", F_OK) != 0, "archive-1.0.25/pkg/clean was not removed");
+		cover_assert(access(HNY_TEST_PREFIX"/archive-1.0.25/"HNY_DELTA_DIRECTORY, F_OK) != 0, "archive-1.0.25 still has its delta directory");
+	}
+
+	{ /* honey extract --delta, against a base file with the size and modification time of the archived one */
+		char * const cmd0[] = { "hny", "extract", "--mtime", "archive-1.0.30", HNY_TEST_ARCHIVE, NULL };
+		char * const cmd1[] = { "hny", "extract", "--delta", "archive-1.0.30", "--link", "archive-1.0.31", HNY_TEST_DELTA, NULL };
+		const struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, { .tv_sec = 0 } };
+		char buffer[64];
+		int fd;
+
+		hny(cmd0);
+
+		fd = open(HNY_TEST_PREFIX"/archive-1.0.30/doc/readme", O_WRONLY | O_CREAT | O_EXCL, 0644);
+		cover_assert(fd >= 0, "open archive-1.0.30/doc/readme");
+		cover_assert(write(fd, "delta\n", 6) == 6 && futimens(fd, times) == 0, "write archive-1.0.30/doc/readme");
+		close(fd);
+
+		hny(cmd1);
+
+		fd = open(HNY_TEST_PREFIX"/archive-1.0.31/doc/readme", O_RDONLY);
+		cover_assert(fd >= 0 && fstat(fd, &st) == 0, "open archive-1.0.31/doc/readme");
+		cover_assert(st.st_mode == (S_IFREG | 0644) && read(fd, buffer, sizeof (buffer)) == 6 && memcmp(buffer, "Delta\n", 6) == 0,
+			"archive-1.0.31/doc/readme was kept from the base");
+		close(fd);
+
+		fd = open(HNY_TEST_PREFIX"/archive-1.0.30/doc/readme", O_RDONLY);
+		cover_assert(fd >= 0 && read(fd, buffer, sizeof (buffer)) == 6 && memcmp(buffer, "delta\n", 6) == 0, "archive-1.0.30/doc/readme was modified");
+		close(fd);
+	}
+
+	{ /* honey pack */
+		char * const cmd0[] = { "hny", "pack", "--jobs", "2", HNY_TEST_PREFIX"/archive-1.0.0", HNY_TEST_PACKED, NULL };
+		char * const cmd1[] = { "hny", "extract", "--parallel", "archive-1.0.26", HNY_TEST_PACKED, NULL };
+		const char * const unordered[] = { "pkg/setup", "pkg" };
+		char buffer[64];
+		int dirfd, fd;
+
+		hny(cmd0);
+		hny(cmd1);
+
+		fd = open(HNY_TEST_PREFIX"/archive-1.0.26/pkg/setup", O_RDONLY);
+		cover_assert(fd >= 0 && fstat(fd, &st) == 0, "open archive-1.0.26/pkg/setup");
+		cover_assert(st.st_size == 046 && st.st_mode == (S_IFREG | 0755), "archive-1.0.26/pkg/setup has invalid attributes");
+		cover_assert(read(fd, buffer, sizeof (buffer)) == 046 && memcmp(buffer, "#!/bin/sh\necho \"Test Archive - Setup\"\n", 046) == 0, "archive-1.0.26/pkg/setup has an invalid content");
+		close(fd);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.26/pkg/sparse", &st) == 0 && st.st_size == 04000000, "archive-1.0.26/pkg/sparse has an invalid size");
+
+		dirfd = open(HNY_TEST_PREFIX"/archive-1.0.0", O_RDONLY | O_DIRECTORY);
+		fd = open(HNY_TEST_PACKED, O_WRONLY | O_TRUNC);
+		cover_assert(dirfd >= 0 && fd >= 0, "open "HNY_TEST_PACKED);
+		cover_assert(hny_pack(dirfd, unordered, 2, fd, 1, HNY_PACK_FLAGS_NONE) == EINVAL, "hny_pack accepted a file before its directory");
+		close(fd);
+		close(dirfd);
+	}
+
+	{ /* honey pack --toc */
+		char * const cmd0[] = { "hny", "pack", "--toc", HNY_TEST_PREFIX"/archive-1.0.0", HNY_TEST_PACKED, NULL };
+		char * const cmd1[] = { "hny", "extract", "archive-1.0.27", HNY_TEST_PACKED, NULL };
+		char * const cmd2[] = { "hny", "-p", HNY_TEST_PREFIX"/nonexistent", "contents", HNY_TEST_PACKED, NULL };
+		struct hny_archive_entry *entries;
+		size_t count;
+		int fd;
+
+		hny(cmd0);
+
+		fd = open(HNY_TEST_PACKED, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_PACKED);
+		cover_assert(hny_archive_list(fd, &entries, &count) == 0, "hny_archive_list");
+		close(fd);
+
+		cover_assert(count == 5, "table of contents has an invalid number of entries");
+		cover_assert(strcmp(entries[0].path, "pkg") == 0 && entries[0].mode == (S_IFDIR | 0755), "table of contents doesn't start with pkg");
+		cover_assert(strcmp(entries[2].path, "pkg/setup") == 0 && entries[2].size == 046 && entries[2].mode == (S_IFREG | 0755),
+			"table of contents has an invalid pkg/setup");
+		cover_assert(entries[1].offset > entries[0].offset && entries[2].offset == entries[1].offset + 76 + sizeof ("pkg/clean") + entries[1].size,
+			"table of contents has invalid offsets");
+		free(entries);
+
+		hny(cmd1);
+		/* Listing needs no prefix */
+		hny(cmd2);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.27/pkg/setup", &st) == 0 && st.st_size == 046, "stat archive-1.0.27/pkg/setup");
+		cover_assert(access(HNY_TEST_PREFIX"/archive-1.0.27/"HNY_TOC_FILE, F_OK) != 0, "archive-1.0.27 has its table of contents extracted");
+
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_ARCHIVE);
+		cover_assert(hny_archive_list(fd, &entries, &count) == ENOENT, "hny_archive_list found a table of contents in "HNY_TEST_ARCHIVE);
+		close(fd);
+	}
+
+	{ /* honey extract-bundle, following other content, of a member whose first block is smaller than the others */
+		char * const cmd0[] = { "hny", "extract-bundle", HNY_TEST_BUNDLE, NULL };
+		char *data;
+		int fd;
+
+		fd = open(HNY_TEST_PACKED, O_RDONLY);
+		cover_assert(fd >= 0 && fstat(fd, &st) == 0, "open "HNY_TEST_PACKED);
+		data = malloc(st.st_size);
+		cover_assert(data != NULL && read(fd, data, st.st_size) == st.st_size, "read "HNY_TEST_PACKED);
+		close(fd);
+
+		const struct hny_bundle_member written[] = {
+			{ .package = "archive-1.0.29", .data = data, .size = st.st_size },
+		};
+
+		fd = open(HNY_TEST_BUNDLE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		cover_assert(fd >= 0, "open "HNY_TEST_BUNDLE);
+		cover_assert(write(fd, "#!/bin/false\n", 13) == 13, "write "HNY_TEST_BUNDLE);
+		cover_assert(hny_bundle_write(fd, written, 1) == 0, "hny_bundle_write");
+		close(fd);
+		free(data);
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.29/pkg/sparse", &st) == 0 && st.st_size == 04000000, "archive-1.0.29/pkg/sparse has an invalid size");
+	}
+
+	{ /* Writes of large regular files are coalesced */
+		struct hny_extraction_stats stats;
+		struct hny_extraction *extraction;
+		enum hny_extraction_status status;
+		struct hny *hny;
+		char buffer[4096];
+		ssize_t readval;
+		int fd;
+
+		cover_assert(hny_open(&hny, getenv("HNY_PREFIX"), HNY_FLAGS_NONE) == 0, "hny_open");
+		cover_assert(hny_extraction_create(&extraction, hny, "archive-1.0.28") == 0, "hny_extraction_create");
+
+		fd = open(HNY_TEST_LARGE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_LARGE);
+		while ((readval = read(fd, buffer, sizeof (buffer)), readval > 0)
+			&& (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK));
+		close(fd);
+
+		cover_assert(status == HNY_EXTRACTION_STATUS_END, "large extraction didn't end");
+		hny_extraction_stats(extraction, &stats);
+		hny_extraction_destroy(extraction);
+		hny_close(hny);
+
+		/* Opening and closing, then about one write per megabyte rather than one per decoded window */
+		cover_assert(stats.entries[HNY_EXTRACTION_ENTRY_REGULAR] == 1, "large extraction has an invalid number of regular files");
+		cover_assert(stats.syscalls[HNY_EXTRACTION_ENTRY_REGULAR] <= 2 + (HNY_TEST_LARGE_SIZE >> 20) + 1, "large extraction writes weren't coalesced");
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.28/pkg/large", &st) == 0 && st.st_size == HNY_TEST_LARGE_SIZE, "archive-1.0.28/pkg/large has an invalid size");
+	}
+
+	{ /* honey extract --verify */
+		char * const cmd0[] = { "hny", "extract", "--verify", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(access(HNY_TEST_PREFIX"/archive", F_OK) != 0, "verification created a package");
+	}
+
+	{ /* honey extract --verify, without any prefix */
+		char * const cmd0[] = { "hny", "-p", HNY_TEST_PREFIX"/nonexistent", "extract", "--verify", HNY_TEST_ARCHIVE, NULL };
+
+		hny(cmd0);
+
+		cover_assert(access(HNY_TEST_PREFIX"/nonexistent", F_OK) != 0, "verification created a prefix");
+	}
+
+	{ /* Extraction to an in-memory sink */
+		const struct hny_memory_entry *entries, *entry;
+		struct hny_extraction *extraction;
+		enum hny_extraction_status status;
+		struct hny_memory *memory;
+		char buffer[4096];
+		ssize_t readval;
+		int fd;
+
+		cover_assert(hny_memory_create(&memory) == 0, "hny_memory_create");
+		cover_assert(hny_extraction_create_sink(&extraction, &hny_memory_sink, memory, 4096, UINT32_MAX, HNY_EXTRACTION_FLAGS_NONE) == 0, "hny_extraction_create_sink");
+
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_ARCHIVE);
+		while ((readval = read(fd, buffer, sizeof (buffer)), readval > 0)
+			&& (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK));
+		close(fd);
+
+		cover_assert(status == HNY_EXTRACTION_STATUS_END, "in-memory extraction failed");
+		hny_extraction_destroy(extraction);
+
+		cover_assert(hny_memory_entries(memory, &entries) == 5, "in-memory extraction has an invalid number of entries");
+		cover_assert(strcmp(entries[0].path, "pkg/") == 0 && entries[0].mode == (S_IFDIR | 0755), "in-memory pkg is not a directory");
+
+		entry = hny_memory_find(memory, "pkg/setup");
+		cover_assert(entry != NULL, "in-memory pkg/setup not found");
+		cover_assert(entry->mode == (S_IFREG | 0755), "in-memory pkg/setup is not an executable regular file");
+		cover_assert(entry->size == 046 && memcmp(entry->data, "#!/bin/sh\necho \"Test Archive - Setup\"\n", 046) == 0, "in-memory pkg/setup has an invalid content");
+
+		cover_assert(access(HNY_TEST_PREFIX"/pkg", F_OK) != 0, "in-memory extraction touched the prefix");
+
+		hny_memory_destroy(memory);
+	}
+
+	{ /* honey extract --metadata, stopping once past pkg/ */
+		char * const cmd0[] = { "hny", "extract", "--metadata", "archive-1.0.16", HNY_TEST_ARCHIVE, NULL };
+		const struct hny_memory_entry *entries;
+		struct hny_extraction *extraction;
+		enum hny_extraction_status status;
+		struct hny_memory *memory;
+		char buffer[4096];
+		ssize_t readval;
+		int fd;
+
+		hny(cmd0);
+
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.16/pkg/setup", &st) == 0, "stat archive-1.0.16/pkg/setup");
+		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.16/doc", &st) != 0, "archive-1.0.16/doc was extracted");
+
+		cover_assert(hny_memory_create(&memory) == 0, "hny_memory_create");
+		cover_assert(hny_extraction_create_sink(&extraction, &hny_memory_sink, memory, 4096, UINT32_MAX, HNY_EXTRACTION_FLAGS_METADATA) == 0, "hny_extraction_create_sink");
+
+		fd = open(HNY_TEST_ARCHIVE, O_RDONLY);
+		cover_assert(fd >= 0, "open "HNY_TEST_ARCHIVE);
+		while ((readval = read(fd, buffer, sizeof (buffer)), readval > 0)
+			&& (status = hny_extraction_extract(extraction, buffer, readval), status == HNY_EXTRACTION_STATUS_OK));
+		close(fd);
+
+		cover_assert(status == HNY_EXTRACTION_STATUS_STOPPED, "metadata extraction didn't stop");
+		hny_extraction_destroy(extraction);
+
+		cover_assert(hny_memory_entries(memory, &entries) == 4, "metadata extraction has an invalid number of entries");
+
+		hny_memory_destroy(memory);
+	}
+
 	{/* honey shift */
 		char * const cmd0[] = { "hny", "shift", "archive", "archive-1.0.0", NULL };
 		char * const cmd1[] = { "hny", "shift", "arxiv", "archive", NULL };
@@ -238,7 +1049,7 @@ test_hny(void) {
 
 	{/* honey remove */
 		char * const cmd0[] = { "hny", "remove", "arxiv", NULL };
-		char * const cmd1[] = { "hny", "remove", "archive", "archive-1.0.0", NULL };
+		char * const cmd1[] = { "hny", "remove", "archive", "archive-1.0.0", "archive-1.0.1", "archive-1.0.2", "archive-1.0.3", "archive-1.0.4", "archive-1.0.5", "archive-1.0.6", "archive-1.0.7", "archive-1.0.8", "archive-1.0.9", "archive-1.0.10", "archive-1.0.11", "archive-1.0.12", "archive-1.0.13", "archive-1.0.14", "archive-1.0.15", "archive-1.0.16", "archive-1.0.18", "archive-1.0.19", "archive-1.0.20", "archive-1.0.21", "archive-1.0.22", "archive-1.0.23", "archive-1.0.24", "archive-1.0.25", "archive-1.0.26", "archive-1.0.27", "archive-1.0.28", "archive-1.0.29", "archive-1.0.30", "archive-1.0.31", "archive-1.0.32", NULL };
 
 		hny(cmd0);
 
@@ -247,6 +1058,9 @@ test_hny(void) {
 		cover_assert(lstat(HNY_TEST_PREFIX"/archive-1.0.0", &st) == 0, "stat archive-1.0.0");
 
 		hny(cmd1);
+
+		/* Check whether removal collected unused objects */
+		cover_assert(rmdir(HNY_TEST_PREFIX"/.objects") == 0, "rmdir .objects");
 	}
 }
 